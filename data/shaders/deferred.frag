@@ -1,5 +1,7 @@
 #version 330
 
+const int MAX_CASCADES = 4;
+
 //light structs and uniforms
 struct Light {
     vec4 position;
@@ -12,6 +14,10 @@ struct Light {
     mat4 view_projection;
     int type; // 0 - directional; 1 - point; 2 - spot
     int cast_shadow; // 0 - false; 1 - true
+    vec4 shadow_rect; // tile in shadow atlas: offset, scale
+    mat4 cascade_view_projection[MAX_CASCADES]; // directional only
+    vec4 cascade_rect[MAX_CASCADES];
+    int num_cascades; // 0 - single map above
 };
 
 //...light struct as before.../
@@ -20,7 +26,7 @@ in vec2 v_uv;
 out vec4 fragColor;
 
 uniform int u_num_lights;
-const int MAX_LIGHTS = 8;
+const int MAX_LIGHTS = 16;
 layout (std140) uniform u_lights_ubo
 {
     Light lights[MAX_LIGHTS];
@@ -32,7 +38,7 @@ uniform sampler2D u_tex_normal;
 uniform sampler2D u_tex_albedo;
 
 //shadows
-uniform sampler2D u_shadow_map[MAX_LIGHTS];
+uniform sampler2D u_shadow_atlas;
 
 float random(vec4 seed4){
     float dot_product = dot(seed4, vec4(12.9898,78.233,45.164,94.673));
@@ -46,7 +52,30 @@ vec2 poissonDisk[4] = vec2[](
                              vec2( 0.34495938, 0.29387760 )
                              );
 
-float shadowCalculationPoisson(vec4 fragment_light_space, float NdotL, int light_index) {
+//light clip space position of a world position, and tile of the shadow
+//map to look it up in: for lights with cascades, the first cascade which
+//holds it (so the one with most detail)
+vec4 shadowLightSpace(int light_index, vec3 position, out vec4 rect) {
+    rect = lights[light_index].shadow_rect;
+    vec4 light_space = lights[light_index].view_projection * vec4(position, 1.0);
+    for (int c = 0; c < lights[light_index].num_cascades; c++) {
+        light_space = lights[light_index].cascade_view_projection[c] * vec4(position, 1.0);
+        rect = lights[light_index].cascade_rect[c];
+        vec3 p = abs(light_space.xyz);
+        if (max(p.x, p.y) < 0.99 && p.z < 1.0)
+            break;
+    }
+    return light_space;
+}
+
+//maps uv in a shadow map to its tile of the atlas, kept half a texel
+//inside the tile so filtering never reads a neighbouring tile
+vec2 shadowAtlasUV(vec2 uv, vec4 rect) {
+    vec2 half_texel = 0.5 / (vec2(textureSize(u_shadow_atlas, 0)) * rect.zw);
+    return rect.xy + clamp(uv, half_texel, 1.0 - half_texel) * rect.zw;
+}
+
+float shadowCalculationPoisson(vec4 fragment_light_space, float NdotL, vec4 rect) {
     
     //gl_position does this divide automatically. But we need to do it manually
     //result is current fragment coordinates in light clip space
@@ -68,13 +97,12 @@ float shadowCalculationPoisson(vec4 fragment_light_space, float NdotL, int light
         
         float bias = max(0.05 * (1.0 - NdotL), 0.005);
 
-        vec2 texel_size = 1.0 / textureSize(u_shadow_map[light_index], 0);
+        vec2 texel_size = 1.0 / (vec2(textureSize(u_shadow_atlas, 0)) * rect.zw);
         for (int i = 0;i < 4; i++){
             
             int index = int(4*random(vec4(gl_FragCoord.xyy, i))) % 4;
             
-            float poisson_depth = texture( u_shadow_map[light_index],
-                                          proj_coords.xy + poissonDisk[index] * texel_size).r;
+            float poisson_depth = texture(u_shadow_atlas, shadowAtlasUV(proj_coords.xy + poissonDisk[index] * texel_size, rect)).r;
             
             shadow += current_depth - bias > poisson_depth ? 1.0 : 0.0;
         }
@@ -135,9 +163,10 @@ void main() {
         RdotV = pow(RdotV, 30.0);
         vec3 specular_color = RdotV * albedo_spec.w * lights[i].color.xyz;
         
-        vec4 position_light_space = lights[i].view_projection * vec4(position, 1.0);
+        vec4 shadow_rect;
+        vec4 position_light_space = shadowLightSpace(i, position, shadow_rect);
         
-        float shadow = (lights[i].cast_shadow == 1 ? shadowCalculationPoisson(position_light_space, NdotL, i) : 0.0);
+        float shadow = (lights[i].cast_shadow == 1 ? shadowCalculationPoisson(position_light_space, NdotL, shadow_rect) : 0.0);
 
         final_color += ((diffuse_color + specular_color) * attenuation * spot_cone_intensity) * (1.0 - shadow);
     }
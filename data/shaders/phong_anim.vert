@@ -16,7 +16,7 @@ uniform mat4 u_skin_bind_matrix;
 uniform mat4 u_mvp;
 uniform mat4 u_vp;
 uniform mat4 u_model;
-uniform mat4 u_normal_matrix;
+uniform mat3 u_normal_matrix;
 uniform vec3 u_cam_pos;
 
 out vec2 v_uv;
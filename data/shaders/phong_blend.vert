@@ -14,7 +14,7 @@ layout(location = 10) in vec3 a_blend7;
 
 uniform mat4 u_mvp;
 uniform mat4 u_model;
-uniform mat4 u_normal_matrix;
+uniform mat3 u_normal_matrix;
 uniform vec3 u_cam_pos;
 
 const int MAX_BLEND_SHAPES = 8;
@@ -43,7 +43,7 @@ void main(){
     
 	v_uv = a_uv;
 	//rotate normal & tangent
-	v_normal = (u_normal_matrix * vec4(a_normal, 1.0)).xyz;
+	v_normal = u_normal_matrix * a_normal;
     
 	//calculate world position of current vertex
 	v_vertex_world_pos = (u_model * vec4(mod_vertex, 1.0)).xyz;
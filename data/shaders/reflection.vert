@@ -4,9 +4,22 @@ layout(location = 0) in vec3 a_vertex;
 layout(location = 1) in vec2 a_uv;
 layout(location = 2) in vec3 a_normal;
 
-uniform mat4 u_mvp;
-uniform mat4 u_model;
-uniform mat4 u_normal_matrix;
+#ifdef INSTANCED
+//per instance matrices, see GraphicsSystem::renderInstances_
+layout(location = 9) in mat4 a_model;
+layout(location = 13) in mat3 a_normal_matrix;
+uniform mat4 u_vp;
+#define u_model a_model
+#define u_normal_matrix a_normal_matrix
+#define u_mvp (u_vp * a_model)
+#else
+//per object, see GraphicsSystem::uploadFrameUniforms_
+layout (std140) uniform u_object_ubo {
+    mat4 u_mvp;
+    mat4 u_model;
+    mat3 u_normal_matrix;
+};
+#endif
 
 
 out vec2 v_uv;
@@ -18,7 +31,7 @@ void main(){
 
 	v_uv = a_uv;
 	//rotate normal 
-	v_normal = (u_normal_matrix * vec4(a_normal, 1.0)).xyz;
+	v_normal = u_normal_matrix * a_normal;
 
 	//calculate world position of current vertex
 	v_vertex_world_pos = (u_model * vec4(a_vertex, 1.0)).xyz;
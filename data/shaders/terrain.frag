@@ -2,7 +2,8 @@
 
 #define SOFT_SHADOWS
 
-const int MAX_LIGHTS = 8;
+const int MAX_LIGHTS = 16;
+const int MAX_CASCADES = 4;
 
 //varyings and out color
 in vec2 v_uv;
@@ -54,6 +55,10 @@ struct Light {
     mat4 view_projection;
     int type; // 0 - directional; 1 - point; 2 - spot
     int cast_shadow; // 0 - false; 1 - true
+    vec4 shadow_rect; // tile in shadow atlas: offset, scale
+    mat4 cascade_view_projection[MAX_CASCADES]; // directional only
+    vec4 cascade_rect[MAX_CASCADES];
+    int num_cascades; // 0 - single map above
 };
 
 uniform int u_num_lights;
@@ -61,10 +66,33 @@ layout (std140) uniform u_lights_ubo
 {
     Light lights[MAX_LIGHTS];
 };
-uniform sampler2D u_shadow_map[MAX_LIGHTS];
+uniform sampler2D u_shadow_atlas;
+
+//light clip space position of a world position, and tile of the shadow
+//map to look it up in: for lights with cascades, the first cascade which
+//holds it (so the one with most detail)
+vec4 shadowLightSpace(int light_index, vec3 position, out vec4 rect) {
+    rect = lights[light_index].shadow_rect;
+    vec4 light_space = lights[light_index].view_projection * vec4(position, 1.0);
+    for (int c = 0; c < lights[light_index].num_cascades; c++) {
+        light_space = lights[light_index].cascade_view_projection[c] * vec4(position, 1.0);
+        rect = lights[light_index].cascade_rect[c];
+        vec3 p = abs(light_space.xyz);
+        if (max(p.x, p.y) < 0.99 && p.z < 1.0)
+            break;
+    }
+    return light_space;
+}
+
+//maps uv in a shadow map to its tile of the atlas, kept half a texel
+//inside the tile so filtering never reads a neighbouring tile
+vec2 shadowAtlasUV(vec2 uv, vec4 rect) {
+    vec2 half_texel = 0.5 / (vec2(textureSize(u_shadow_atlas, 0)) * rect.zw);
+    return rect.xy + clamp(uv, half_texel, 1.0 - half_texel) * rect.zw;
+}
 
 //calculate shadows
-float shadowCalculationPCF(vec4 fragment_light_space, float NdotL, int light_index) {
+float shadowCalculationPCF(vec4 fragment_light_space, float NdotL, vec4 rect) {
     
     vec3 proj_coords = fragment_light_space.xyz / fragment_light_space.w;
     proj_coords = proj_coords * 0.5 + 0.5;
@@ -77,11 +105,10 @@ float shadowCalculationPCF(vec4 fragment_light_space, float NdotL, int light_ind
         
         float bias = max(0.001 * (1.0 - NdotL), 0.001);
         //PCF
-        vec2 texel_size = 1.0 / textureSize(u_shadow_map[light_index], 0);
+        vec2 texel_size = 1.0 / (vec2(textureSize(u_shadow_atlas, 0)) * rect.zw);
         for (int x = -1; x <= 1; x++) {
             for (int y = -1; y <= 1; y++) {
-                float pcf_depth = texture(u_shadow_map[light_index],
-                                          proj_coords.xy + vec2(x,y) * texel_size).r;
+                float pcf_depth = texture(u_shadow_atlas, shadowAtlasUV(proj_coords.xy + vec2(x,y) * texel_size, rect)).r;
                 shadow += current_depth - bias > pcf_depth ? 1.0 : 0.0;
             }
         }
@@ -229,9 +256,10 @@ void main(){
         vec3 specular_color = RdotV * lights[i].color.xyz * mat_specular;
         
         //shadow
-        vec4 position_light_space = lights[i].view_projection * vec4(v_vertex_world_pos, 1.0);
+        vec4 shadow_rect;
+        vec4 position_light_space = shadowLightSpace(i, v_vertex_world_pos, shadow_rect);
         
-        float shadow = (lights[i].cast_shadow == 1 ? shadowCalculationPCF(position_light_space, NdotL, i) : 0.0);
+        float shadow = (lights[i].cast_shadow == 1 ? shadowCalculationPCF(position_light_space, NdotL, shadow_rect) : 0.0);
         
         //final color
         final_color += ((diffuse_color + specular_color) * attenuation * spot_cone_intensity) * (1.0 - shadow);
@@ -22,38 +22,48 @@ void AnimationSystem::lateInit() {
 }
 
 void AnimationSystem::update(float dt) {
-    //frame counter
-    
-    bool trigger_frame = false;
+    updateClock(dt);
+    updateTransforms();
+    updateSkinning();
+}
+
+//frame counter
+void AnimationSystem::updateClock(float dt) {
+    trigger_frame_ = false;
     //increment millisecond counter
     ms_counter_ += dt * 1000;
     //if counter above threshold
     if (ms_counter_ >= ms_per_frame_) {
-        trigger_frame = true;
+        trigger_frame_ = true;
         ms_counter_ = 0;
     }
-    
-    //animation component
-    auto& anims = ECS.getAllComponents<Animation>();
-    for (auto& anim : anims) {
-        //get transform
+}
+
+//animation components
+void AnimationSystem::updateTransforms() {
+    //nothing changes between frames
+    if (!trigger_frame_) return;
+    //each animation writes only transform of its entity, so in parallel
+    auto anims = ECS.getEnabledComponents<Animation>();
+    JOBS.parallel_for(0, (int)anims.size(), 64, [&](int i) {
+        Animation& anim = anims[i];
+        if (!ECS.hasComponent<Transform>(anim.owner)) return;
         Transform& transform = ECS.getComponentFromEntity<Transform>(anim.owner);
-        
-        //if new frame
-        if (trigger_frame) {
-            //set positions to current frame
-            transform.set(anim.keyframes[anim.curr_frame]);
-            //advance frame
-            anim.curr_frame++;
-            //loop if required
-            if (anim.curr_frame == anim.num_frames)
-                anim.curr_frame = 0;
-        }
-    }
+        //set positions to current frame
+        transform.set(anim.keyframes[anim.curr_frame]);
+        ECS.markDirty(transform);
+        //advance frame
+        anim.curr_frame++;
+        //loop if required
+        if (anim.curr_frame == anim.num_frames)
+            anim.curr_frame = 0;
+    });
+}
 
-    
-    //skinned mesh joints
-    auto& skinnedmeshes = ECS.getAllComponents<SkinnedMesh>();
+//skinned mesh joints and blend shapes
+void AnimationSystem::updateSkinning() {
+    const bool trigger_frame = trigger_frame_;
+    auto skinnedmeshes = ECS.getEnabledComponents<SkinnedMesh>();
     for (auto& sm : skinnedmeshes) {
         if (!sm.root) continue; //only if mesh has a joint chain!
         if (trigger_frame) {
@@ -81,7 +91,7 @@ void AnimationSystem::incrementJointFrame_(Joint* joint) {
 }
 
 void AnimationSystem::deformBlendShapes_() {
-    auto& blend_components = ECS.getAllComponents<BlendShapes>();
+    auto blend_components = ECS.getEnabledComponents<BlendShapes>();
     for (auto& blend_comp : blend_components) {
         //check entity has parent mesh
         if (!ECS.hasComponent<Mesh>(blend_comp.owner)) {
@@ -9,9 +9,16 @@ public:
     void init();
     void lateInit();
     void update(float dt);
+
+    //update() split in parts, for SystemScheduler. updateClock must be
+    //called first every frame, then the other two can run in parallel
+    void updateClock(float dt);
+    void updateTransforms();
+    void updateSkinning();
     
 private:
     GLuint curr_frame_ = 0;
+    bool trigger_frame_ = false;
     float ms_per_frame_ = 41.666f;
     float ms_counter_ = 0;
     
@@ -0,0 +1,303 @@
+#pragma once
+#include "Components.h"
+#include <vector>
+#include <memory>
+#include <new>
+#include <tuple>
+#include <utility>
+
+/**** ARCHETYPE STORAGE ****/
+
+//experimental alternative component storage, only used by the 'ecs'
+//benchmark to compare with ComponentArrays; the ECS and its systems do not
+//use it. Entities with the same set of component types (their
+//'archetype') live together in fixed size chunks, and inside a chunk
+//every component type has its own column (SoA), e.g. for Transform + Collider
+//    | entity ids ... | Transform Transform ... | Collider Collider ... |
+//so a loop which only reads colliders does not pull transforms into cache.
+//Rows are kept packed: deleting an entity moves the last row of the
+//archetype into the hole, so all chunks but the last one are always full
+
+//size in bytes of a chunk
+const size_t ARCHETYPE_CHUNK_SIZE = 16 * 1024;
+
+//number of component types which can be stored (as in ComponentArrays)
+const int NUM_ARCHETYPE_TYPES = (int)std::tuple_size<ComponentArrays>::value;
+
+//functions to handle a component type without knowing it, as columns are
+//raw bytes
+struct ComponentTypeInfo {
+    size_t size;
+    size_t align;
+    void (*construct)(void* dst);
+    void (*destroy)(void* ptr);
+    //move constructs dst from src, then destroys src
+    void (*relocate)(void* dst, void* src);
+};
+
+template<typename T>
+ComponentTypeInfo makeComponentTypeInfo() {
+    ComponentTypeInfo info;
+    info.size = sizeof(T);
+    info.align = alignof(T);
+    info.construct = [](void* dst) { new (dst) T(); };
+    info.destroy = [](void* ptr) { static_cast<T*>(ptr)->~T(); };
+    info.relocate = [](void* dst, void* src) {
+        new (dst) T(std::move(*static_cast<T*>(src)));
+        static_cast<T*>(src)->~T();
+    };
+    return info;
+}
+
+template<size_t... Is>
+const ComponentTypeInfo* buildComponentTypeInfos(std::index_sequence<Is...>) {
+    static const ComponentTypeInfo infos[] = {
+        makeComponentTypeInfo<typename std::tuple_element<Is, ComponentArrays>::type::value_type>()...
+    };
+    return infos;
+}
+
+//returns info of type index (as in type2int)
+inline const ComponentTypeInfo& componentTypeInfo(int type) {
+    static const ComponentTypeInfo* infos =
+        buildComponentTypeInfos(std::make_index_sequence<NUM_ARCHETYPE_TYPES>());
+    return infos[type];
+}
+
+struct ArchetypeChunk {
+    alignas(64) unsigned char data[ARCHETYPE_CHUNK_SIZE];
+    int count = 0;
+};
+
+//all chunks of one set of component types
+struct Archetype {
+    ComponentMask mask = 0;
+    //rows per chunk
+    int capacity = 0;
+    size_t entity_offset = 0;
+    //byte offset of column of each type inside chunk (if type is in mask)
+    size_t column_offsets[NUM_ARCHETYPE_TYPES] = {};
+    std::vector<std::unique_ptr<ArchetypeChunk>> chunks;
+
+    Archetype(ComponentMask a_mask) : mask(a_mask) {
+        size_t row_size = sizeof(int);
+        for (int t = 0; t < NUM_ARCHETYPE_TYPES; t++)
+            if (has(t)) row_size += componentTypeInfo(t).size;
+        //padding to align columns might not fit, so shrink until it does
+        capacity = (int)(ARCHETYPE_CHUNK_SIZE / row_size);
+        while (capacity > 1 && !layout_()) capacity--;
+        layout_();
+    }
+
+    bool has(int type) const { return ((mask >> type) & 1u) != 0; }
+
+    int* entityColumn(ArchetypeChunk& chunk) {
+        return reinterpret_cast<int*>(chunk.data + entity_offset);
+    }
+
+    template<typename T>
+    T* column(ArchetypeChunk& chunk) {
+        return reinterpret_cast<T*>(chunk.data + column_offsets[type2int<T>::result]);
+    }
+
+    void* at(ArchetypeChunk& chunk, int type, int row) {
+        return chunk.data + column_offsets[type] + row * componentTypeInfo(type).size;
+    }
+
+private:
+    //calculates column offsets for current capacity, false if it does not fit
+    bool layout_() {
+        size_t offset = 0;
+        entity_offset = offset;
+        offset += sizeof(int) * capacity;
+        for (int t = 0; t < NUM_ARCHETYPE_TYPES; t++) {
+            if (!has(t)) continue;
+            const ComponentTypeInfo& info = componentTypeInfo(t);
+            offset = (offset + info.align - 1) / info.align * info.align;
+            column_offsets[t] = offset;
+            offset += info.size * capacity;
+        }
+        return offset <= ARCHETYPE_CHUNK_SIZE;
+    }
+};
+
+//entity ids here are independent of ECS.entities
+struct ArchetypeStorage {
+
+    struct Location {
+        int archetype = -1;
+        int chunk = 0;
+        int row = 0;
+    };
+
+    std::vector<std::unique_ptr<Archetype>> archetypes;
+    //location of every entity id (archetype -1 if deleted)
+    std::vector<Location> locations;
+    std::vector<int> free_entities;
+
+    ArchetypeStorage() {}
+    ArchetypeStorage(const ArchetypeStorage&) = delete;
+    ArchetypeStorage& operator=(const ArchetypeStorage&) = delete;
+    ~ArchetypeStorage() { clear(); }
+
+    //creates entity with default constructed components of types in mask
+    int createEntity(ComponentMask mask) {
+        int id;
+        if (free_entities.size() > 0) {
+            id = free_entities.back();
+            free_entities.pop_back();
+        }
+        else {
+            id = (int)locations.size();
+            locations.emplace_back();
+        }
+        Location loc = allocateRow_(findOrCreateArchetype_(mask), id);
+        Archetype& arch = *archetypes[loc.archetype];
+        for (int t = 0; t < NUM_ARCHETYPE_TYPES; t++)
+            if (arch.has(t)) componentTypeInfo(t).construct(arch.at(*arch.chunks[loc.chunk], t, loc.row));
+        locations[id] = loc;
+        return id;
+    }
+
+    void deleteEntity(int id) {
+        Location loc = locations[id];
+        if (loc.archetype == -1) return;
+        Archetype& arch = *archetypes[loc.archetype];
+        for (int t = 0; t < NUM_ARCHETYPE_TYPES; t++)
+            if (arch.has(t)) componentTypeInfo(t).destroy(arch.at(*arch.chunks[loc.chunk], t, loc.row));
+        removeRow_(loc);
+        locations[id] = Location();
+        free_entities.push_back(id);
+    }
+
+    template<typename T>
+    bool hasComponent(int id) {
+        const Location& loc = locations[id];
+        return loc.archetype != -1 && archetypes[loc.archetype]->has(type2int<T>::result);
+    }
+
+    template<typename T>
+    T& getComponent(int id) {
+        const Location& loc = locations[id];
+        Archetype& arch = *archetypes[loc.archetype];
+        return arch.column<T>(*arch.chunks[loc.chunk])[loc.row];
+    }
+
+    //moves entity to archetype which also has T
+    template<typename T>
+    T& addComponent(int id) {
+        Archetype& arch = *archetypes[locations[id].archetype];
+        moveEntity_(id, arch.mask | componentMask<T>());
+        return getComponent<T>(id);
+    }
+
+    //moves entity to archetype without T
+    template<typename T>
+    void removeComponent(int id) {
+        Archetype& arch = *archetypes[locations[id].archetype];
+        moveEntity_(id, arch.mask & ~componentMask<T>());
+    }
+
+    //calls func(Ts&...) for every entity which has all of Ts
+    template<typename... Ts, typename F>
+    void each(F func) {
+        eachChunk<Ts...>([&](int count, Ts*... columns) {
+            for (int i = 0; i < count; i++)
+                func(columns[i]...);
+        });
+    }
+
+    //calls func(count, Ts*...) once per chunk with all of Ts, with a pointer
+    //to start of column of each type, for loops which work on whole columns
+    template<typename... Ts, typename F>
+    void eachChunk(F func) {
+        const ComponentMask m = componentMask<Ts...>();
+        for (auto& arch : archetypes) {
+            if ((arch->mask & m) != m) continue;
+            for (auto& chunk : arch->chunks)
+                func(chunk->count, arch->template column<Ts>(*chunk)...);
+        }
+    }
+
+    //deletes everything
+    void clear() {
+        for (auto& arch : archetypes) {
+            for (auto& chunk : arch->chunks) {
+                for (int t = 0; t < NUM_ARCHETYPE_TYPES; t++) {
+                    if (!arch->has(t)) continue;
+                    for (int row = 0; row < chunk->count; row++)
+                        componentTypeInfo(t).destroy(arch->at(*chunk, t, row));
+                }
+            }
+        }
+        archetypes.clear();
+        locations.clear();
+        free_entities.clear();
+    }
+
+private:
+    int findOrCreateArchetype_(ComponentMask mask) {
+        for (size_t i = 0; i < archetypes.size(); i++)
+            if (archetypes[i]->mask == mask) return (int)i;
+        archetypes.emplace_back(new Archetype(mask));
+        return (int)archetypes.size() - 1;
+    }
+
+    //adds an (unconstructed) row at end of archetype
+    Location allocateRow_(int arch_index, int id) {
+        Archetype& arch = *archetypes[arch_index];
+        if (arch.chunks.size() == 0 || arch.chunks.back()->count == arch.capacity)
+            arch.chunks.emplace_back(new ArchetypeChunk());
+        ArchetypeChunk& chunk = *arch.chunks.back();
+        Location loc;
+        loc.archetype = arch_index;
+        loc.chunk = (int)arch.chunks.size() - 1;
+        loc.row = chunk.count++;
+        arch.entityColumn(chunk)[loc.row] = id;
+        return loc;
+    }
+
+    //fills hole left by a row whose components are already destroyed or moved
+    //with last row of archetype
+    void removeRow_(Location loc) {
+        Archetype& arch = *archetypes[loc.archetype];
+        const int last_chunk_index = (int)arch.chunks.size() - 1;
+        ArchetypeChunk& last_chunk = *arch.chunks[last_chunk_index];
+        ArchetypeChunk& chunk = *arch.chunks[loc.chunk];
+        const int last_row = last_chunk.count - 1;
+        if (loc.chunk != last_chunk_index || loc.row != last_row) {
+            for (int t = 0; t < NUM_ARCHETYPE_TYPES; t++)
+                if (arch.has(t))
+                    componentTypeInfo(t).relocate(arch.at(chunk, t, loc.row), arch.at(last_chunk, t, last_row));
+            int moved_id = arch.entityColumn(last_chunk)[last_row];
+            arch.entityColumn(chunk)[loc.row] = moved_id;
+            locations[moved_id] = loc;
+        }
+        last_chunk.count--;
+        if (last_chunk.count == 0)
+            arch.chunks.pop_back();
+    }
+
+    //moves components of entity to archetype of new mask, constructing or
+    //destroying those which are added or removed
+    void moveEntity_(int id, ComponentMask new_mask) {
+        Location old_loc = locations[id];
+        if (archetypes[old_loc.archetype]->mask == new_mask) return;
+        Location new_loc = allocateRow_(findOrCreateArchetype_(new_mask), id);
+        Archetype& src = *archetypes[old_loc.archetype];
+        Archetype& dst = *archetypes[new_loc.archetype];
+        ArchetypeChunk& src_chunk = *src.chunks[old_loc.chunk];
+        ArchetypeChunk& dst_chunk = *dst.chunks[new_loc.chunk];
+        for (int t = 0; t < NUM_ARCHETYPE_TYPES; t++) {
+            const ComponentTypeInfo& info = componentTypeInfo(t);
+            if (src.has(t) && dst.has(t))
+                info.relocate(dst.at(dst_chunk, t, new_loc.row), src.at(src_chunk, t, old_loc.row));
+            else if (src.has(t))
+                info.destroy(src.at(src_chunk, t, old_loc.row));
+            else if (dst.has(t))
+                info.construct(dst.at(dst_chunk, t, new_loc.row));
+        }
+        locations[id] = new_loc;
+        removeRow_(old_loc);
+    }
+};
@@ -0,0 +1,347 @@
+#include "Benchmarks.h"
+#include "EntityComponentStore.h"
+#include "ArchetypeStorage.h"
+#include "JobSystem.h"
+#include "EcsSnapshot.h"
+#include "Frustum.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+
+//runs func 'repeats' times and returns average time in microseconds
+template<typename F>
+static double timeAverage(int repeats, F func) {
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int i = 0; i < repeats; i++)
+        func();
+    auto end = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration<double, std::micro>(end - start).count() / repeats;
+}
+
+static std::string formatResult(const char* name, double vector_us, double chunk_us) {
+    char buffer[256];
+    snprintf(buffer, sizeof(buffer), "%-22s vectors %9.1f us   chunks %9.1f us   x%.2f",
+             name, vector_us, chunk_us, vector_us / (chunk_us > 0.0 ? chunk_us : 1.0));
+    return std::string(buffer);
+}
+
+void benchmarkECSStorage(int num_entities, std::vector<std::string>& out) {
+    const int repeats = 50;
+    //stops compiler from optimizing loops away
+    volatile float sink = 0.0f;
+
+    //same scene in both storages: every entity has a transform, half of them
+    //a collider, a quarter of them a mesh
+    EntityComponentStore vectors;
+    ArchetypeStorage chunks;
+    for (int i = 0; i < num_entities; i++) {
+        int ent = vectors.createEntity("bench");
+        ComponentMask mask = componentMask<Transform>();
+        if (i % 2 == 0) {
+            vectors.createComponentForEntity<Collider>(ent);
+            mask |= componentMask<Collider>();
+        }
+        if (i % 4 == 0) {
+            vectors.createComponentForEntity<Mesh>(ent);
+            mask |= componentMask<Mesh>();
+        }
+        vectors.getComponentFromEntity<Transform>(ent).translate((float)i, 0.0f, 0.0f);
+        int chunk_ent = chunks.createEntity(mask);
+        chunks.getComponent<Transform>(chunk_ent).translate((float)i, 0.0f, 0.0f);
+    }
+
+    //positions only
+    double vec_pos = timeAverage(repeats, [&]() {
+        float sum = 0.0f;
+        for (auto& t : vectors.getAllComponents<Transform>()) sum += t.translation.x;
+        sink = sink + sum;
+    });
+    double chunk_pos = timeAverage(repeats, [&]() {
+        float sum = 0.0f;
+        chunks.each<Transform>([&](Transform& t) { sum += t.translation.x; });
+        sink = sink + sum;
+    });
+
+    //colliders only
+    double vec_col = timeAverage(repeats, [&]() {
+        float sum = 0.0f;
+        for (auto& c : vectors.getAllComponents<Collider>()) sum += c.local_halfwidth.x;
+        sink = sink + sum;
+    });
+    double chunk_col = timeAverage(repeats, [&]() {
+        float sum = 0.0f;
+        chunks.each<Collider>([&](Collider& c) { sum += c.local_halfwidth.x; });
+        sink = sink + sum;
+    });
+
+    //transform + collider, i.e. what collision system reads
+    double vec_both = timeAverage(repeats, [&]() {
+        float sum = 0.0f;
+        for (auto [c, t] : vectors.view<Collider, Transform>()) sum += c.local_halfwidth.x + t.translation.x;
+        sink = sink + sum;
+    });
+    double chunk_both = timeAverage(repeats, [&]() {
+        float sum = 0.0f;
+        chunks.each<Collider, Transform>([&](Collider& c, Transform& t) { sum += c.local_halfwidth.x + t.translation.x; });
+        sink = sink + sum;
+    });
+
+    out.push_back("ECS storage, " + std::to_string(num_entities) + " entities, average of " + std::to_string(repeats) + " passes");
+    out.push_back(formatResult("transform", vec_pos, chunk_pos));
+    out.push_back(formatResult("collider", vec_col, chunk_col));
+    out.push_back(formatResult("collider+transform", vec_both, chunk_both));
+}
+
+void benchmarkJobs(int num_items, std::vector<std::string>& out) {
+    const int repeats = 20;
+    const int num_empty_jobs = 10000;
+    const int grain = 256;
+    const int max_threads = std::max(1, (int)std::thread::hardware_concurrency());
+
+    //some work per item: a chain of matrix-vector products
+    std::vector<lm::vec4> points(num_items, lm::vec4(1.0f, 2.0f, 3.0f, 1.0f));
+    lm::mat4 matrix;
+    matrix.rotate(0.1f, lm::vec3(0.3f, 0.2f, 1.0f).normalize());
+    matrix.translate(0.01f, 0.0f, 0.0f);
+    auto work = [&](int i) {
+        lm::vec4 p = points[i];
+        for (int k = 0; k < 32; k++) p = matrix * p;
+        points[i] = p;
+    };
+
+    out.push_back("Job system, " + std::to_string(num_items) + " items, grain " + std::to_string(grain) +
+                  ", average of " + std::to_string(repeats) + " passes");
+    double single_us = 0.0;
+    for (int threads = 1; threads <= max_threads; threads++) {
+        JobSystem jobs;
+        jobs.init(threads - 1);
+
+        //queue and wait for empty jobs
+        double empty_us = timeAverage(repeats, [&]() {
+            JobCounter counter;
+            for (int i = 0; i < num_empty_jobs; i++)
+                jobs.run([]() {}, &counter);
+            jobs.wait(counter);
+        });
+
+        double for_us = timeAverage(repeats, [&]() {
+            jobs.parallel_for(0, num_items, grain, work);
+        });
+        if (threads == 1) single_us = for_us;
+
+        char buffer[256];
+        snprintf(buffer, sizeof(buffer), "%2d threads   empty job %7.1f ns   parallel_for %9.1f us   x%.2f",
+                 threads, empty_us * 1000.0 / num_empty_jobs, for_us, single_us / (for_us > 0.0 ? for_us : 1.0));
+        out.push_back(buffer);
+        jobs.shutdown();
+    }
+}
+
+void benchmarkSnapshot(int num_entities, std::vector<std::string>& out) {
+    const int repeats = 10;
+    const std::string filename = "benchmark_snapshot.ecs";
+
+    //every entity has a transform (half of them parented to the previous
+    //one), a collider and a mesh
+    EntityComponentStore ecs;
+    ecs.reserveEntities(num_entities);
+    for (int i = 0; i < num_entities; i++) {
+        int ent = ecs.createEntity("bench" + std::to_string(i));
+        //createEntity adds the transform
+        ecs.getComponentFromEntity<Transform>(ent).translate((float)i, 0.0f, 0.0f);
+        if (i % 2 == 1) ecs.setParent(ent, ecs.getEntityHandle(ent - 1));
+        ecs.createComponentForEntity<Collider>(ent);
+        ecs.createComponentForEntity<Mesh>(ent);
+    }
+
+    bool ok = true;
+    double save_us = timeAverage(repeats, [&]() { ok = EcsSnapshot::save(ecs, filename) && ok; });
+    EntityComponentStore loaded;
+    double load_us = timeAverage(repeats, [&]() { ok = EcsSnapshot::load(loaded, filename) && ok; });
+    std::remove(filename.c_str());
+
+    //same number of each component, and a few entities with the same
+    //position and parent
+    ok = ok && loaded.entities.size() == ecs.entities.size() &&
+         loaded.getAllComponents<Transform>().size() == ecs.getAllComponents<Transform>().size() &&
+         loaded.getAllComponents<Collider>().size() == ecs.getAllComponents<Collider>().size() &&
+         loaded.getAllComponents<Mesh>().size() == ecs.getAllComponents<Mesh>().size();
+    for (int i = 0; ok && i < num_entities; i += std::max(1, num_entities / 8)) {
+        const std::string name = "bench" + std::to_string(i);
+        const int ent = ecs.getEntity(name), loaded_ent = loaded.getEntity(name);
+        if (loaded_ent < 0) { ok = false; break; }
+        const Transform& a = ecs.getComponentFromEntity<Transform>(ent);
+        const Transform& b = loaded.getComponentFromEntity<Transform>(loaded_ent);
+        ok = a.position().x == b.position().x && a.parent.id == b.parent.id;
+    }
+    if (!ok) {
+        out.push_back("ERROR: snapshot round trip failed");
+        return;
+    }
+
+    out.push_back("ECS snapshot, " + std::to_string(num_entities) + " entities, average of " +
+                  std::to_string(repeats) + " runs");
+    char buffer[256];
+    snprintf(buffer, sizeof(buffer), "save %9.2f ms   load %9.2f ms", save_us / 1000.0, load_us / 1000.0);
+    out.push_back(buffer);
+}
+
+void benchmarkMath(int count, std::vector<std::string>& out) {
+    const int repeats = 20;
+    count = std::max(count, 1);
+    //random-ish invertible matrices: rotations, scales and translations
+    std::vector<lm::mat4> a(count), b(count), result(count);
+    std::vector<lm::vec4> points(count);
+    for (int i = 0; i < count; i++) {
+        a[i].makeTransformMatrix(lm::vec3((float)i, 1.0f, -2.0f), lm::quat(0.001f * i, lm::vec3(0.0f, 1.0f, 0.0f)), lm::vec3(1.0f, 2.0f, 0.5f));
+        b[i].makeTransformMatrix(lm::vec3(0.5f, (float)-i, 3.0f), lm::quat(0.002f * i, lm::vec3(1.0f, 0.0f, 0.0f)), lm::vec3(1.5f, 1.0f, 1.0f));
+        points[i] = lm::vec4((float)i, 1.0f, 2.0f, 1.0f);
+    }
+    //stops compiler from optimizing loops away
+    volatile float sink = 0.0f;
+
+    auto line = [&](const char* name, double scalar_us, double simd_us) {
+        char buffer[256];
+        snprintf(buffer, sizeof(buffer), "%-14s scalar %8.1f Mops/s   simd %8.1f Mops/s   x%.2f", name,
+                 count / (scalar_us > 0.0 ? scalar_us : 1.0), count / (simd_us > 0.0 ? simd_us : 1.0),
+                 scalar_us / (simd_us > 0.0 ? simd_us : 1.0));
+        out.push_back(buffer);
+    };
+
+    out.push_back(std::string("mat4 math, ") + std::to_string(count) + " operations, simd level " + lm::simdLevel() +
+                  ", average of " + std::to_string(repeats) + " passes");
+
+    double mul_scalar = timeAverage(repeats, [&]() {
+        for (int i = 0; i < count; i++) result[i] = lm::scalar::multiply(a[i], b[i]);
+    });
+    double mul_simd = timeAverage(repeats, [&]() {
+        for (int i = 0; i < count; i++) result[i] = a[i] * b[i];
+    });
+    line("multiply", mul_scalar, mul_simd);
+
+    double many_simd = timeAverage(repeats, [&]() {
+        lm::transformMany(a.data(), b.data(), result.data(), count);
+    });
+    line("transformMany", mul_scalar, many_simd);
+
+    double vec_scalar = timeAverage(repeats, [&]() {
+        float sum = 0.0f;
+        for (int i = 0; i < count; i++) sum += lm::scalar::transform(a[i], points[i]).x;
+        sink = sink + sum;
+    });
+    double vec_simd = timeAverage(repeats, [&]() {
+        float sum = 0.0f;
+        for (int i = 0; i < count; i++) sum += (a[i] * points[i]).x;
+        sink = sink + sum;
+    });
+    line("mat4 * vec4", vec_scalar, vec_simd);
+
+    double inv_scalar = timeAverage(repeats, [&]() {
+        for (int i = 0; i < count; i++) { result[i] = a[i]; lm::scalar::inverse(result[i]); }
+    });
+    double inv_simd = timeAverage(repeats, [&]() {
+        for (int i = 0; i < count; i++) { result[i] = a[i]; result[i].inverse(); }
+    });
+    line("inverse", inv_scalar, inv_simd);
+
+    //fast path for affine matrices (all of a[] are), vs general inverse
+    double inv_affine = timeAverage(repeats, [&]() {
+        for (int i = 0; i < count; i++) { result[i] = a[i]; result[i].inverseAffine(); }
+    });
+    char buffer[256];
+    snprintf(buffer, sizeof(buffer), "%-14s general %7.1f Mops/s   affine %7.1f Mops/s   x%.2f", "inverseAffine",
+             count / (inv_simd > 0.0 ? inv_simd : 1.0), count / (inv_affine > 0.0 ? inv_affine : 1.0),
+             inv_simd / (inv_affine > 0.0 ? inv_affine : 1.0));
+    out.push_back(buffer);
+    sink = sink + result[count / 2].m[0];
+}
+
+//previous culling test, for comparison: transforms the 8 corners of box to
+//clip space and rejects it if all are outside one of the planes
+static bool boxInClipSpace(const lm::vec3& c, const lm::vec3& e, const lm::mat4& view_projection) {
+    lm::vec4 clip[8];
+    for (int i = 0; i < 8; i++) {
+        lm::vec4 corner(c.x + (i & 4 ? e.x : -e.x), c.y + (i & 2 ? e.y : -e.y), c.z + (i & 1 ? e.z : -e.z), 1.0f);
+        clip[i] = view_projection * corner;
+    }
+    for (int axis = 0; axis < 3; axis++) {
+        int in_min = 0, in_max = 0;
+        for (int i = 0; i < 8; i++) {
+            const float v = clip[i].value_[axis];
+            if (-clip[i].w < v) in_min++;
+            if (v < clip[i].w) in_max++;
+        }
+        if (!in_min || !in_max) return false;
+    }
+    return true;
+}
+
+void benchmarkCulling(int count, std::vector<std::string>& out) {
+    const int repeats = 10;
+    count = std::max(count, 1);
+
+    //camera at origin looking down -z, boxes scattered around it
+    lm::mat4 view, projection;
+    view.lookAt(lm::vec3(0.0f, 0.0f, 0.0f), lm::vec3(0.0f, 0.0f, -1.0f), lm::vec3(0.0f, 1.0f, 0.0f));
+    projection.perspective(1.0f, 16.0f / 9.0f, 0.1f, 500.0f);
+    const lm::mat4 view_projection = projection * view;
+    const Frustum frustum(view_projection);
+
+    out.push_back("Frustum culling, average of " + std::to_string(repeats) + " passes");
+    for (int n = count; n <= count * 100; n *= 10) {
+        CullBoxes boxes;
+        boxes.resize(n);
+        srand(1);
+        auto random = [](float range) { return (rand() / (float)RAND_MAX * 2.0f - 1.0f) * range; };
+        for (int i = 0; i < n; i++)
+            boxes.set(i, lm::vec3(random(400.0f), random(400.0f), random(400.0f)),
+                      lm::vec3(1.0f + random(0.5f), 1.0f + random(0.5f), 1.0f + random(0.5f)));
+        std::vector<uint32_t> mask(cullMaskWords(n));
+
+        int visible_corners = 0, visible_planes = 0, visible_batch = 0;
+        double corners_us = timeAverage(repeats, [&]() {
+            visible_corners = 0;
+            for (int i = 0; i < n; i++)
+                visible_corners += boxInClipSpace(lm::vec3(boxes.cx[i], boxes.cy[i], boxes.cz[i]),
+                                                  lm::vec3(boxes.ex[i], boxes.ey[i], boxes.ez[i]), view_projection);
+        });
+        double planes_us = timeAverage(repeats, [&]() {
+            visible_planes = 0;
+            for (int i = 0; i < n; i++)
+                visible_planes += frustum.testBox(lm::vec3(boxes.cx[i], boxes.cy[i], boxes.cz[i]),
+                                                  lm::vec3(boxes.ex[i], boxes.ey[i], boxes.ez[i]));
+        });
+        double batch_us = timeAverage(repeats, [&]() {
+            cullBoxes(frustum, boxes, 0, n, mask.data());
+        });
+        for (int i = 0; i < n; i++) visible_batch += cullMaskTest(mask.data(), i);
+
+        char buffer[256];
+        snprintf(buffer, sizeof(buffer), "%8d boxes   clip corners %8.1f us   planes %8.1f us   batch %8.1f us   x%.1f   visible %d/%d/%d",
+                 n, corners_us, planes_us, batch_us, corners_us / (batch_us > 0.0 ? batch_us : 1.0),
+                 visible_corners, visible_planes, visible_batch);
+        out.push_back(buffer);
+    }
+}
+
+int runBenchmark(const std::string& name, int count) {
+    std::vector<std::string> results;
+    if (name == "ecs")
+        benchmarkECSStorage(count, results);
+    else if (name == "jobs")
+        benchmarkJobs(count, results);
+    else if (name == "snapshot")
+        benchmarkSnapshot(count, results);
+    else if (name == "mat4")
+        benchmarkMath(count, results);
+    else if (name == "culling")
+        benchmarkCulling(count, results);
+    else {
+        std::cerr << "ERROR: unknown benchmark '" << name << "'\n";
+        return 1;
+    }
+    for (auto& line : results)
+        std::cout << line << "\n";
+    return 0;
+}
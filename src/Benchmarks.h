@@ -0,0 +1,31 @@
+#pragma once
+#include <string>
+#include <vector>
+
+//micro-benchmarks, run from the command line instead of the game with
+//    24-Particles benchmark <name> [count]
+//each one appends lines with its results to 'out'
+
+//runs benchmark by name and prints results. Returns exit code for main()
+int runBenchmark(const std::string& name, int count);
+
+//iteration over vector-per-type storage vs archetype chunks (an
+//ArchetypeStorage built for the benchmark)
+void benchmarkECSStorage(int num_entities, std::vector<std::string>& out);
+
+//job system: cost of scheduling an empty job, and speedup of parallel_for
+//over num_items matrix transforms, from 1 thread to one per core
+void benchmarkJobs(int num_items, std::vector<std::string>& out);
+
+//ECS snapshot: save and load time for num_entities entities with a
+//transform, collider and mesh each
+void benchmarkSnapshot(int num_entities, std::vector<std::string>& out);
+
+//mat4 multiply, inverse and mat4 * vec4 throughput for count operations,
+//scalar reference vs SSE/AVX2 versions in linmath, and batched transformMany
+void benchmarkMath(int count, std::vector<std::string>& out);
+
+//frustum culling of count, 10 * count and 100 * count boxes: clip space
+//corners (previous method) vs extracted planes, one box at a time and in
+//SIMD batches
+void benchmarkCulling(int count, std::vector<std::string>& out);
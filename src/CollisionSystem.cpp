@@ -9,9 +9,6 @@ void CollisionSystem::init() {
 }
 
 void CollisionSystem::update(float dt) {
-    //necesary variables
-    lm::vec3 col_point;
-    
     //reset all collisions every frame
     auto& colliders = ECS.getAllComponents<Collider>();
     for (auto& col : colliders){
@@ -20,35 +17,74 @@ void CollisionSystem::update(float dt) {
         col.other = -1;
     }
     
+    //get world matrix of every collider once, rather than once per test,
+    //and only again when the collider (or its position in the array) or its
+    //world matrix changed
+    const int num_colliders = ECS.getNumEnabled<Collider>();
+    collider_globals_.resize(colliders.size());
+    const unsigned int since = collider_version_;
+    if (ECS.changed<Collider>(since) || ECS.changed<Transform>(since)) {
+        JOBS.parallel_for(0, num_colliders, 256, [&](int i) {
+            if (!ECS.hasComponent<Transform>(colliders[i].owner))
+                return;
+            const Transform& transform = ECS.getComponentFromEntity<Transform>(colliders[i].owner);
+            if (ECS.changed(colliders[i], since) || transform.world_version > since)
+                collider_globals_[i] = ECS.getGlobalMatrix(transform);
+        });
+    }
+    collider_version_ = ECS.advanceVersion();
+    
     //test ray-box collision. This works by looping over ray colliders. For each one, we loop over box colliders
     //test collision between ray and box, updating collision distance for each collision found
     //then for future collision tests only look as far as existing stored collision distance
-    for (size_t i = 0; i < colliders.size(); i++) {
+    //only colliders of active entities, which are at front of array
+    //rays are tested in parallel, one job per ray as each tests all boxes;
+    //each ray stores its hits, which are copied to the colliders afterwards
+    //in ray order, as several rays may hit a box
+    ray_colliders_.clear();
+    for (int i = 0; i < num_colliders; i++)
+        if (colliders[i].collider_type == ColliderTypeRay)
+            ray_colliders_.push_back(i);
+    ray_hits_.resize(ray_colliders_.size());
+    JOBS.parallel_for(0, (int)ray_colliders_.size(), 1, [&](int r) {
+        const int i = ray_colliders_[r];
+        ray_hits_[r].clear();
         
-        //if collider is ray
-        if (colliders[i].collider_type == ColliderTypeRay) {
+        float max_distance = colliders[i].collision_distance;
+        //test all other colliders
+        for (int j = 0; j < num_colliders; j++) {
+            if (j == i) continue; // no self-test
             
-            //test all other colliders
-            for (size_t j = 0; j < colliders.size(); j++) {
-                if (j == i) continue; // no self-test
-                
-                //if box
-                if (colliders[j].collider_type == ColliderTypeBox) {
-                    //test collision
-                    float col_distance = 0; //temp var to store distance
-                    if (intersectSegmentBox(colliders[i], //the ray
-                                            colliders[j], //the box
-                                            col_point, //reference to collision point
-                                            col_distance, //reference to collision distance
-                                            colliders[i].collision_distance)){ //only look as far as current nearest collider
-                        colliders[i].colliding = colliders[j].colliding = true;
-						colliders[i].other = (int)j; colliders[j].other = (int)i;
-                        colliders[i].collision_point = colliders[j].collision_point = col_point;
-                        colliders[i].collision_distance = colliders[j].collision_distance = col_distance;
-                    }
+            //if box
+            if (colliders[j].collider_type == ColliderTypeBox) {
+                //test collision
+                RayHit hit;
+                hit.other = j;
+                if (intersectSegmentBox(colliders[i], //the ray
+                                        collider_globals_[i],
+                                        colliders[j], //the box
+                                        collider_globals_[j],
+                                        hit.point, //reference to collision point
+                                        hit.distance, //reference to collision distance
+                                        max_distance)){ //only look as far as current nearest collider
+                    max_distance = hit.distance;
+                    ray_hits_[r].push_back(hit);
                 }
             }
         }
+    });
+    
+    //store hits in colliders
+    for (size_t r = 0; r < ray_colliders_.size(); r++) {
+        const int i = ray_colliders_[r];
+        for (auto& hit : ray_hits_[r]) {
+            Collider& ray = colliders[i];
+            Collider& box = colliders[hit.other];
+            ray.colliding = box.colliding = true;
+            ray.other = hit.other; box.other = i;
+            ray.collision_point = box.collision_point = hit.point;
+            ray.collision_distance = box.collision_distance = hit.distance;
+        }
     }
 }
 
@@ -60,6 +96,14 @@ void CollisionSystem::update(float dt) {
 // - reference to a float which will be updated with the distance to the nearest collider
 // - optional variable which specifies the maximum distance along ray which to search
 bool CollisionSystem::intersectSegmentBox(Collider& ray, Collider& box, lm::vec3& col_point, float& col_distance, float max_distance) {
+    //get world matrices from scene graph
+    mat4 ray_global = ECS.getGlobalMatrix(ECS.getComponentFromEntity<Transform>(ray.owner));
+    mat4 box_global = ECS.getGlobalMatrix(ECS.getComponentFromEntity<Transform>(box.owner));
+    return intersectSegmentBox(ray, ray_global, box, box_global, col_point, col_distance, max_distance);
+}
+
+// Same as above, with world matrices of ray and box already calculated
+bool CollisionSystem::intersectSegmentBox(Collider& ray, const lm::mat4& ray_global_matrix, Collider& box, const lm::mat4& box_global, lm::vec3& col_point, float& col_distance, float max_distance) {
     //the general approach of this function is as follows
     // - transform ray and box into world space and apply any offsets
     // - create six planes of box
@@ -68,16 +112,7 @@ bool CollisionSystem::intersectSegmentBox(Collider& ray, Collider& box, lm::vec3
     // function already discards cases where ray points in same direction as quad
     // normal, so in fact we only test collisions for maximum 3 faces
     
-    //get model matrices
-    Transform& ray_model = ECS.getComponentFromEntity<Transform>(ray.owner);
-    Transform& box_model = ECS.getComponentFromEntity<Transform>(box.owner);
-    //get reference to all transforms in ECS, for world pos calculations
-    std::vector<Transform>& all_transforms = ECS.getAllComponents<Transform>();
-    
     //*** TRANSFORM BOX TO WORLD ***//
-    //get world matrices from scene graph
-    mat4 box_global = box_model.getGlobalMatrix(all_transforms);
-    
     //get each corner of box in local space
     float x = box.local_halfwidth.x;
     float y = box.local_halfwidth.y;
@@ -102,20 +137,16 @@ bool CollisionSystem::intersectSegmentBox(Collider& ray, Collider& box, lm::vec3
     
     
     //*** TRANSFORM RAY TO WORLD ***//
-    mat4 ray_global = ray_model.getGlobalMatrix(all_transforms);
+    mat4 ray_global = ray_global_matrix;
     
     //translate the center of ray locally before applying global positionthen get position
     ray_global.translateLocal(ray.local_center.x, ray.local_center.y, ray.local_center.z);
     vec3 p = ray_global.position();
     
     //direction is more complex as we must rotate the it without translation or scale
-    //To do this we muts multiply the direction by the InverseTranspose of the global model
-    //setting translation component to zero first. This is similar to the normal matrix in a shader
-    mat4 inv = ray_global;
-    inv.m[12] = 0.0; inv.m[13] = 0.0; inv.m[14] = 0.0;
-    inv.inverse();
-    mat4 inv_trans = inv.transpose();
-    vec3 q = inv_trans * ray.direction.normalize(); //normalize direction as there's no guarantee it's length = 1!
+    //To do this we muts multiply the direction by the InverseTranspose of the 3x3 part of
+    //the global model, i.e. the normal matrix in a shader
+    vec3 q = ray_global.normalMatrix() * ray.direction.normalize(); //normalize direction as there's no guarantee it's length = 1!
     
     //now scale q by max distance to get segment size - safe to do this as direction was normalized
     float test_distance = (ray.max_distance < max_distance ? ray.max_distance : max_distance);
@@ -7,11 +7,25 @@ public:
     void init();
     void update(float dt);
     bool intersectSegmentBox(Collider& ray, Collider& box, lm::vec3& col_point, float& col_distance, float max_distance = 100000.0f);
+    bool intersectSegmentBox(Collider& ray, const lm::mat4& ray_global, Collider& box, const lm::mat4& box_global, lm::vec3& col_point, float& col_distance, float max_distance = 100000.0f);
     
     bool intersectSegmentTriangle(lm::vec3 p, lm::vec3 q, lm::vec3 a, lm::vec3 b, lm::vec3 c);
     bool intersectSegmentQuad(lm::vec3 p, lm::vec3 q, lm::vec3 a, lm::vec3 b, lm::vec3 c, lm::vec3 d, lm::vec3& r);
     
     //LINE not segment
     bool intersectLineQuad(lm::vec3 p, lm::vec3 q, lm::vec3 a, lm::vec3 b, lm::vec3 c, lm::vec3 d, lm::vec3& r);
+private:
+    //world matrix of each collider (by index in array), updated for those
+    //whose collider or world matrix changed since collider_version_
+    std::vector<lm::mat4> collider_globals_;
+    unsigned int collider_version_ = 0;
+    //collisions found by each ray collider this frame
+    struct RayHit {
+        int other;
+        lm::vec3 point;
+        float distance = 0;
+    };
+    std::vector<std::vector<RayHit>> ray_hits_; //same order as ray_colliders_
+    std::vector<int> ray_colliders_; //indices of ray colliders
 };
 
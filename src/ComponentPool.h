@@ -0,0 +1,201 @@
+#pragma once
+#include <vector>
+#include <new>
+#include <utility>
+#include <iterator>
+#include <cstddef>
+#include <cstring>
+#include <type_traits>
+
+/**** COMPONENT POOL ****/
+
+//storage of one component type: a vector-like array split in fixed size pages
+//(COMPONENT_POOL_PAGE_SIZE bytes each) which are allocated once and never
+//moved. Growing the pool only adds pages, so unlike std::vector it never
+//copies existing components. Pages left empty when the pool shrinks are
+//kept in a free list and reused before allocating new ones
+//
+//NOTE: this does NOT make references to components stable. The ECS moves
+//components between indices of the pool on most structural changes (see
+//EntityComponentStore.h), so a T& or T* into a pool must not be kept across
+//them: keep a ComponentHandle or the owner entity id instead
+
+//size in bytes of a page
+const size_t COMPONENT_POOL_PAGE_SIZE = 16 * 1024;
+
+//largest power of two elements of size 'size' which fit in a page (at least 1)
+constexpr size_t componentPoolPageShift(size_t size, size_t shift = 0) {
+    return (size << (shift + 1)) > COMPONENT_POOL_PAGE_SIZE ? shift : componentPoolPageShift(size, shift + 1);
+}
+
+template<typename T>
+class ComponentPool {
+public:
+    typedef T value_type;
+    static const size_t PAGE_SHIFT = componentPoolPageShift(sizeof(T));
+    static const size_t PAGE_COUNT = size_t(1) << PAGE_SHIFT; //elements per page
+    static const size_t PAGE_MASK = PAGE_COUNT - 1;
+
+    //random access iterator, so that <algorithm> works on pools. Keeps a
+    //pointer to current element, so that ++ only looks up the page table
+    //when crossing into the next page
+    template<typename V>
+    struct Iterator {
+        typedef std::random_access_iterator_tag iterator_category;
+        typedef V value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef V* pointer;
+        typedef V& reference;
+
+        T* const* pages = nullptr;
+        size_t num_pages = 0;
+        std::ptrdiff_t i = 0;
+        V* ptr = nullptr;
+
+        Iterator() {}
+        Iterator(T* const* a_pages, size_t a_num_pages, std::ptrdiff_t a_i) :
+            pages(a_pages), num_pages(a_num_pages), i(a_i) { seek_(); }
+
+        V& operator*() const { return *ptr; }
+        V* operator->() const { return ptr; }
+        V& operator[](std::ptrdiff_t n) const { return *(*this + n); }
+        Iterator& operator++() {
+            i++;
+            if ((i & PAGE_MASK) == 0) seek_();
+            else ptr++;
+            return *this;
+        }
+        Iterator operator++(int) { Iterator it = *this; ++*this; return it; }
+        Iterator& operator--() { i--; seek_(); return *this; }
+        Iterator operator--(int) { Iterator it = *this; --*this; return it; }
+        Iterator& operator+=(std::ptrdiff_t n) { i += n; seek_(); return *this; }
+        Iterator& operator-=(std::ptrdiff_t n) { i -= n; seek_(); return *this; }
+        Iterator operator+(std::ptrdiff_t n) const { Iterator it = *this; it += n; return it; }
+        Iterator operator-(std::ptrdiff_t n) const { Iterator it = *this; it -= n; return it; }
+        friend Iterator operator+(std::ptrdiff_t n, const Iterator& it) { return it + n; }
+        std::ptrdiff_t operator-(const Iterator& other) const { return i - other.i; }
+        bool operator==(const Iterator& other) const { return i == other.i; }
+        bool operator!=(const Iterator& other) const { return i != other.i; }
+        bool operator<(const Iterator& other) const { return i < other.i; }
+        bool operator>(const Iterator& other) const { return i > other.i; }
+        bool operator<=(const Iterator& other) const { return i <= other.i; }
+        bool operator>=(const Iterator& other) const { return i >= other.i; }
+
+    private:
+        void seek_() {
+            const size_t page = (size_t)i >> PAGE_SHIFT;
+            ptr = (i >= 0 && page < num_pages) ? pages[page] + (i & PAGE_MASK) : nullptr;
+        }
+    };
+    typedef Iterator<T> iterator;
+    typedef Iterator<const T> const_iterator;
+
+    ComponentPool() {}
+    ComponentPool(const ComponentPool& other) { *this = other; }
+    ComponentPool& operator=(const ComponentPool& other) {
+        if (this == &other) return *this;
+        clear();
+        reserve(other.size_);
+        for (size_t i = 0; i < other.size_; i++)
+            push_back(other[i]);
+        return *this;
+    }
+    ~ComponentPool() {
+        clear();
+        for (T* page : pages_) freePage_(page);
+        for (T* page : free_pages_) freePage_(page);
+    }
+
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    //number of elements which fit in allocated pages
+    size_t capacity() const { return pages_.size() * PAGE_COUNT; }
+
+    T& operator[](size_t i) { return pages_[i >> PAGE_SHIFT][i & PAGE_MASK]; }
+    const T& operator[](size_t i) const { return pages_[i >> PAGE_SHIFT][i & PAGE_MASK]; }
+    T& back() { return (*this)[size_ - 1]; }
+
+    iterator begin() { return iterator(pages_.data(), pages_.size(), 0); }
+    iterator end() { return iterator(pages_.data(), pages_.size(), (std::ptrdiff_t)size_); }
+    const_iterator begin() const { return const_iterator(pages_.data(), pages_.size(), 0); }
+    const_iterator end() const { return const_iterator(pages_.data(), pages_.size(), (std::ptrdiff_t)size_); }
+
+    //allocates pages for at least 'count' elements, so that adding up to
+    //that many does not allocate
+    void reserve(size_t count) {
+        while (capacity() < count) {
+            if (free_pages_.size() > 0) {
+                pages_.push_back(free_pages_.back());
+                free_pages_.pop_back();
+            }
+            else
+                pages_.push_back(allocatePage_());
+        }
+    }
+
+    template<typename... Args>
+    T& emplace_back(Args&&... args) {
+        reserve(size_ + 1);
+        T* ptr = &(*this)[size_];
+        new (ptr) T(std::forward<Args>(args)...);
+        size_++;
+        return *ptr;
+    }
+    void push_back(const T& value) { emplace_back(value); }
+    void push_back(T&& value) { emplace_back(std::move(value)); }
+
+    void pop_back() {
+        size_--;
+        (*this)[size_].~T();
+        //keep one spare page, release the rest to the free list
+        if (pages_.size() > 1 && size_ + 2 * PAGE_COUNT <= capacity()) {
+            free_pages_.push_back(pages_.back());
+            pages_.pop_back();
+        }
+    }
+
+    //calls func(first, count) for each page in use, in order, e.g. to write
+    //the pool to a file
+    template<typename F>
+    void forEachPage(F func) const {
+        for (size_t first = 0; first < size_; first += PAGE_COUNT) {
+            const size_t count = size_ - first < PAGE_COUNT ? size_ - first : PAGE_COUNT;
+            func(pages_[first >> PAGE_SHIFT], count);
+        }
+    }
+
+    //replaces contents with a copy of count elements at data, page by page
+    //(only for types which can be copied as bytes)
+    void assignBytes(const void* data, size_t count) {
+        static_assert(std::is_trivially_copyable<T>::value, "assignBytes needs a trivially copyable type");
+        clear();
+        reserve(count);
+        const char* src = static_cast<const char*>(data);
+        for (size_t first = 0; first < count; first += PAGE_COUNT) {
+            const size_t n = count - first < PAGE_COUNT ? count - first : PAGE_COUNT;
+            std::memcpy((void*)pages_[first >> PAGE_SHIFT], src + first * sizeof(T), n * sizeof(T));
+        }
+        size_ = count;
+    }
+
+    //destroys all elements, keeping pages in the free list
+    void clear() {
+        for (size_t i = 0; i < size_; i++)
+            (*this)[i].~T();
+        size_ = 0;
+        free_pages_.insert(free_pages_.end(), pages_.begin(), pages_.end());
+        pages_.clear();
+    }
+
+private:
+    std::vector<T*> pages_;
+    std::vector<T*> free_pages_;
+    size_t size_ = 0;
+
+    static T* allocatePage_() {
+        return static_cast<T*>(::operator new(sizeof(T) * PAGE_COUNT, std::align_val_t(alignof(T))));
+    }
+    static void freePage_(T* page) {
+        ::operator delete(page, std::align_val_t(alignof(T)));
+    }
+};
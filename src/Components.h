@@ -2,7 +2,7 @@
 //  Copyright � 2018 Alun Evans. All rights reserved.
 //
 //  This file contains the definitions of an entity, and all the different types of component
-//  At the end is a struct called the EntityComponentManager (ECM) which contains an std::vector for
+//  At the end is a struct called the EntityComponentManager (ECM) which contains a ComponentPool for
 //  each of the different component types, stored in an std::tuple. The advantage of this system is that
 //  if a system wishes to interact/use/update all components of a certain type (e.g. draw all meshes),
 //  then these components are stored in contiguous memory, which the various levels of caching can use
@@ -13,32 +13,114 @@
 //    - add it to the ComponentArrays tuple
 //    - add it as a subtemplate of typetoint() and increment 'result' variable
 //    - increment NUM_TYPE_COMPONENTS
+//    - add it to EntityComponentStore::deleteEntity and setEntityActive
 //
 #pragma once
 #include "includes.h"
+#include "ComponentPool.h"
 #include <vector>
 #include <functional>
 #include "Shader.h"
 
 /**** COMPONENTS ****/
 
+//Handles
+// - id: stable slot of an entity (its index in ECS.entities) or of a component
+//   (its slot in the sparse table of its type, see ComponentSlots in ECS)
+// - generation: must match the generation of the slot, otherwise the entity or
+//   component has been deleted (and maybe the slot reused) so handle is stale
+struct EntityHandle {
+    int id = -1;
+    int generation = -1;
+};
+
+struct ComponentHandle {
+    int id = -1;
+    int generation = -1;
+};
+
 //Component (base class)
 // - owner: id of Entity which owns the instance of the component
+// - index: current position of component in its array (changes on delete!)
+// - version: ECS version when component was created or last marked dirty,
+//   see EntityComponentStore::markDirty
 struct Component {
     int owner;
     int index = -1;
+    unsigned int version = 0;
 };
 
 // Transform Component
-// - inherits a mat4 which represents a model matrix
-// - all_transform - reference to vector of all transforms
-struct Transform : public Component, public lm::mat4 {
-    int parent = -1;
-    lm::mat4 getGlobalMatrix(std::vector<Transform>& transforms) {
-        if (parent != - 1){
-            return transforms.at(parent).getGlobalMatrix(transforms) * *this;
-        }
-        else return *this;
+// - translation, rotation, scaling: the local transform, applied as scale,
+//   then rotation, then translation. Change them with the functions below,
+//   which have the same effect as the lm::mat4 functions of the same name.
+//   The local matrix is not stored: getLocalMatrix() builds it, and use set()
+//   to assign a matrix
+// - parent: handle of parent entity, set it with ECS.setParent(). Use
+//   ECS.getGlobalMatrix() for world matrix
+// - parent_index, num_descendants: position of parent in Transform array (-1
+//   if root) and size of subtree below this one, which follows it in the
+//   array. Kept by the ECS, see ECS.sortTransformHierarchy
+// - world_version: ECS version when world was last computed
+// - normal_matrix: inverse transpose of 3x3 part of world, to transform
+//   normals, recomputed along with world
+// - world: cached world matrix, updated once per frame by TransformSystem
+//   (last, as mat4 is 16 byte aligned)
+struct Transform : public Component {
+    lm::vec3 translation;
+    lm::quat rotation;
+    lm::vec3 scaling = lm::vec3(1.0f, 1.0f, 1.0f);
+    EntityHandle parent;
+    int parent_index = -1;
+    int num_descendants = 0;
+    unsigned int world_version = 0;
+    lm::mat3 normal_matrix;
+    lm::mat4 world;
+
+    //local matrix from translation, rotation and scale
+    lm::mat4 getLocalMatrix() const {
+        lm::mat4 local;
+        local.makeTransformMatrix(translation, rotation, scaling);
+        return local;
+    }
+
+    //replaces transform with matrix m (which must not have shear)
+    void set(const lm::mat4& m) { m.decompose(translation, rotation, scaling); }
+
+    lm::vec3 position() const { return translation; }
+    void position(float x, float y, float z) { translation = lm::vec3(x, y, z); }
+    void position(const lm::vec3& p) { translation = p; }
+    lm::vec3 right() const { return rotation * lm::vec3(scaling.x, 0, 0); }
+    lm::vec3 top() const { return rotation * lm::vec3(0, scaling.y, 0); }
+    lm::vec3 front() const { return rotation * lm::vec3(0, 0, scaling.z); }
+
+    //in parent space
+    void translate(float x, float y, float z) { translation = translation + lm::vec3(x, y, z); }
+    void translate(const lm::vec3& t) { translation = translation + t; }
+    void rotate(float angle_in_rad, const lm::vec3& axis) {
+        //mat4::makeRotationMatrix(angle, axis) turns the other way to quat
+        lm::quat q(-angle_in_rad, lm::vec3(axis).normalize());
+        translation = q * translation;
+        rotation = (q * rotation).normalize();
+    }
+    //exact only if rotation is a multiple of 90 degrees (a scaled rotation
+    //is not a rotation and scale any more)
+    void scale(float x, float y, float z) {
+        translation = lm::vec3(translation.x * x, translation.y * y, translation.z * z);
+        scaling = lm::vec3(scaling.x * x, scaling.y * y, scaling.z * z);
+    }
+    void scale(const lm::vec3& s) { scale(s.x, s.y, s.z); }
+
+    //in local space
+    void translateLocal(float x, float y, float z) {
+        translation = translation + rotation * lm::vec3(x * scaling.x, y * scaling.y, z * scaling.z);
+    }
+    //exact only for uniform scale
+    void rotateLocal(float angle_in_rad, const lm::vec3& axis) {
+        rotation = (rotation * lm::quat(-angle_in_rad, lm::vec3(axis).normalize())).normalize();
+    }
+    void scaleLocal(float x, float y, float z) {
+        scaling = lm::vec3(scaling.x * x, scaling.y * y, scaling.z * z);
     }
 };
 
@@ -67,6 +149,8 @@ struct Camera : public Component {
 	lm::mat4 view_matrix;
 	lm::mat4 projection_matrix;
 	lm::mat4 view_projection;
+	float near_plane = 0.01f;
+	float far_plane = 100.0f;
 
 	//constructor that sets placeholder matrices
 	Camera() {
@@ -85,6 +169,8 @@ struct Camera : public Component {
 
 	//wraps orthographic projection matrix
 	void setOrthographic(float left, float right, float bottom, float top, float near, float far) {
+		near_plane = near;
+		far_plane = far;
 		projection_matrix.orthographic(left, right, bottom, top, near, far);
 	}
 
@@ -92,6 +178,8 @@ struct Camera : public Component {
 	void setPerspective(float fov_rad, float the_aspect, float near, float far) {
         fov = fov_rad;
         aspect = the_aspect;
+		near_plane = near;
+		far_plane = far;
 		projection_matrix.perspective(fov_rad, the_aspect, near, far);
 	}
 
@@ -122,6 +210,13 @@ struct Light : public Camera {
 	int resolution;
     int cast_shadow;
 	float radius = 0;
+	//directional only: shadow map is split into cascades, slices of main
+	//camera view up to shadow_distance. cascade_split blends slice ends
+	//between even (0) and logarithmic (1) spacing. 0 cascades uses
+	//view_projection like other lights
+	int num_cascades = 4;
+	float cascade_split = 0.75f;
+	float shadow_distance = 100.0f;
     
     Light() {
         type = LightTypeDirectional;
@@ -259,7 +354,7 @@ struct Joint {
 
 struct SkinnedMesh : public Mesh {
     lm::mat4 skin_bind_matrix;
-    Joint* root;
+    Joint* root = nullptr;
     int num_joints = -1;
     void getAllJoints(Joint* current, std::vector<Joint*>& all_joints) {
         all_joints.push_back(current);
@@ -292,19 +387,20 @@ struct BlendShapes : public Component {
 
 /**** COMPONENT STORAGE ****/
 
-//add new component type vectors here to store them in *ECS*
+//add new component type pools here to store them in *ECS*
+//(ComponentPool is a paged array, see ComponentPool.h)
 typedef std::tuple<
-std::vector<Transform>,
-std::vector<Mesh>,
-std::vector<Camera>,
-std::vector<Light>,
-std::vector<Collider>,
-std::vector<GUIElement>,
-std::vector<GUIText>,
-std::vector<Animation>,
-std::vector<SkinnedMesh>,
-std::vector<BlendShapes>
-//std::vector<ParticleEmitter>
+ComponentPool<Transform>,
+ComponentPool<Mesh>,
+ComponentPool<Camera>,
+ComponentPool<Light>,
+ComponentPool<Collider>,
+ComponentPool<GUIElement>,
+ComponentPool<GUIText>,
+ComponentPool<Animation>,
+ComponentPool<SkinnedMesh>,
+ComponentPool<BlendShapes>
+//ComponentPool<ParticleEmitter>
 > ComponentArrays;
 
 //way of mapping different types to an integer value i.e.
@@ -325,6 +421,15 @@ template<> struct type2int<BlendShapes> { enum { result = 9 }; };
 //UPDATE THIS!
 const int NUM_TYPE_COMPONENTS = 11;
 
+//set of component types, one bit per type2int
+typedef unsigned int ComponentMask;
+const ComponentMask ALL_COMPONENTS = ~0u;
+
+template<typename... Ts>
+ComponentMask componentMask() {
+    return (0u | ... | (1u << type2int<Ts>::result));
+}
+
 /**** ENTITY ****/
 
 struct Entity {
@@ -332,8 +437,12 @@ struct Entity {
     std::string name;
     //array of handles into ECM component arrays
     int components[NUM_TYPE_COMPONENTS];
-    //sets active or not
+    //sets active or not - use ECS.setEntityActive() to change it!
     bool active = true;
+    //false once deleted, the slot is then waiting to be reused
+    bool alive = true;
+    //incremented every time entity slot is deleted, see EntityHandle
+    int generation = 0;
     
     Entity() {
         for (int i = 0; i < NUM_TYPE_COMPONENTS; i++) { components[i] = -1;}
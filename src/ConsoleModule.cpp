@@ -263,21 +263,27 @@ void ConsoleModule::BuildCommand(const char* cmd)
         float posy = atof(v[2].c_str());
         float posz = atof(v[3].c_str());
         int ent_id = ECS.getEntity("PlayerFPS");
-        Camera& camera = ECS.getComponentInArray<Camera>(ECS.main_camera);
+        if (ent_id == -1 || !ECS.isValid<Camera>(ECS.main_camera)) {
+            ConsoleWrite(false, "Command error: no player\n");
+            return;
+        }
+        Camera& camera = ECS.getComponent<Camera>(ECS.main_camera);
         Transform& transform = ECS.getComponentFromEntity<Transform>(ent_id);
         transform.translate( lm::vec3(posx, posy, posz));
+        ECS.markDirty(transform);
         camera.position = lm::vec3(posx, posy, posz);
         ConsoleWrite(false, "Executed command: '%s'\n", cmd);
 
 	} else if (input.find("moveobject") != std::string::npos) {
 
 		if (v.size() == 5) {
-			int entity_id = ECS.getEntity(v[1].c_str());
+			int entity_id = ECS.getEntity(v[1]);
 			float posx = atof(v[2].c_str());
 			float posy = atof(v[3].c_str());
 			float posz = atof(v[4].c_str());
 			Transform& transform = ECS.getComponentFromEntity<Transform>(entity_id);
 			transform.translate(lm::vec3(posx, posy, posz));
+			ECS.markDirty(transform);
 			ConsoleWrite(false, "Executed command: '%s'\n", cmd);
 		} else {
 			ConsoleWrite(false, "Command error\n", cmd);
@@ -285,7 +291,7 @@ void ConsoleModule::BuildCommand(const char* cmd)
 	} else if (input.find("rotateObject") != std::string::npos) {
 
 			if (v.size() == 4) {
-				int entity_id = ECS.getEntity(v[1].c_str());
+				int entity_id = ECS.getEntity(v[1]);
 				float angle = atof(v[2].c_str());
 				angle = angle * DEG2RAD;
 				Transform& transform = ECS.getComponentFromEntity<Transform>(entity_id);
@@ -306,6 +312,7 @@ void ConsoleModule::BuildCommand(const char* cmd)
 					ConsoleWrite(false, "Command error\n", cmd);
 					break;
 				}
+				ECS.markDirty(transform);
 			} else {
 				ConsoleWrite(false, "Command error\n", cmd);
 			}
@@ -25,6 +25,8 @@ void ControlSystem::updateMousePosition(int new_x, int new_y) {
 
 //called once per frame
 void ControlSystem::update(float dt) {
+	if (!checkMainCamera_()) return;
+
 	if (control_type == ControlTypeFPS) {
 		updateFPS(dt);
 	}
@@ -33,21 +35,40 @@ void ControlSystem::update(float dt) {
 	}
 
 	//check if switch to Debug cam
-	if (input[GLFW_KEY_O] == true) {
-		ECS.main_camera = 0; //debug cam is 0
+	if (input[GLFW_KEY_O] == true && ECS.isValid<Camera>(debug_camera)) {
+		ECS.main_camera = debug_camera;
 		control_type = ControlTypeFree;
 	}
-	if (input[GLFW_KEY_P] == true) {
-		ECS.main_camera = 1;
+	if (input[GLFW_KEY_P] == true && ECS.isValid<Camera>(FPS_camera)) {
+		ECS.main_camera = FPS_camera;
 		control_type = ControlTypeFPS;
 	}
 }
 
+//the main camera can be deleted (e.g. from the debug GUI): fall back to the
+//debug camera, the FPS camera or else any camera
+bool ControlSystem::checkMainCamera_() {
+	if (ECS.isValid<Camera>(ECS.main_camera)) return true;
+	if (ECS.isValid<Camera>(debug_camera)) {
+		ECS.main_camera = debug_camera;
+		control_type = ControlTypeFree;
+	}
+	else if (ECS.isValid<Camera>(FPS_camera)) {
+		ECS.main_camera = FPS_camera;
+		control_type = ControlTypeFPS;
+	}
+	else {
+		ECS.main_camera = ECS.getComponentHandleInArray<Camera>(0);
+		control_type = ControlTypeFree;
+	}
+	return ECS.isValid<Camera>(ECS.main_camera);
+}
+
 //update an entity with a free movement control component 
 void ControlSystem::updateFree(float dt) {
 
-	Camera& camera = ECS.getComponentInArray<Camera>(ECS.main_camera);
-	Transform& transform = ECS.getComponentFromEntity<Transform>(camera.owner);
+	Camera& camera = ECS.getComponent<Camera>(ECS.main_camera);
+	Transform& transform = ECS.getComponentForWrite<Transform>(camera.owner);
 
 	//multiply speeds by delta time 
 	float move_speed_dt = move_speed_ * dt;
@@ -81,8 +102,16 @@ void ControlSystem::updateFree(float dt) {
 }
 
 void ControlSystem::updateFPS(float dt) {
-	Camera& camera = ECS.getComponentInArray<Camera>(ECS.main_camera);
-	Transform& transform = ECS.getComponentFromEntity<Transform>(camera.owner);
+	//fps control needs its five ray colliders, move freely if one is gone
+	if (!ECS.isValid<Collider>(FPS_collider_down) || !ECS.isValid<Collider>(FPS_collider_forward) ||
+		!ECS.isValid<Collider>(FPS_collider_left) || !ECS.isValid<Collider>(FPS_collider_right) ||
+		!ECS.isValid<Collider>(FPS_collider_back)) {
+		updateFree(dt);
+		return;
+	}
+
+	Camera& camera = ECS.getComponent<Camera>(ECS.main_camera);
+	Transform& transform = ECS.getComponentForWrite<Transform>(camera.owner);
 
 	//multiply speeds by delta time 
 	float move_speed_dt = move_speed_ * dt;
@@ -100,13 +129,12 @@ void ControlSystem::updateFPS(float dt) {
 		camera.forward = R_pitch * camera.forward;
 	}
 
-	//fps control should have five ray colliders assigned
-	auto& colliders = ECS.getAllComponents<Collider>();
-	Collider& collider_down = colliders[FPS_collider_down];
-	Collider& collider_forward = colliders[FPS_collider_forward];
-	Collider& collider_left = colliders[FPS_collider_left];
-	Collider& collider_right = colliders[FPS_collider_right];
-	Collider& collider_back = colliders[FPS_collider_back];
+	//the five ray colliders
+	Collider& collider_down = ECS.getComponent<Collider>(FPS_collider_down);
+	Collider& collider_forward = ECS.getComponent<Collider>(FPS_collider_forward);
+	Collider& collider_left = ECS.getComponent<Collider>(FPS_collider_left);
+	Collider& collider_right = ECS.getComponent<Collider>(FPS_collider_right);
+	Collider& collider_back = ECS.getComponent<Collider>(FPS_collider_back);
 
 	//collisions and gravity
 	//player down ray is always colliding, we need to keep player at 'FPS_height' units above nearest collider
@@ -170,8 +198,4 @@ void ControlSystem::updateFPS(float dt) {
 
 	//update camera position
 	camera.position = transform.position();
-
-	//check if switch to Debug cam
-	if (input[GLFW_KEY_O] == true) ECS.main_camera = 0; //debug cam is 0
-	if (input[GLFW_KEY_P] == true) ECS.main_camera = 1;
 }
\ No newline at end of file
@@ -35,12 +35,17 @@ public:
 	//mouse is public, it's just four ints
 	Mouse mouse;
 
+	//cameras switched to with keys O (debug camera, free movement) and P (FPS
+	//camera), set when the cameras are created
+	ComponentHandle debug_camera;
+	ComponentHandle FPS_camera;
+
 	//FPS stuff
-	int FPS_collider_down;
-	int FPS_collider_left;
-	int FPS_collider_right;
-	int FPS_collider_forward;
-	int FPS_collider_back;
+	ComponentHandle FPS_collider_down;
+	ComponentHandle FPS_collider_left;
+	ComponentHandle FPS_collider_right;
+	ComponentHandle FPS_collider_forward;
+	ComponentHandle FPS_collider_back;
 	bool FPS_can_jump = true;
 	float FPS_jump_force = 0.0f;
 	float FPS_jump_initial_force = 12.0f;
@@ -54,6 +59,8 @@ private:
 
 	bool input[GLFW_KEY_LAST];
 
+	//makes ECS.main_camera a live camera, false if there is none
+	bool checkMainCamera_();
 	//function to update entity movement
 	void updateFree(float dt);
 	void updateFPS(float dt);
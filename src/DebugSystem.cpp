@@ -3,6 +3,7 @@
 #include "Parsers.h"
 #include "shaders_default.h"
 #include "Game.h"
+#include "EcsSnapshot.h"
 
 DebugSystem::~DebugSystem() {
 	delete grid_shader_;
@@ -63,13 +64,13 @@ void DebugSystem::setActive(bool a) {
 //called once per frame
 void DebugSystem::update(float dt) {
 
-	if (!active_) return;
+	if (!active_ || !ECS.isValid<Camera>(ECS.main_camera)) return;
 
 	//line drawing first, use same shader
 	if (draw_grid_ || draw_frustra_ || draw_colliders_) {
 
 		//use line shader to draw all lines and boxes
-		glUseProgram(grid_shader_->program);
+		GL_STATE.useProgram(grid_shader_->program);
 
 		if (draw_grid_) {
 			drawGrid_();
@@ -94,7 +95,7 @@ void DebugSystem::update(float dt) {
 	}
 
 
-	glBindVertexArray(0);
+	GL_STATE.bindVertexArray(0);
 	ImGui_ImplOpenGL3_NewFrame();
 	ImGui_ImplGlfw_NewFrame();
 	ImGui::NewFrame();
@@ -164,7 +165,7 @@ void DebugSystem::createJointGeometry_() {
 
 		GLuint new_vao;
 		glGenVertexArrays(1, &new_vao);
-		glBindVertexArray(new_vao);
+		GL_STATE.bindVertexArray(new_vao);
 		//positions
 		GLuint vbo;
 		glGenBuffers(1, &vbo);
@@ -185,7 +186,7 @@ void DebugSystem::createJointGeometry_() {
 
 	//unbind
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
-	glBindVertexArray(0);
+	GL_STATE.bindVertexArray(0);
 
 }
 
@@ -221,9 +222,9 @@ void DebugSystem::getJointWorldMatrices_(Joint* current,
 void DebugSystem::drawJoints_() {
 
 	//joint shader
-	glUseProgram(joint_shader_->program);
+	GL_STATE.useProgram(joint_shader_->program);
 
-	Camera& cam = ECS.getComponentInArray<Camera>(ECS.main_camera);
+	Camera& cam = ECS.getComponent<Camera>(ECS.main_camera);
 	auto& skinnedmeshes = ECS.getAllComponents<SkinnedMesh>();
 
 	//skinned_meshes size must be same as joints_vaos size
@@ -243,17 +244,17 @@ void DebugSystem::drawJoints_() {
 
 		joint_shader_->setUniform(U_VP, cam.view_projection);
 
-		glBindVertexArray(joints_vaos_[i]);
+		GL_STATE.bindVertexArray(joints_vaos_[i]);
 		glDrawElements(GL_LINES, skinnedmeshes[i].num_joints * 2, GL_UNSIGNED_INT, 0);
 	}
 }
 
 void DebugSystem::drawGrid_() {
 	//get the camera view projection matrix
-	lm::mat4 vp = ECS.getComponentInArray<Camera>(ECS.main_camera).view_projection;
+	lm::mat4 vp = ECS.getComponent<Camera>(ECS.main_camera).view_projection;
 
 	//use line shader to draw all lines and boxes
-	glUseProgram(grid_shader_->program);
+	GL_STATE.useProgram(grid_shader_->program);
 	GLint u_mvp = glGetUniformLocation(grid_shader_->program, "u_mvp");
 	GLint u_color = glGetUniformLocation(grid_shader_->program, "u_color");
 	GLint u_color_mod = glGetUniformLocation(grid_shader_->program, "u_color_mod");
@@ -266,13 +267,13 @@ void DebugSystem::drawGrid_() {
 	glUniform3f(u_size_scale, 1.0, 1.0, 1.0);
 	glUniform3f(u_center_mod, 0.0, 0.0, 0.0);
 	glUniform1i(u_color_mod, 0);
-	glBindVertexArray(grid_vao_); //GRID
+	GL_STATE.bindVertexArray(grid_vao_); //GRID
 	glDrawElements(GL_LINES, grid_num_indices, GL_UNSIGNED_INT, 0);
 }
 
 void DebugSystem::drawFrusta_() {
 	//get the camera view projection matrix
-	lm::mat4 vp = ECS.getComponentInArray<Camera>(ECS.main_camera).view_projection;
+	lm::mat4 vp = ECS.getComponent<Camera>(ECS.main_camera).view_projection;
 	GLint u_mvp = glGetUniformLocation(grid_shader_->program, "u_mvp");
 	GLint u_color_mod = glGetUniformLocation(grid_shader_->program, "u_color_mod");
 
@@ -281,28 +282,29 @@ void DebugSystem::drawFrusta_() {
 	int counter = 0;
 	for (auto& cc : cameras) {
 		//don't draw current camera frustum
-		if (counter == ECS.main_camera) continue;
+		if (counter == ECS.getComponentIndex<Camera>(ECS.main_camera)) continue;
 		counter++;
 
+		//inverse of projection * view; the view matrix is rigid, so only the
+		//projection needs a general inverse
 		lm::mat4 cam_iv = cc.view_matrix;
-		cam_iv.inverse();
+		cam_iv.inverseRigid();
 		lm::mat4 cam_ip = cc.projection_matrix;
 		cam_ip.inverse();
-		lm::mat4 cam_ivp = cc.view_projection;
-		cam_ivp.inverse();
+		lm::mat4 cam_ivp = cam_iv * cam_ip;
 		lm::mat4 mvp = vp * cam_ivp;
 
 		//set uniforms and draw cube
 		glUniformMatrix4fv(u_mvp, 1, GL_FALSE, mvp.m);
 		glUniform1i(u_color_mod, 1); //set color to index 1 (red)
-		glBindVertexArray(cube_vao_); //CUBE
+		GL_STATE.bindVertexArray(cube_vao_); //CUBE
 		glDrawElements(GL_LINES, 24, GL_UNSIGNED_INT, 0);
 	}
 }
 
 void DebugSystem::drawColliders_() {
 	//get the camera view projection matrix
-	lm::mat4 vp = ECS.getComponentInArray<Camera>(ECS.main_camera).view_projection;
+	lm::mat4 vp = ECS.getComponent<Camera>(ECS.main_camera).view_projection;
 	GLint u_mvp = glGetUniformLocation(grid_shader_->program, "u_mvp");
 	GLint u_color_mod = glGetUniformLocation(grid_shader_->program, "u_color_mod");
 
@@ -312,7 +314,7 @@ void DebugSystem::drawColliders_() {
 		//get transform for collider
 		Transform& tc = ECS.getComponentFromEntity<Transform>(cc.owner);
 		//get the colliders local model matrix in order to draw correctly
-		lm::mat4 collider_matrix = tc.getGlobalMatrix(ECS.getAllComponents<Transform>());
+		lm::mat4 collider_matrix = ECS.getGlobalMatrix(tc);
 
 		if (cc.collider_type == ColliderTypeBox) {
 
@@ -326,7 +328,7 @@ void DebugSystem::drawColliders_() {
 			//set uniforms and draw
 			glUniformMatrix4fv(u_mvp, 1, GL_FALSE, mvp.m);
 			glUniform1i(u_color_mod, 2); //set color to index 2 (green)
-			glBindVertexArray(cube_vao_); //CUBE
+			GL_STATE.bindVertexArray(cube_vao_); //CUBE
 			glDrawElements(GL_LINES, 24, GL_UNSIGNED_INT, 0);
 		}
 
@@ -362,7 +364,7 @@ void DebugSystem::drawColliders_() {
 			glUniform1i(u_color_mod, 3);
 
 			//bind the cube vao
-			glBindVertexArray(collider_ray_vao_);
+			GL_STATE.bindVertexArray(collider_ray_vao_);
 			glDrawElements(GL_LINES, 2, GL_UNSIGNED_INT, 0);
 		}
 	}
@@ -370,10 +372,10 @@ void DebugSystem::drawColliders_() {
 
 
 void DebugSystem::drawIcons_() {
-	lm::mat4 vp = ECS.getComponentInArray<Camera>(ECS.main_camera).view_projection;
+	lm::mat4 vp = ECS.getComponent<Camera>(ECS.main_camera).view_projection;
 
 	//switch to icon shader
-	glUseProgram(icon_shader_->program);
+	GL_STATE.useProgram(icon_shader_->program);
 
 	//get uniforms
 	GLint u_mvp = glGetUniformLocation(icon_shader_->program, "u_mvp");
@@ -382,14 +384,13 @@ void DebugSystem::drawIcons_() {
 
 
 	//for each light - bind light texture
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, icon_light_texture_);
+	GL_STATE.bindTexture(GL_TEXTURE_2D, icon_light_texture_, 0);
 
 	auto& lights = ECS.getAllComponents<Light>();
 	for (auto& curr_light : lights) {
 		Transform& curr_light_transform = ECS.getComponentFromEntity<Transform>(curr_light.owner);
 
-		lm::mat4 mvp_matrix = vp * curr_light_transform.getGlobalMatrix(ECS.getAllComponents<Transform>());;
+		lm::mat4 mvp_matrix = vp * ECS.getGlobalMatrix(curr_light_transform);;
 		//BILLBOARDS
 		//the mvp for the light contains rotation information. We want it to look at the camera always.
 		//So we zero out first three columns of matrix, which contain the rotation information
@@ -399,25 +400,24 @@ void DebugSystem::drawIcons_() {
 
 		//send this new matrix as the MVP
 		glUniformMatrix4fv(u_mvp, 1, GL_FALSE, bill_matrix.m);
-		glBindVertexArray(icon_vao_);
+		GL_STATE.bindVertexArray(icon_vao_);
 		glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
 	}
 
 	//bind camera texture
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, icon_camera_texture_);
+	GL_STATE.bindTexture(GL_TEXTURE_2D, icon_camera_texture_, 0);
 
 	//for each camera, exactly the same but with camera texture
 	auto& cameras = ECS.getAllComponents<Camera>();
 	for (auto& curr_camera : cameras) {
 		Transform& curr_cam_transform = ECS.getComponentFromEntity<Transform>(curr_camera.owner);
-		lm::mat4 mvp_matrix = vp * curr_cam_transform.getGlobalMatrix(ECS.getAllComponents<Transform>());
+		lm::mat4 mvp_matrix = vp * ECS.getGlobalMatrix(curr_cam_transform);
 
 		// billboard as above
 		lm::mat4 bill_matrix;
 		for (int i = 12; i < 16; i++) bill_matrix.m[i] = mvp_matrix.m[i];
 		glUniformMatrix4fv(u_mvp, 1, GL_FALSE, bill_matrix.m);
-		glBindVertexArray(icon_vao_);
+		GL_STATE.bindVertexArray(icon_vao_);
 		glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
 
 	}
@@ -427,14 +427,13 @@ void DebugSystem::drawIcons_() {
 void DebugSystem::imGuiRenderTransformNode(TransformNode& trans) {
 	auto& ent = ECS.entities[trans.entity_owner];
 	if (ImGui::TreeNode(ent.name.c_str())) {
-		Transform& transform = ECS.getComponentFromEntity<Transform>(ent.name);
-		if (ECS.getComponentID<Light>(trans.entity_owner) != -1) {
-			graphics_system_->needUpdateLights = true;
-		}
+		Transform& transform = ECS.getComponentFromEntity<Transform>(trans.entity_owner);
 		lm::vec3 pos = transform.position();
 		float pos_array[3] = { pos.x, pos.y, pos.z };
-		ImGui::DragFloat3("Position", pos_array);
-		transform.position(pos_array[0], pos_array[1], pos_array[2]);
+		if (ImGui::DragFloat3("Position", pos_array)) {
+			transform.position(pos_array[0], pos_array[1], pos_array[2]);
+			ECS.markDirty(transform);
+		}
 
 		for (auto& child : trans.children) {
 
@@ -468,7 +467,7 @@ void DebugSystem::updateimGUI_(float dt) {
 
 		//Tell imGUI to display variables of the camera
 		//get camera and its transform
-		Camera& cam = ECS.getComponentInArray<Camera>(ECS.main_camera);
+		Camera& cam = ECS.getComponent<Camera>(ECS.main_camera);
 		Transform& cam_transform = ECS.getComponentFromEntity<Transform>(cam.owner);
 
 		//Create an unfoldable tree node called 'Camera'
@@ -488,6 +487,26 @@ void DebugSystem::updateimGUI_(float dt) {
 			ImGui::TreePop();
 		}
 
+		//timings of systems in last frame (thread 0 is main thread)
+		if (scheduler_ && ImGui::TreeNode("Systems")) {
+			ImGui::Text("Frame: %.3f ms, %d threads", scheduler_->getFrameTime(), scheduler_->getNumThreads());
+			for (auto& timing : scheduler_->getTimings())
+				ImGui::Text("%-14s thread %d  start %7.3f ms  took %7.3f ms",
+					timing.name.c_str(), timing.thread, timing.start_ms, timing.duration_ms);
+			ImGui::TreePop();
+		}
+
+		//mesh draws of last frame
+		if (ImGui::TreeNode("Rendering")) {
+			const GraphicsSystem::RenderStats& stats = graphics_system_->render_stats;
+			ImGui::Checkbox("Instancing", &graphics_system_->use_instancing);
+			ImGui::Text("Draw items: %d", stats.draw_items);
+			ImGui::Text("Draw calls: %d (%d instanced, %d instances)", stats.draw_calls, stats.instanced_calls, stats.instances);
+			const GLState::Stats& gl_stats = GL_STATE.frameStats();
+			ImGui::Text("GL state calls: %d (%d elided)", gl_stats.calls, gl_stats.elided);
+			ImGui::TreePop();
+		}
+
 		//create a tree of TransformNodes objects (defined in DebugSystem.h)
 		//which represents the current scene graph
 
@@ -499,15 +518,16 @@ void DebugSystem::updateimGUI_(float dt) {
 			tn.trans_id = (int)i;
 			tn.entity_owner = all_transforms[i].owner;
 			tn.ent_name = ECS.entities[tn.entity_owner].name;
-			if (all_transforms[i].parent == -1)
+			if (!ECS.isValid(all_transforms[i].parent))
 				tn.isTop = true;
 			transform_nodes.push_back(tn);
 		}
 
 		// 2) traverse array to assign children to their parents
 		for (size_t i = 0; i < transform_nodes.size(); i++) {
-			int parent = all_transforms[i].parent;
-			if (parent != -1) {
+			EntityHandle parent_ent = all_transforms[i].parent;
+			if (ECS.isValid(parent_ent)) {
+				int parent = ECS.getComponentID<Transform>(parent_ent.id);
 				transform_nodes[parent].children.push_back(transform_nodes[i]);
 			}
 		}
@@ -578,7 +598,7 @@ void DebugSystem::updateprotoGUI_(float dt) {
 		ImGui::SetNextWindowBgAlpha(1.0);
 		ImGui::Begin("Proto", &show_protoGUI_);
 
-		Camera& cam = ECS.getComponentInArray<Camera>(ECS.main_camera);
+		Camera& cam = ECS.getComponent<Camera>(ECS.main_camera);
 		Transform& cam_transform = ECS.getComponentFromEntity<Transform>(cam.owner);
 
 		//Create an unfoldable tree node called 'Camera'
@@ -622,29 +642,48 @@ void DebugSystem::update_entitiesGUI_(float dt) {
 		if (ImGui::Button("Add new entity")) {
 			show_addEntitiesGUI_ = true;
 		}
+		ImGui::SameLine();
+		if (ImGui::Button("Save snapshot")) {
+			EcsSnapshot::save(ECS, "data/snapshot.ecs");
+		}
+		ImGui::SameLine();
+		if (ImGui::Button("Load snapshot")) {
+			EcsSnapshot::load(ECS, "data/snapshot.ecs");
+		}
 
 		auto& ents = ECS.entities;
-		for (auto& ent : ents) {
-			int entity_id = ECS.getEntity(ent.name.c_str());
+		for (size_t i = 0; i < ents.size(); i++) {
+			//skip deleted entity slots
+			if (!ents[i].alive) continue;
+			int entity_id = (int)i;
+			Entity& ent = ents[i];
 			if (ImGui::TreeNode(ent.name.c_str())) {
 
+				//deletes are deferred, as we are iterating entities
 				if (ImGui::Button("Delete")) {
-					ECS.deleteEntity(entity_id);
+					ECS_COMMANDS.destroyEntity(ECS.getEntityHandle(entity_id));
 				}
 				ImGui::SameLine();
 				if (ImGui::Button("Add Component")) {
 					show_newComponentGUI_ = true;
 					newComponent_entity_id_ = entity_id;
 				}
+				ImGui::SameLine();
+				bool active = ent.active;
+				if (ImGui::Checkbox("Active", &active)) {
+					ECS.setEntityActive(entity_id, active);
+				}
 
 				if (ECS.hasComponent<Transform>(entity_id)) {
-					auto& trans = ECS.getComponentFromEntity<Transform>(ent.name.c_str());
+					auto& trans = ECS.getComponentFromEntity<Transform>(entity_id);
 					if (ImGui::TreeNode("Transform")) {
 
 						lm::vec3 pos = trans.position();
 						float pos_array[3] = { pos.x, pos.y, pos.z };
-						ImGui::DragFloat3("Position", pos_array, 0.05f);
-						trans.position(pos_array[0], pos_array[1], pos_array[2]);
+						if (ImGui::DragFloat3("Position", pos_array, 0.05f)) {
+							trans.position(pos_array[0], pos_array[1], pos_array[2]);
+							ECS.markDirty(trans);
+						}
 
 						ImGui::TreePop();
 					}
@@ -652,10 +691,10 @@ void DebugSystem::update_entitiesGUI_(float dt) {
 
 				if (ECS.hasComponent<Mesh>(entity_id)) {
 					int a = ECS.getComponentID<Mesh>(entity_id);
-					auto& mesh = ECS.getComponentFromEntity<Mesh>(ent.name.c_str());
+					auto& mesh = ECS.getComponentFromEntity<Mesh>(entity_id);
 					if (ImGui::TreeNode("Mesh")) {
 						if (ImGui::Button("Delete Component")) {
-							ECS.deleteComponent<Mesh>(entity_id);
+							ECS_COMMANDS.removeComponent<Mesh>(ECS.getEntityHandle(entity_id));
 						}
 						static const char* current_item = graphics_system_->getMaterial(mesh.material).name.c_str();
 						std::vector<Material>& materials = graphics_system_->getMaterials();
@@ -680,7 +719,7 @@ void DebugSystem::update_entitiesGUI_(float dt) {
 				if (ECS.hasComponent<Light>(entity_id)) {
 					if (ImGui::TreeNode("Light")) {
 						if (ImGui::Button("Delete Component")) {
-							ECS.deleteComponent<Light>(entity_id);
+							ECS_COMMANDS.removeComponent<Light>(ECS.getEntityHandle(entity_id));
 						}
 						Light& light = ECS.getComponentFromEntity<Light>(entity_id);
 
@@ -722,11 +761,16 @@ void DebugSystem::update_entitiesGUI_(float dt) {
 						light.cast_shadow = cast_shadow ? 1 : 0;
 						if (cast_shadow) {
 							ImGui::DragInt("Shadow resolution ", &light.resolution, 1.0f, 8);
+							if (light.type == LightTypeDirectional) {
+								ImGui::SliderInt("Cascades", &light.num_cascades, 0, MAX_CASCADES);
+								ImGui::DragFloat("Cascade split", &light.cascade_split, 0.01f, 0.0f, 1.0f);
+								ImGui::DragFloat("Shadow distance", &light.shadow_distance, 1.0f, 1.0f);
+							}
 						}
 
 						light.calculateRadius();
 						light.update();
-						graphics_system_->needUpdateLights = true;
+						ECS.markDirty(light);
 
 						ImGui::TreePop();
 					}
@@ -735,7 +779,7 @@ void DebugSystem::update_entitiesGUI_(float dt) {
 				if (ECS.hasComponent<Collider>(entity_id)) {
 					if (ImGui::TreeNode("Collider")) {
 						if (ImGui::Button("Delete Component")) {
-							ECS.deleteComponent<Collider>(entity_id);
+							ECS_COMMANDS.removeComponent<Collider>(ECS.getEntityHandle(entity_id));
 						}
 						Collider& collider = ECS.getComponentFromEntity<Collider>(entity_id);
 
@@ -905,19 +949,22 @@ void DebugSystem::update_addEntitiesGUI_(float dt)
 		if (ImGui::Button("Add")) {
 			if (entity_name_.length() > 0) {
 				show_addEntitiesGUI_ = false;
-				int new_entity = ECS.createEntity(entity_name_);
+				//entity is created at end of frame by command buffer
+				EntityHandle new_entity = ECS_COMMANDS.createEntity(entity_name_);
 
-				Transform& st = ECS.getComponentFromEntity<Transform>(new_entity);
+				Transform st;
 				st.translate(position_);
+				ECS_COMMANDS.addComponent<Transform>(new_entity, st);
 				if (addMesh_) {
-					Mesh& new_mesh = ECS.createComponentForEntity<Mesh>(new_entity);
+					Mesh new_mesh;
 					new_mesh.geometry = selected_geo_;
 					new_mesh.material = selected_mat_;
 					new_mesh.render_mode = RenderModeForward;
+					ECS_COMMANDS.addComponent<Mesh>(new_entity, new_mesh);
 				}
 
 				if (addLight_) {
-					Light& new_light_comp = ECS.createComponentForEntity<Light>(new_entity);
+					Light new_light_comp;
 					new_light_comp.color = light_color_;
 					new_light_comp.direction = light_direction_;
 					new_light_comp.type = static_cast<LightType>(light_type_); //change for direction or spot
@@ -934,10 +981,11 @@ void DebugSystem::update_addEntitiesGUI_(float dt)
 					}
 					new_light_comp.update();
 					new_light_comp.cast_shadow = light_cast_shadow_;
+					ECS_COMMANDS.addComponent<Light>(new_entity, new_light_comp);
 				}
 
 				if (addCollider_) {
-					Collider& new_collider = ECS.createComponentForEntity<Collider>(new_entity);
+					Collider new_collider;
 					new_collider.collider_type = static_cast<ColliderType>(collider_type_);
 					new_collider.local_center = collider_local_center_;
 					if (collider_type_ == ColliderTypeBox) {
@@ -946,6 +994,7 @@ void DebugSystem::update_addEntitiesGUI_(float dt)
 					if (collider_type_ == ColliderTypeRay) {
 						new_collider.direction = collider_direction_;
 					}
+					ECS_COMMANDS.addComponent<Collider>(new_entity, new_collider);
 				}
 
 				resetAddEntity();
@@ -1151,7 +1200,7 @@ void DebugSystem::setPickingRay(int mouse_x, int mouse_y, int screen_width, int
 	lm::vec4 mouse_near_plane(ndc_x, ndc_y, -1.0, 1.0);
 
 	//get view projection
-	Camera& cam = ECS.getComponentInArray<Camera>(ECS.main_camera);
+	Camera& cam = ECS.getComponent<Camera>(ECS.main_camera);
 	lm::mat4 inv_vp = cam.view_projection;
 	inv_vp.inverse();
 
@@ -1167,6 +1216,7 @@ void DebugSystem::setPickingRay(int mouse_x, int mouse_y, int screen_width, int
 	Transform& pick_ray_transform = ECS.getComponentFromEntity<Transform>(ent_picking_ray_);
 	Collider& pick_ray_collider = ECS.getComponentFromEntity<Collider>(ent_picking_ray_);
 	pick_ray_transform.position(cam.position);
+	ECS.markDirty(pick_ray_transform);
 	pick_ray_collider.direction = (mouse_world_3 - cam.position).normalize();
 	pick_ray_collider.max_distance = 1000000;
 }
@@ -1182,7 +1232,7 @@ void DebugSystem::createIcon_() {
 	GLfloat icon_uvs[8]{ 0.0f, 0.0f, 1.0f, 0.0f, 1.0f, 1.0f, 0.0f, 1.0f };
 	GLuint icon_indices[6]{ 0, 1, 2, 0, 2, 3 };
 	glGenVertexArrays(1, &icon_vao_);
-	glBindVertexArray(icon_vao_);
+	GL_STATE.bindVertexArray(icon_vao_);
 	GLuint vbo;
 	//positions
 	glGenBuffers(1, &vbo);
@@ -1203,7 +1253,7 @@ void DebugSystem::createIcon_() {
 	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(icon_indices), icon_indices, GL_STATIC_DRAW);
 	//unbind
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
-	glBindVertexArray(0);
+	GL_STATE.bindVertexArray(0);
 }
 
 void DebugSystem::createRay_() {
@@ -1212,7 +1262,7 @@ void DebugSystem::createRay_() {
 		0, 0, 1, 0 };
 	GLuint icon_indices[2]{ 0, 1 };
 	glGenVertexArrays(1, &collider_ray_vao_);
-	glBindVertexArray(collider_ray_vao_);
+	GL_STATE.bindVertexArray(collider_ray_vao_);
 	GLuint vbo;
 	//positions
 	glGenBuffers(1, &vbo);
@@ -1227,7 +1277,7 @@ void DebugSystem::createRay_() {
 	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(icon_indices), icon_indices, GL_STATIC_DRAW);
 	//unbind
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
-	glBindVertexArray(0);
+	GL_STATE.bindVertexArray(0);
 }
 
 void DebugSystem::createCube_() {
@@ -1252,7 +1302,7 @@ void DebugSystem::createCube_() {
 	};
 
 	glGenVertexArrays(1, &cube_vao_);
-	glBindVertexArray(cube_vao_);
+	GL_STATE.bindVertexArray(cube_vao_);
 
 	GLuint vbo;
 	glGenBuffers(1, &vbo);
@@ -1265,7 +1315,7 @@ void DebugSystem::createCube_() {
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, vbo);
 	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(quad_index_buffer_data), quad_index_buffer_data, GL_STATIC_DRAW);
 
-	glBindVertexArray(0);
+	GL_STATE.bindVertexArray(0);
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
 
@@ -1325,7 +1375,7 @@ void DebugSystem::createGrid_() {
 
 	//gl buffers
 	glGenVertexArrays(1, &grid_vao_);
-	glBindVertexArray(grid_vao_);
+	GL_STATE.bindVertexArray(grid_vao_);
 	GLuint vbo;
 	//positions
 	glGenBuffers(1, &vbo);
@@ -1342,6 +1392,6 @@ void DebugSystem::createGrid_() {
 
 	//unbind
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
-	glBindVertexArray(0);
+	GL_STATE.bindVertexArray(0);
 }
 
@@ -3,6 +3,7 @@
 #include "Shader.h"
 #include <vector>
 #include "GraphicsSystem.h"
+#include "SystemScheduler.h"
 #include "ConsoleModule.h"
 
 
@@ -24,6 +25,9 @@ public:
 
 	void setActive(bool a);
 
+	//scheduler whose timings are shown in Scene window
+	void setScheduler(SystemScheduler* scheduler) { scheduler_ = scheduler; }
+
 	//public imGUI functions
 	bool isShowGUI() { return show_imGUI_; };
 	void toggleimGUI() { show_imGUI_ = !show_imGUI_; };
@@ -50,6 +54,8 @@ public:
 private:
 	//graphics system pointer
 	GraphicsSystem * graphics_system_;
+	//system scheduler pointer (may be null)
+	SystemScheduler* scheduler_ = nullptr;
 
 	//bools to draw or not
 	bool active_;
@@ -0,0 +1,214 @@
+#pragma once
+#include "EntityComponentStore.h"
+#include <functional>
+#include <mutex>
+
+/**** ECS COMMAND BUFFER ****/
+
+//records structural changes to the ECS (create/destroy entities, add/remove
+//components) so that they are made at one point of the frame, when nobody is
+//iterating component arrays or holding references into them. Recording is
+//thread safe. Game::update plays back the global ECS_COMMANDS after the logic
+//systems have run
+//
+//createEntity returns a placeholder handle (negative id, generation is the
+//playback it belongs to), which can be passed to the other commands of the
+//same buffer, or as parent of a Transform added by it, and is resolved on
+//playback. Commands on entities deleted before playback, or on placeholders
+//of an earlier playback, are ignored
+struct EcsCommandBuffer {
+
+    //records creation of entity (with a Transform, as ECS.createEntity)
+    EntityHandle createEntity(std::string name) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        EntityHandle pending;
+        pending.id = -2 - num_pending_;
+        pending.generation = epoch_;
+        num_pending_++;
+        Command cmd;
+        cmd.phase = PhaseCreate;
+        cmd.entity = pending;
+        cmd.name = std::move(name);
+        commands_.push_back(std::move(cmd));
+        return pending;
+    }
+
+    void destroyEntity(EntityHandle entity) {
+        Command cmd;
+        cmd.phase = PhaseDestroy;
+        cmd.entity = entity;
+        push_(std::move(cmd));
+    }
+
+    //records adding component T with value to entity, or overwriting the
+    //value if entity already has one (e.g. for the default Transform)
+    template<typename T>
+    void addComponent(EntityHandle entity, const T& value = T()) {
+        Command cmd;
+        cmd.phase = PhaseAdd;
+        cmd.type = type2int<T>::result;
+        cmd.entity = entity;
+        cmd.apply = [value](EntityComponentStore& ecs, int ent_id, const Resolver& resolver) {
+            T& comp = ecs.hasComponent<T>(ent_id) ? ecs.getComponentFromEntity<T>(ent_id)
+                                                  : ecs.createComponentForEntity<T>(ent_id);
+            assign_(ecs, resolver, comp, value);
+            ecs.markDirty(comp);
+        };
+        cmd.reserve = [](EntityComponentStore& ecs, size_t count) {
+            reserveExtra_(ecs.getAllComponents<T>(), count);
+        };
+        push_(std::move(cmd));
+    }
+
+    template<typename T>
+    void removeComponent(EntityHandle entity) {
+        Command cmd;
+        cmd.phase = PhaseRemove;
+        cmd.type = type2int<T>::result;
+        cmd.entity = entity;
+        cmd.apply = [](EntityComponentStore& ecs, int ent_id, const Resolver&) {
+            ecs.deleteComponent<T>(ent_id);
+        };
+        push_(std::move(cmd));
+    }
+
+    bool empty() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return commands_.empty();
+    }
+
+    //applies all recorded commands to ecs, in the order they were recorded
+    //(so e.g. a remove followed by an add of the same component leaves the
+    //entity with the new one), and clears buffer. Every array is grown once
+    //before the commands are applied
+    void playback(EntityComponentStore& ecs) {
+        std::vector<Command> commands;
+        Resolver resolver;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            commands.swap(commands_);
+            resolver.created.assign(num_pending_, EntityHandle());
+            resolver.epoch = epoch_;
+            num_pending_ = 0;
+            epoch_++;
+        }
+        if (commands.empty()) return;
+        const size_t num_pending = resolver.created.size();
+
+        //grow arrays once: count adds per type (each command has a reserve
+        //function, only one per type is needed)
+        size_t add_counts[NUM_TYPE_COMPONENTS] = {};
+        void (*reserve_funcs[NUM_TYPE_COMPONENTS])(EntityComponentStore&, size_t) = {};
+        for (auto& cmd : commands) {
+            if (cmd.phase != PhaseAdd) continue;
+            add_counts[cmd.type]++;
+            reserve_funcs[cmd.type] = cmd.reserve;
+        }
+        reserveExtra_(ecs.entities, num_pending);
+        reserveExtra_(ecs.getAllComponents<Transform>(), num_pending + add_counts[type2int<Transform>::result]);
+        for (int t = 0; t < NUM_TYPE_COMPONENTS; t++) {
+            if (t != type2int<Transform>::result && reserve_funcs[t])
+                reserve_funcs[t](ecs, add_counts[t]);
+        }
+
+        for (auto& cmd : commands) {
+            if (cmd.phase == PhaseCreate) {
+                resolver.created[-2 - cmd.entity.id] = ecs.getEntityHandle(ecs.createEntity(cmd.name));
+                continue;
+            }
+            const int ent_id = resolver.resolve(ecs, cmd.entity).id;
+            if (ent_id == -1) continue;
+
+            if (cmd.phase == PhaseDestroy)
+                ecs.deleteEntity(ent_id);
+            else
+                cmd.apply(ecs, ent_id, resolver);
+        }
+    }
+
+private:
+    //maps placeholders of one playback to the entities created for them
+    struct Resolver {
+        std::vector<EntityHandle> created;
+        int epoch = 0;
+
+        //handle of live entity, or empty handle if entity is dead, is a
+        //placeholder of another playback, or is not created yet
+        EntityHandle resolve(EntityComponentStore& ecs, EntityHandle handle) const {
+            if (handle.id <= -2) {
+                const int slot = -2 - handle.id;
+                if (handle.generation != epoch || slot >= (int)created.size())
+                    return EntityHandle();
+                handle = created[slot];
+            }
+            return ecs.isValid(handle) ? handle : EntityHandle();
+        }
+    };
+
+    //copies value into comp, keeping bookkeeping of comp
+    template<typename T>
+    static void assign_(EntityComponentStore&, const Resolver&, T& comp, const T& value) {
+        const int owner = comp.owner;
+        const int index = comp.index;
+        comp = value;
+        comp.owner = owner;
+        comp.index = index;
+    }
+    //for a transform only translation, rotation and scale are copied; the
+    //hierarchy fields and cached matrices belong to the ECS, and a new parent
+    //(which may be a placeholder of this buffer) goes through setParent so the
+    //hierarchy order is kept
+    static void assign_(EntityComponentStore& ecs, const Resolver& resolver, Transform& comp, const Transform& value) {
+        comp.translation = value.translation;
+        comp.rotation = value.rotation;
+        comp.scaling = value.scaling;
+        EntityHandle parent = value.parent;
+        if (parent.id != -1) {
+            parent = resolver.resolve(ecs, parent);
+            if (parent.id == -1)
+                std::cerr << "ERROR: EcsCommandBuffer: parent of entity " << comp.owner << " does not exist, left as root" << std::endl;
+        }
+        if (comp.parent.id != parent.id || comp.parent.generation != parent.generation)
+            ecs.setParent(comp.owner, parent);
+    }
+
+    //kind of command
+    enum Phase {
+        PhaseCreate,
+        PhaseAdd,
+        PhaseRemove,
+        PhaseDestroy
+    };
+
+    struct Command {
+        Phase phase;
+        int type = -1;
+        EntityHandle entity;
+        std::string name;
+        std::function<void(EntityComponentStore&, int, const Resolver&)> apply;
+        void (*reserve)(EntityComponentStore&, size_t) = nullptr;
+    };
+
+    std::mutex mutex_;
+    std::vector<Command> commands_;
+    int num_pending_ = 0;
+    int epoch_ = 0; //generation of placeholders, one per playback
+
+    void push_(Command&& cmd) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        commands_.push_back(std::move(cmd));
+    }
+
+    //makes room for count more elements, keeping geometric growth
+    template<typename V>
+    static void reserveExtra_(V& vec, size_t count) {
+        const size_t needed = vec.size() + count;
+        if (needed > vec.capacity())
+            vec.reserve(std::max(needed, vec.capacity() * 2));
+    }
+    //component pools grow by pages without moving, so no need to overallocate
+    template<typename T>
+    static void reserveExtra_(ComponentPool<T>& pool, size_t count) {
+        pool.reserve(pool.size() + count);
+    }
+};
@@ -0,0 +1,463 @@
+#include "EcsSnapshot.h"
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+//increment when format changes
+static const unsigned int SNAPSHOT_FORMAT_VERSION = 1;
+static const char SNAPSHOT_MAGIC[4] = { 'E', 'C', 'S', 'S' };
+static const size_t SNAPSHOT_ALIGN = 16;
+
+struct SnapshotHeader {
+    char magic[4];
+    unsigned int format_version;
+    unsigned int num_types;
+    //sizeof each component type and of Entity, so that a snapshot from a
+    //build with different layouts is rejected
+    unsigned int type_sizes[NUM_TYPE_COMPONENTS];
+    unsigned int entity_size;
+    ComponentHandle main_camera;
+};
+
+/**** WRITING ****/
+
+struct SnapshotWriter {
+    FILE* file = nullptr;
+    size_t offset = 0;
+    bool ok = true;
+
+    void bytes(const void* data, size_t size) {
+        if (size == 0) return;
+        if (fwrite(data, 1, size, file) != size) ok = false;
+        offset += size;
+    }
+    template<typename T>
+    void pod(const T& value) {
+        static_assert(std::is_trivially_copyable<T>::value, "pod() needs a trivially copyable type");
+        bytes(&value, sizeof(T));
+    }
+    void string(const std::string& s) {
+        pod((unsigned int)s.size());
+        bytes(s.data(), s.size());
+    }
+    template<typename T>
+    void vector(const std::vector<T>& v) {
+        pod((unsigned int)v.size());
+        bytes(v.data(), v.size() * sizeof(T));
+    }
+    void align() {
+        static const char zeros[SNAPSHOT_ALIGN] = {};
+        bytes(zeros, (SNAPSHOT_ALIGN - offset % SNAPSHOT_ALIGN) % SNAPSHOT_ALIGN);
+    }
+};
+
+/**** READING ****/
+
+//reads from a block of memory (the mapped file), checking bounds
+struct SnapshotReader {
+    const char* data = nullptr;
+    size_t size = 0;
+    size_t offset = 0;
+    bool ok = true;
+
+    const char* bytes(size_t count) {
+        if (!ok || count > size - offset) { ok = false; return nullptr; }
+        const char* ptr = data + offset;
+        offset += count;
+        return ptr;
+    }
+    template<typename T>
+    void pod(T& value) {
+        const char* ptr = bytes(sizeof(T));
+        if (ptr) std::memcpy((void*)&value, ptr, sizeof(T));
+    }
+    void string(std::string& s) {
+        unsigned int n = 0;
+        pod(n);
+        const char* ptr = bytes(n);
+        if (ptr) s.assign(ptr, n);
+    }
+    template<typename T>
+    void vector(std::vector<T>& v) {
+        unsigned int n = 0;
+        pod(n);
+        const char* ptr = bytes((size_t)n * sizeof(T));
+        if (!ptr) return;
+        v.resize(n);
+        if (n > 0) std::memcpy((void*)v.data(), ptr, (size_t)n * sizeof(T));
+    }
+    void align() {
+        bytes((SNAPSHOT_ALIGN - offset % SNAPSHOT_ALIGN) % SNAPSHOT_ALIGN);
+    }
+};
+
+//read-only memory mapping of a whole file
+struct MappedFile {
+    const char* data = nullptr;
+    size_t size = 0;
+#ifdef _WIN32
+    HANDLE file_ = INVALID_HANDLE_VALUE;
+    HANDLE mapping_ = NULL;
+
+    bool open(const std::string& filename) {
+        file_ = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (file_ == INVALID_HANDLE_VALUE) return false;
+        LARGE_INTEGER file_size;
+        if (!GetFileSizeEx(file_, &file_size) || file_size.QuadPart == 0) return false;
+        size = (size_t)file_size.QuadPart;
+        mapping_ = CreateFileMappingA(file_, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (!mapping_) return false;
+        data = (const char*)MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0);
+        return data != nullptr;
+    }
+    ~MappedFile() {
+        if (data) UnmapViewOfFile(data);
+        if (mapping_) CloseHandle(mapping_);
+        if (file_ != INVALID_HANDLE_VALUE) CloseHandle(file_);
+    }
+#else
+    bool open(const std::string& filename) {
+        int fd = ::open(filename.c_str(), O_RDONLY);
+        if (fd == -1) return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size == 0) { close(fd); return false; }
+        size = (size_t)st.st_size;
+        void* ptr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd); //mapping stays valid
+        if (ptr == MAP_FAILED) return false;
+        data = (const char*)ptr;
+        return true;
+    }
+    ~MappedFile() {
+        if (data) munmap((void*)data, size);
+    }
+#endif
+};
+
+/**** COMPONENTS WRITTEN FIELD BY FIELD ****/
+
+static void writeBase(SnapshotWriter& w, const Component& c) {
+    w.pod(c.owner); w.pod(c.index); w.pod(c.version);
+}
+static void readBase(SnapshotReader& r, Component& c) {
+    r.pod(c.owner); r.pod(c.index); r.pod(c.version);
+}
+
+static void writeComponent(SnapshotWriter& w, const GUIElement& c) {
+    writeBase(w, c);
+    w.pod(c.texture); w.pod(c.width); w.pod(c.height); w.pod(c.anchor);
+    w.pod(c.offset); w.pod(c.screen_bounds);
+}
+static void readComponent(SnapshotReader& r, GUIElement& c) {
+    readBase(r, c);
+    r.pod(c.texture); r.pod(c.width); r.pod(c.height); r.pod(c.anchor);
+    r.pod(c.offset); r.pod(c.screen_bounds);
+}
+
+static void writeComponent(SnapshotWriter& w, const GUIText& c) {
+    writeComponent(w, (const GUIElement&)c);
+    w.string(c.text); w.string(c.font_face); w.pod(c.font_size); w.pod(c.color);
+}
+static void readComponent(SnapshotReader& r, GUIText& c) {
+    readComponent(r, (GUIElement&)c);
+    r.string(c.text); r.string(c.font_face); r.pod(c.font_size); r.pod(c.color);
+}
+
+static void writeComponent(SnapshotWriter& w, const Animation& c) {
+    writeBase(w, c);
+    w.string(c.name); w.pod(c.target_transform); w.pod(c.num_frames); w.pod(c.curr_frame);
+    w.pod(c.ms_frame); w.pod(c.ms_counter); w.vector(c.keyframes);
+}
+static void readComponent(SnapshotReader& r, Animation& c) {
+    readBase(r, c);
+    r.string(c.name); r.pod(c.target_transform); r.pod(c.num_frames); r.pod(c.curr_frame);
+    r.pod(c.ms_frame); r.pod(c.ms_counter); r.vector(c.keyframes);
+}
+
+static void writeComponent(SnapshotWriter& w, const BlendShapes& c) {
+    writeBase(w, c);
+    w.pod((unsigned int)c.blend_names.size());
+    for (auto& name : c.blend_names) w.string(name);
+    w.vector(c.blend_weights);
+}
+static void readComponent(SnapshotReader& r, BlendShapes& c) {
+    readBase(r, c);
+    unsigned int num_names = 0;
+    r.pod(num_names);
+    if (num_names > r.size) { r.ok = false; return; }
+    c.blend_names.resize(num_names);
+    for (auto& name : c.blend_names) r.string(name);
+    r.vector(c.blend_weights);
+}
+
+/**** COMPONENT ARRAYS ****/
+
+static void writeSlots(SnapshotWriter& w, const ComponentSlots& slots) {
+    w.pod(slots.num_enabled);
+    w.vector(slots.sparse);
+    w.vector(slots.dense);
+    w.vector(slots.generations);
+    w.vector(slots.free_slots);
+}
+static void readSlots(SnapshotReader& r, ComponentSlots& slots) {
+    r.pod(slots.num_enabled);
+    r.vector(slots.sparse);
+    r.vector(slots.dense);
+    r.vector(slots.generations);
+    r.vector(slots.free_slots);
+}
+
+template<typename T>
+static void writeComponents(SnapshotWriter& w, EntityComponentStore& ecs) {
+    writeSlots(w, ecs.component_slots[type2int<T>::result]);
+    ComponentPool<T>& pool = ecs.getAllComponents<T>();
+    w.pod((unsigned int)pool.size());
+    if constexpr (std::is_trivially_copyable<T>::value) {
+        w.align();
+        pool.forEachPage([&](const T* first, size_t count) { w.bytes(first, count * sizeof(T)); });
+    }
+    else {
+        for (auto& comp : pool) writeComponent(w, comp);
+    }
+}
+
+template<typename T>
+static void readComponents(SnapshotReader& r, EntityComponentStore& ecs) {
+    readSlots(r, ecs.component_slots[type2int<T>::result]);
+    ComponentPool<T>& pool = ecs.getAllComponents<T>();
+    unsigned int count = 0;
+    r.pod(count);
+    if constexpr (std::is_trivially_copyable<T>::value) {
+        r.align();
+        const char* block = r.bytes((size_t)count * sizeof(T));
+        if (block) pool.assignBytes(block, count);
+    }
+    else {
+        if (count > r.size) { r.ok = false; return; }
+        pool.reserve(count);
+        for (unsigned int i = 0; i < count && r.ok; i++)
+            readComponent(r, pool.emplace_back());
+    }
+}
+
+template<size_t... Is>
+static void writeAllComponents(SnapshotWriter& w, EntityComponentStore& ecs, std::index_sequence<Is...>) {
+    (writeComponents<typename std::tuple_element<Is, ComponentArrays>::type::value_type>(w, ecs), ...);
+}
+
+template<size_t... Is>
+static void readAllComponents(SnapshotReader& r, EntityComponentStore& ecs, std::index_sequence<Is...>) {
+    ((r.ok ? readComponents<typename std::tuple_element<Is, ComponentArrays>::type::value_type>(r, ecs) : void()), ...);
+}
+
+template<size_t... Is>
+static void fillTypeSizes(unsigned int* sizes, std::index_sequence<Is...>) {
+    ((sizes[Is] = (unsigned int)sizeof(typename std::tuple_element<Is, ComponentArrays>::type::value_type)), ...);
+}
+
+typedef std::make_index_sequence<std::tuple_size<ComponentArrays>::value> ComponentIndices;
+
+/**** JOINTS ****/
+
+//joint trees of skinned meshes are written as one flat list (trees may be
+//shared by several meshes), each joint referring to others by index, and
+//each mesh stores the index of its root
+static void writeJoints(SnapshotWriter& w, EntityComponentStore& ecs) {
+    std::vector<Joint*> joints;
+    std::unordered_map<Joint*, int> joint_index;
+    std::vector<int> roots;
+    for (auto& sm : ecs.getAllComponents<SkinnedMesh>()) {
+        if (!sm.root) { roots.push_back(-1); continue; }
+        if (joint_index.count(sm.root) == 0) {
+            std::vector<Joint*> tree;
+            sm.getAllJoints(sm.root, tree);
+            for (Joint* j : tree) {
+                joint_index[j] = (int)joints.size();
+                joints.push_back(j);
+            }
+        }
+        roots.push_back(joint_index[sm.root]);
+    }
+
+    w.pod((unsigned int)joints.size());
+    for (Joint* j : joints) {
+        w.string(j->name); w.string(j->id); w.pod(j->index_in_chain);
+        w.pod(j->model_orig); w.pod(j->matrix); w.pod(j->bind_pose_matrix);
+        auto it = joint_index.find(j->parent);
+        w.pod(j->parent && it != joint_index.end() ? it->second : -1);
+        std::vector<int> children;
+        for (Joint* c : j->children) children.push_back(joint_index[c]);
+        w.vector(children);
+        w.vector(j->keyframes);
+        w.pod(j->num_keyframes); w.pod(j->current_keyframe);
+    }
+    w.vector(roots);
+}
+
+//frees joint trees of all skinned meshes (each joint once, as trees may be
+//shared), before the meshes which own them are cleared
+static void deleteJoints(EntityComponentStore& ecs) {
+    std::unordered_set<Joint*> joints;
+    for (auto& sm : ecs.getAllComponents<SkinnedMesh>()) {
+        if (!sm.root || joints.count(sm.root)) continue;
+        std::vector<Joint*> tree;
+        sm.getAllJoints(sm.root, tree);
+        joints.insert(tree.begin(), tree.end());
+    }
+    for (Joint* j : joints) delete j;
+}
+
+static void readJoints(SnapshotReader& r, EntityComponentStore& ecs) {
+    unsigned int num_joints = 0;
+    r.pod(num_joints);
+    if (num_joints > r.size) { r.ok = false; return; }
+    //like the parsers, joints are allocated here and owned by the meshes
+    std::vector<Joint*> joints(num_joints);
+    for (auto& j : joints) j = new Joint();
+    std::vector<int> parents(num_joints);
+    std::vector<std::vector<int>> children(num_joints);
+    for (unsigned int i = 0; i < num_joints && r.ok; i++) {
+        Joint* j = joints[i];
+        r.string(j->name); r.string(j->id); r.pod(j->index_in_chain);
+        r.pod(j->model_orig); r.pod(j->matrix); r.pod(j->bind_pose_matrix);
+        r.pod(parents[i]);
+        r.vector(children[i]);
+        r.vector(j->keyframes);
+        r.pod(j->num_keyframes); r.pod(j->current_keyframe);
+    }
+    std::vector<int> roots;
+    r.vector(roots);
+    auto& skinned = ecs.getAllComponents<SkinnedMesh>();
+    if (!r.ok || roots.size() != skinned.size()) {
+        for (Joint* j : joints) delete j;
+        r.ok = false;
+        return;
+    }
+
+    //fix up pointers
+    auto joint = [&](int index) { return index >= 0 && index < (int)num_joints ? joints[index] : nullptr; };
+    for (unsigned int i = 0; i < num_joints; i++) {
+        joints[i]->parent = joint(parents[i]);
+        for (int c : children[i])
+            if (joint(c)) joints[i]->children.push_back(joint(c));
+    }
+    for (size_t i = 0; i < skinned.size(); i++)
+        skinned[i].root = joint(roots[i]);
+}
+
+/**** SAVE/LOAD ****/
+
+bool EcsSnapshot::save(EntityComponentStore& ecs, const std::string& filename) {
+    SnapshotWriter w;
+    w.file = fopen(filename.c_str(), "wb");
+    if (!w.file) {
+        std::cerr << "ERROR: could not open snapshot file " << filename << " for writing" << std::endl;
+        return false;
+    }
+    //most writes are a few bytes (entity fields), so buffer generously
+    setvbuf(w.file, nullptr, _IOFBF, 1 << 20);
+
+    SnapshotHeader header = {};
+    std::memcpy(header.magic, SNAPSHOT_MAGIC, 4);
+    header.format_version = SNAPSHOT_FORMAT_VERSION;
+    header.num_types = NUM_TYPE_COMPONENTS;
+    fillTypeSizes(header.type_sizes, ComponentIndices());
+    header.entity_size = sizeof(Entity);
+    header.main_camera = ecs.main_camera;
+    w.pod(header);
+
+    //entities
+    w.pod((unsigned int)ecs.entities.size());
+    for (auto& ent : ecs.entities) {
+        w.string(ent.name);
+        w.pod(ent.components);
+        w.pod(ent.active); w.pod(ent.alive); w.pod(ent.generation);
+    }
+    w.vector(ecs.free_entities);
+
+    writeAllComponents(w, ecs, ComponentIndices());
+    writeJoints(w, ecs);
+
+    if (fclose(w.file) != 0) w.ok = false;
+    if (!w.ok)
+        std::cerr << "ERROR: could not write snapshot file " << filename << std::endl;
+    return w.ok;
+}
+
+bool EcsSnapshot::load(EntityComponentStore& ecs, const std::string& filename) {
+    MappedFile file;
+    if (!file.open(filename)) {
+        std::cerr << "ERROR: could not open snapshot file " << filename << std::endl;
+        return false;
+    }
+    SnapshotReader r;
+    r.data = file.data;
+    r.size = file.size;
+
+    SnapshotHeader header;
+    r.pod(header);
+    unsigned int type_sizes[NUM_TYPE_COMPONENTS] = {};
+    fillTypeSizes(type_sizes, ComponentIndices());
+    if (!r.ok || std::memcmp(header.magic, SNAPSHOT_MAGIC, 4) != 0 ||
+        header.format_version != SNAPSHOT_FORMAT_VERSION ||
+        header.num_types != NUM_TYPE_COMPONENTS ||
+        std::memcmp(header.type_sizes, type_sizes, sizeof(type_sizes)) != 0 ||
+        header.entity_size != sizeof(Entity)) {
+        std::cerr << "ERROR: " << filename << " is not a snapshot of this build" << std::endl;
+        return false;
+    }
+
+    deleteJoints(ecs);
+    ecs.clear();
+    ecs.main_camera = header.main_camera;
+
+    //entities
+    unsigned int num_entities = 0;
+    r.pod(num_entities);
+    if (num_entities > r.size) r.ok = false;
+    if (r.ok) ecs.entities.resize(num_entities);
+    for (unsigned int i = 0; i < num_entities && r.ok; i++) {
+        Entity& ent = ecs.entities[i];
+        r.string(ent.name);
+        r.pod(ent.components);
+        r.pod(ent.active); r.pod(ent.alive); r.pod(ent.generation);
+    }
+    r.vector(ecs.free_entities);
+
+    readAllComponents(r, ecs, ComponentIndices());
+    if (r.ok) readJoints(r, ecs);
+
+    if (!r.ok) {
+        std::cerr << "ERROR: snapshot file " << filename << " is truncated or corrupt" << std::endl;
+        ecs.clear();
+        return false;
+    }
+
+    //name index, in id order
+    ecs.entity_name_index.reserve(ecs.entities.size());
+    for (int i = 0; i < (int)ecs.entities.size(); i++) {
+        if (ecs.entities[i].alive)
+            ecs.entity_name_index[std::hash<std::string_view>()(ecs.entities[i].name)].push_back(i);
+    }
+
+    //everything is new to systems which track changes
+    ecs.advanceVersion();
+    ecs.markDirty(ALL_COMPONENTS);
+    const unsigned int version = ecs.getVersion();
+    std::apply([&](auto&... pools) { ((void)(std::for_each(pools.begin(), pools.end(), [&](auto& c) { c.version = version; })), ...); }, ecs.components);
+    return true;
+}
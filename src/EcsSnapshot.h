@@ -0,0 +1,29 @@
+#pragma once
+#include "EntityComponentStore.h"
+#include <string>
+
+/**** ECS SNAPSHOT ****/
+
+//binary save/restore of a whole EntityComponentStore: entities, every
+//component array (with the slot tables, so entity and component handles stay
+//valid) and the hierarchy, which lives in Transform::parent
+//
+//The file is written in one pass. Arrays of components which can be copied as
+//bytes (Transform, Mesh, Camera, Light, Collider, SkinnedMesh) are stored as
+//raw blocks, 16 byte aligned; load maps the file into memory and copies each
+//block into its pool, then fixes up the few pointer fields (joint trees of
+//skinned meshes) and rebuilds the name index. Other types are written field
+//by field. GUIElement::onClick callbacks can't be saved and are left empty
+//
+//Geometry, material and texture ids are saved as they are, so a snapshot
+//only makes sense with the same resources loaded (e.g. to checkpoint and
+//restore a running game). Snapshots are for the build which wrote them:
+//load fails if any component layout has changed
+class EcsSnapshot {
+public:
+    //writes ecs to file, false on failure
+    static bool save(EntityComponentStore& ecs, const std::string& filename);
+    //replaces contents of ecs with snapshot in file. On failure, prints error
+    //and returns false (ecs may have been cleared)
+    static bool load(EntityComponentStore& ecs, const std::string& filename);
+};
@@ -3,35 +3,200 @@
 #include <vector>
 #include <unordered_map>
 #include <map>
+#include <algorithm>
+#include <numeric>
+#include <string_view>
+#include <tuple>
+#include <climits>
+#include <atomic>
+#include <cassert>
 
 using namespace std;
 
+/**** COMPONENT SLOTS ****/
+
+//sparse->dense indirection for one component type. A ComponentHandle stores a
+//stable slot; 'sparse' maps that slot to the current index of the component in
+//its (dense) vector, and 'dense' maps back, so that when a component is moved
+//by a swap-and-pop delete its slot can be patched in O(1)
+//'generations' is incremented every time a slot is freed, so that a handle
+//to a deleted component does not match anymore and can be detected as stale
+//'num_enabled': components of active entities are kept at the front of the
+//array, [0, num_enabled), and those of inactive entities after them
+struct ComponentSlots {
+    vector<int> sparse;
+    vector<int> dense;
+    vector<int> generations;
+    vector<int> free_slots;
+    int num_enabled = 0;
+
+    //allocates slot for a component just added at back of dense vector
+    int add() {
+        int slot;
+        if (free_slots.size() > 0) {
+            slot = free_slots.back();
+            free_slots.pop_back();
+        }
+        else {
+            slot = (int)sparse.size();
+            sparse.push_back(-1);
+            generations.push_back(0);
+        }
+        sparse[slot] = (int)dense.size();
+        dense.push_back(slot);
+        return slot;
+    }
+
+    //mirrors a swap-and-pop of dense_index in the component vector, and frees
+    //the slot of the removed component
+    void remove(int dense_index) {
+        int slot = dense[dense_index];
+        int last_slot = dense.back();
+        dense[dense_index] = last_slot;
+        sparse[last_slot] = dense_index;
+        dense.pop_back();
+        sparse[slot] = -1;
+        generations[slot]++;
+        free_slots.push_back(slot);
+    }
+};
+
+/**** COMPONENT RANGE ****/
+
+//first 'count' components of a pool, e.g. enabled components of a type
+template<typename T>
+struct ComponentRange {
+    ComponentPool<T>* pool;
+    size_t count;
+    typename ComponentPool<T>::iterator begin() const { return pool->begin(); }
+    typename ComponentPool<T>::iterator end() const { return pool->begin() + count; }
+    size_t size() const { return count; }
+    T& operator[](size_t i) const { return (*pool)[i]; }
+};
+
+/**** VIEW ****/
+
+//iterates all active entities which own ALL the component types Lead, Others...
+//in the dense order of the Lead array, e.g.
+//    for (auto [mesh, transform] : ECS.view<Mesh, Transform>()) { ... }
+//Entity::components is the sparse array of each type, and the owner of each
+//component is its dense->entity array, so a view just walks the Lead array
+//and looks the others up. When the Others arrays have been grouped with the
+//Lead (see EntityComponentStore::groupComponents) the component at the same
+//index already belongs to the same entity, so the lookup is skipped and all
+//arrays are read linearly. Only the enabled part of the Lead array is
+//walked; components of an active entity are all enabled, so Others need no check
+template<typename Lead, typename... Others>
+struct View {
+    vector<Entity>& entities;
+    ComponentPool<Lead>& lead;
+    size_t lead_count;
+    tuple<ComponentPool<Others>&...> others;
+
+    View(vector<Entity>& ents, ComponentPool<Lead>& lead_vec, size_t num_lead, ComponentPool<Others>&... other_vecs) :
+        entities(ents), lead(lead_vec), lead_count(num_lead), others(other_vecs...) {}
+
+    //true if entity owning lead[i] also owns all Others
+    bool ownsAll(size_t i) const {
+        const int owner = lead[i].owner;
+        if (owner == -1) return false;
+        const Entity& ent = entities[owner];
+        return (true && ... && (ent.components[type2int<Others>::result] != -1));
+    }
+
+    template<typename T>
+    T& getOther(size_t i, int owner) const {
+        ComponentPool<T>& the_vec = std::get<ComponentPool<T>&>(others);
+        //grouped fast path
+        if (i < the_vec.size() && the_vec[i].owner == owner)
+            return the_vec[i];
+        return the_vec[entities[owner].components[type2int<T>::result]];
+    }
+
+    struct iterator {
+        const View* view;
+        size_t i;
+        //advance to next index which has all components
+        void skip() {
+            while (i < view->lead_count && !view->ownsAll(i)) i++;
+        }
+        iterator& operator++() { i++; skip(); return *this; }
+        bool operator!=(const iterator& other) const { return i != other.i; }
+        tuple<Lead&, Others&...> operator*() const {
+            Lead& l = view->lead[i];
+            return tuple<Lead&, Others&...>(l, view->template getOther<Others>(i, l.owner)...);
+        }
+    };
+
+    iterator begin() const { iterator it{ this, 0 }; it.skip(); return it; }
+    iterator end() const { return iterator{ this, lead_count }; }
+};
+
 /**** ENTITY COMPONENT STORE ****/
 
 //the entity component manager is a global struct that contains an array of
 //all the entities, and an array to store each of the component types
+//
+//entity ids are stable: a deleted entity leaves a dead slot in 'entities' which
+//is reused by the next createEntity (with a new generation). Components are
+//kept densely packed: deleting one moves the last component of the array into
+//its place (swap-and-pop), so component ids in arrays are NOT stable. To keep
+//a reference to a component across frames store a ComponentHandle instead
+//Component arrays are paged pools which never reallocate, but components
+//still move inside them: when one of their type is deleted, sorted, enabled
+//or disabled, or created for an entity while others of the type are
+//disabled, and transforms also move on setParent and when the hierarchy is
+//sorted. A T& returned by the store is only valid until the next such call;
+//fetch it again (e.g. getComponentFromEntity) after one
 struct EntityComponentStore {
-    
-    //vector of all entities
+
+    //vector of all entities (including dead slots, check Entity::alive)
     vector<Entity> entities;
-    
+
     ComponentArrays components; // defined at bottom of Components.h
-    
+
+    //sparse tables for handles, one per component type
+    ComponentSlots component_slots[NUM_TYPE_COMPONENTS];
+
+    //ids of dead entity slots ready to be reused
+    vector<int> free_entities;
+
+    //index of alive entity ids by hash of their name, see getEntity
+    //keyed by hash (not string) so that lookups from a string_view never
+    //allocate; buckets keep creation order so duplicate names resolve as before
+    unordered_map<size_t, vector<int>> entity_name_index;
+
     //create Entity and add transform component by default
     //return array id of new entity
     int createEntity(string name) {
-        entities.emplace_back(name);
-        createComponentForEntity<Transform>((int)entities.size() - 1);
-        return (int)entities.size() - 1;
+        int ent_id;
+        if (free_entities.size() > 0) {
+            //reuse dead slot - generation was already incremented on delete
+            ent_id = free_entities.back();
+            free_entities.pop_back();
+            entities[ent_id].name = name;
+            entities[ent_id].alive = true;
+            entities[ent_id].active = true;
+        }
+        else {
+            entities.emplace_back(name);
+            ent_id = (int)entities.size() - 1;
+        }
+        entity_name_index[hash<string_view>()(name)].push_back(ent_id);
+        createComponentForEntity<Transform>(ent_id);
+        return ent_id;
     }
 
-	//returns id of entity
-	int getEntity(string name) {
-		for (size_t i = 0; i < entities.size(); i++)
-			if (entities[i].name == name) return (int)i;
+	//returns id of entity, or -1 if there is no entity with that name. O(1)
+	int getEntity(string_view name) {
+		auto it = entity_name_index.find(hash<string_view>()(name));
+		if (it == entity_name_index.end()) return -1;
+		//bucket may hold different names with same hash
+		for (int ent_id : it->second)
+			if (entities[ent_id].name == name) return ent_id;
 		return -1;
 	}
-    
+
     //returns name of entity
     std::string getEntityName(int ent_id) {
         if (ent_id < (int)entities.size())
@@ -39,45 +204,112 @@ struct EntityComponentStore {
         else
             return "ERROR: entity id out of range";
     }
-    
+
+    //returns generational handle of entity id
+    EntityHandle getEntityHandle(int ent_id) {
+        EntityHandle handle;
+        if (ent_id < 0 || ent_id >= (int)entities.size() || !entities[ent_id].alive)
+            return handle;
+        handle.id = ent_id;
+        handle.generation = entities[ent_id].generation;
+        return handle;
+    }
+
+    //false if handle is empty or entity has been deleted since handle was taken
+    bool isValid(EntityHandle handle) {
+        return handle.id >= 0 && handle.id < (int)entities.size() &&
+            entities[handle.id].alive &&
+            entities[handle.id].generation == handle.generation;
+    }
+
     //creates a new component with no entity parent
     template<typename T>
     int createComponent(){
         // get reference to vector
-        vector<T>& the_vec = get<vector<T>>(components);
+        ComponentPool<T>& the_vec = get<ComponentPool<T>>(components);
         // add a new object at back of vector
         the_vec.emplace_back();
+        the_vec.back().owner = -1;
+        the_vec.back().index = (int)the_vec.size() - 1;
+        the_vec.back().version = getVersion();
+        markDirty<T>();
+        structureChanged_<T>();
+        ComponentSlots& slots = component_slots[type2int<T>::result];
+        slots.add();
+        //with no entity it can't be disabled, move it into enabled part
+        swapComponents_<T>(slots.num_enabled, (int)the_vec.size() - 1);
         // return index of new object in vector
-        return (int)the_vec->size() - 1;
+        return slots.num_enabled++;
     }
-    
+
     //creates a new component and associates it with an entity
     template<typename T>
     T& createComponentForEntity(int entity_id){
         // get reference to vector
-        vector<T>& the_vec = get<vector<T>>(components);
+        ComponentPool<T>& the_vec = get<ComponentPool<T>>(components);
         // add a new object at back of vector
         the_vec.emplace_back();
-        
+
         //get index type of ComponentType
         const int type_index = type2int<T>::result;
-        
+
         //set index of entity component array to index of newly added component
         entities[entity_id].components[type_index] = (int)the_vec.size() - 1;
-        
+
         //set owner of component to entity
         Component& new_comp = the_vec.back();
         new_comp.owner = entity_id;
-        
-        return the_vec.back(); // return pointer to new component
+        new_comp.index = (int)the_vec.size() - 1;
+        new_comp.version = getVersion();
+        markDirty<T>();
+        structureChanged_<T>();
+
+        //give it a slot so that handles can be made
+        ComponentSlots& slots = component_slots[type_index];
+        slots.add();
+
+        //move it into enabled part of array if entity is active (transforms
+        //are always enabled, see setEntityActive)
+        if (entities[entity_id].active || std::is_same<T, Transform>::value) {
+            swapComponents_<T>(slots.num_enabled, (int)the_vec.size() - 1);
+            slots.num_enabled++;
+        }
+
+        return the_vec[entities[entity_id].components[type_index]]; // return pointer to new component
     }
-    
+
+    //makes room for 'count' entities in total, e.g. before loading a level
+    void reserveEntities(size_t count) {
+        entities.reserve(count);
+        entity_name_index.reserve(count);
+        reserveComponents<Transform>(count);
+    }
+
+    //makes room for 'count' components of type T in total, so creating them
+    //allocates nothing
+    template<typename T>
+    void reserveComponents(size_t count) {
+        get<ComponentPool<T>>(components).reserve(count);
+        ComponentSlots& slots = component_slots[type2int<T>::result];
+        slots.sparse.reserve(count);
+        slots.dense.reserve(count);
+        slots.generations.reserve(count);
+    }
+
+    //creates a component of type T for each entity in ids, allocating once
+    template<typename T>
+    void createComponentsForEntities(const vector<int>& ids) {
+        reserveComponents<T>(get<ComponentPool<T>>(components).size() + ids.size());
+        for (int id : ids)
+            createComponentForEntity<T>(id);
+    }
+
     //return reference to component at id in array
     template<typename T>
     T& getComponentInArray(int an_id) {
-        return get<vector<T>>(components)[an_id] ;
+        return get<ComponentPool<T>>(components)[an_id] ;
     }
-    
+
     //return reference to component stored in entity
     template<typename T>
     T& getComponentFromEntity(int entity_id) {
@@ -86,12 +318,12 @@ struct EntityComponentStore {
         //get index for component
         const int comp_index = entities[entity_id].components[type_index];
         //return component from vector in tuple
-        return get<vector<T>>(components)[comp_index];
+        return get<ComponentPool<T>>(components)[comp_index];
     }
 
 	//return reference to component stored in entity, accessed by name
 	template<typename T>
-	T& getComponentFromEntity(std::string entity_name) {
+	T& getComponentFromEntity(string_view entity_name) {
 		//get entity id
 		const int entity_id = getEntity(entity_name);
 		//get index for type
@@ -99,9 +331,9 @@ struct EntityComponentStore {
 		//get index for component
 		const int comp_index = entities[entity_id].components[type_index];
 		//return component from vector in tuple
-		return get<vector<T>>(components)[comp_index];
+		return get<ComponentPool<T>>(components)[comp_index];
 	}
-    
+
     template<typename T>
     bool hasComponent(int entity_id) {
         //get index for type
@@ -113,7 +345,7 @@ struct EntityComponentStore {
         else
             return true;
     }
-    
+
     //return id of component in relevant array
     template<typename T>
     int getComponentID(int entity_id) {
@@ -122,137 +354,603 @@ struct EntityComponentStore {
         //return id of this component type for this
         return entities[entity_id].components[type_index];
     }
-    
+
+    //returns handle to component at id in array
+    template<typename T>
+    ComponentHandle getComponentHandleInArray(int an_id) {
+        ComponentSlots& slots = component_slots[type2int<T>::result];
+        ComponentHandle handle;
+        if (an_id < 0 || an_id >= (int)slots.dense.size())
+            return handle;
+        handle.id = slots.dense[an_id];
+        handle.generation = slots.generations[handle.id];
+        return handle;
+    }
+
+    //returns handle to component stored in entity (empty if there is none)
+    template<typename T>
+    ComponentHandle getComponentHandle(int entity_id) {
+        return getComponentHandleInArray<T>(getComponentID<T>(entity_id));
+    }
+
+    //false if handle is empty or component has been deleted
+    template<typename T>
+    bool isValid(ComponentHandle handle) {
+        ComponentSlots& slots = component_slots[type2int<T>::result];
+        return handle.id >= 0 && handle.id < (int)slots.sparse.size() &&
+            slots.sparse[handle.id] != -1 &&
+            slots.generations[handle.id] == handle.generation;
+    }
+
+    //returns current id in array of component pointed to by handle, or -1 if stale
+    template<typename T>
+    int getComponentIndex(ComponentHandle handle) {
+        if (!isValid<T>(handle)) return -1;
+        return component_slots[type2int<T>::result].sparse[handle.id];
+    }
+
+    //return reference to component pointed to by handle
+    //handle must be valid! check with isValid<T>() if unsure (asserted in
+    //debug builds)
+    template<typename T>
+    T& getComponent(ComponentHandle handle) {
+        assert(isValid<T>(handle));
+        const int comp_index = component_slots[type2int<T>::result].sparse[handle.id];
+        return get<ComponentPool<T>>(components)[comp_index];
+    }
+
     //returns a const (i.e. non-editable) reference to vector of Type
     //i.e. array will not be editable
+    //NOTE: includes components of inactive entities, at end of array
     template<typename T>
-    std::vector<T>& getAllComponents() {
-        return get<vector<T>>(components);
+    ComponentPool<T>& getAllComponents() {
+        return get<ComponentPool<T>>(components);
     }
-    //stores main camera id
-    int main_camera = -1;
 
+    //returns range of components of active entities, i.e. those to update
+    template<typename T>
+    ComponentRange<T> getEnabledComponents() {
+        return ComponentRange<T>{ &get<ComponentPool<T>>(components), (size_t)getNumEnabled<T>() };
+    }
 
-	void deleteEntity(string name) {
-		for (size_t i = 0; i < entities.size(); i++)
-			if (entities[i].name == name) deleteEntity((int)i);
-	}
+    //returns number of components of active entities
+    template<typename T>
+    int getNumEnabled() {
+        return component_slots[type2int<T>::result].num_enabled;
+    }
 
-	void deleteEntity(int id) {
+    //activates or deactivates an entity. Components of an inactive entity are
+    //moved to the end of their arrays, so views and getEnabledComponents skip
+    //them without checking. O(number of types)
+    //NOTE: changes order of lights, so GraphicsSystem lights must be updated
+    void setEntityActive(int id, bool active) {
+        if (entities[id].active == active)
+            return;
+        entities[id].active = active;
+        //transforms stay enabled: children of an inactive entity still need
+        //its world matrix, and the array is kept in hierarchy order instead
+        setComponentEnabled_<Light>(id, active);
+        setComponentEnabled_<Collider>(id, active);
+        setComponentEnabled_<Camera>(id, active);
+        setComponentEnabled_<GUIElement>(id, active);
+        setComponentEnabled_<GUIText>(id, active);
+        setComponentEnabled_<Mesh>(id, active);
+        setComponentEnabled_<Animation>(id, active);
+        setComponentEnabled_<SkinnedMesh>(id, active);
+        setComponentEnabled_<BlendShapes>(id, active);
+    }
 
-		std::map<int, int> entity_delete_map;
-		int rest = 0;
-		for (size_t i = 0; i < entities.size(); i++) {
-			if (i == id) {
-				rest = 1;
-			}
-			else {
-				entity_delete_map[i] = i - rest;
-			}
-		}
+    //returns a view over all entities owning every one of the types, see View
+    template<typename Lead, typename... Others>
+    View<Lead, Others...> view() {
+        return View<Lead, Others...>(entities, get<ComponentPool<Lead>>(components), getNumEnabled<Lead>(),
+                                     get<ComponentPool<Others>>(components)...);
+    }
 
-		deleteComponentTransform(id, entity_delete_map);
-		deleteComponent<Light>(id, entity_delete_map);
-		deleteComponent<Collider>(id, entity_delete_map);
-		deleteComponent<Camera>(id, entity_delete_map);
-		deleteComponent<GUIElement>(id, entity_delete_map);
-		deleteComponent<GUIText>(id, entity_delete_map);
-		deleteComponent<Mesh>(id, entity_delete_map);
-		deleteComponent<Animation>(id, entity_delete_map);
-		deleteComponent<SkinnedMesh>(id, entity_delete_map);
-		deleteComponent<BlendShapes>(id, entity_delete_map);
-		rest = 0;
-		for (size_t i = 0; i < entities.size(); i++) {
-			if (i == id) {
-				rest = 1;
-			}
-			else {
-				entities[i - rest] = entities[i];
-			}
-		}
-		entities.pop_back();
-	}
+    //reorders arrays of Lead and T so that the first components of both belong
+    //to the same entities in the same order (Lead components without a T are
+    //moved to the back). Order of Lead is otherwise preserved. After this,
+    //view<Lead, T>() streams both arrays linearly, until new components are
+    //created or deleted - call it again after loading, not every frame
+    template<typename Lead, typename T>
+    void groupComponents() {
+        const int lead_type = type2int<Lead>::result;
+        const int t_type = type2int<T>::result;
+        //1) Lead components whose entity also owns a T first
+        sortComponents<Lead>([&](const Lead& a, const Lead& b) {
+            bool a_has = a.owner != -1 && entities[a.owner].components[t_type] != -1;
+            bool b_has = b.owner != -1 && entities[b.owner].components[t_type] != -1;
+            return a_has && !b_has;
+        });
+        //2) T sorted by index of the Lead of its entity (if any)
+        auto lead_index = [&](const T& c) {
+            if (c.owner == -1) return INT_MAX;
+            int id = entities[c.owner].components[lead_type];
+            return id == -1 ? INT_MAX : id;
+        };
+        sortComponents<T>([&](const T& a, const T& b) {
+            return lead_index(a) < lead_index(b);
+        });
+    }
+
+    //deletes all entities and components, e.g. before loading a snapshot
+    void clear() {
+        std::apply([](auto&... pools) { (pools.clear(), ...); }, components);
+        for (auto& slots : component_slots)
+            slots = ComponentSlots();
+        entities.clear();
+        free_entities.clear();
+        entity_name_index.clear();
+        main_camera = ComponentHandle();
+        markDirty(ALL_COMPONENTS);
+        hierarchy_dirty_ = true;
+    }
 
+    /**** CHANGE TRACKING ****/
 
-	void deleteComponentTransform(int entity_id, std::map<int, int> entity_delete_map) {
-		int rest = 0;
-		auto& components = getAllComponents<Transform>();
-		if (getComponentID<Transform>(entity_id) == -1) {
-			for (size_t i = 0; i < components.size(); i++) {
-				components[i].owner = entity_delete_map[components[i].owner];
-			}
-			return;
-		}
-		std::map<int, int> transfor_delete_map;
-
-		int entity_transform_id = -1;
-		int entity_transform_parent = -1;
-		for (size_t i = 0; i < components.size(); i++) {
-			if (components[i].owner == entity_id) {
-				rest = 1;
-				entity_transform_id = components[i].index;
-				entity_transform_parent = components[i].parent;
-			}
-			else {
-				components[i - rest] = components[i];
-				components[i - rest].index = i - rest;
-				transfor_delete_map[i] = i - rest;
-				const int type_index = type2int<Transform>::result;
-				entities[components[i - rest].owner].components[type_index] = i - rest;
-				components[i - rest].owner = transfor_delete_map[components[i - rest].owner];
-
-				if (components[i - rest].parent != -1) {
-					if (components[i - rest].parent != entity_transform_id) {
-						components[i - rest].parent = transfor_delete_map[components[i - rest].parent];
-					}
-					else {
-						components[i - rest].parent = entity_transform_parent;
-					}
-				}
-			}
+    //every change is stamped with the current version: the component itself
+    //(Component::version) and its type. To find out what changed, a system
+    //keeps the value returned by advanceVersion() the last time it looked,
+    //and passes it as 'since' to changed(), e.g.
+    //    if (ECS.changed<Light>(lights_version_)) ...
+    //    lights_version_ = ECS.advanceVersion();
+    //Creating, deleting, sorting and (de)activating components mark their
+    //type, and every component which moved in its array. Other changes are
+    //only seen if the code making them calls markDirty() (or writes through
+    //getComponentForWrite), so a type no system touched stays unchanged and
+    //its users can skip it. World matrices have their own version,
+    //Transform::world_version, as moving a parent doesn't mark its children
+
+    unsigned int getVersion() { return version_.load(std::memory_order_relaxed); }
+
+    //returns current version and starts a new one, so that any change from
+    //now on is newer than the returned value
+    unsigned int advanceVersion() { return version_.fetch_add(1, std::memory_order_relaxed); }
+
+    //marks whole type as changed
+    template<typename T>
+    void markDirty() {
+        type_versions_[type2int<T>::result].store(getVersion(), std::memory_order_relaxed);
+    }
+
+    //marks all types in mask as changed
+    void markDirty(ComponentMask mask) {
+        const unsigned int v = getVersion();
+        for (int t = 0; t < NUM_TYPE_COMPONENTS; t++)
+            if ((mask >> t) & 1u) type_versions_[t].store(v, std::memory_order_relaxed);
+    }
+
+    //marks component (and its type) as changed
+    template<typename T>
+    void markDirty(T& comp) {
+        comp.version = getVersion();
+        markDirty<T>();
+    }
+
+    //returns component of entity for writing, marking it as changed
+    template<typename T>
+    T& getComponentForWrite(int entity_id) {
+        T& comp = getComponentFromEntity<T>(entity_id);
+        markDirty(comp);
+        return comp;
+    }
+
+    //true if any component of type T changed after version 'since'
+    template<typename T>
+    bool changed(unsigned int since) {
+        return type_versions_[type2int<T>::result].load(std::memory_order_relaxed) > since;
+    }
+
+    //true if comp was created or marked dirty after version 'since'
+    bool changed(const Component& comp, unsigned int since) {
+        return comp.version > since;
+    }
+
+    //stores handle of main camera component
+    ComponentHandle main_camera;
+
+    //returns world matrix of transform, as computed by TransformSystem this
+    //frame (changes made after it ran show up next frame)
+    const lm::mat4& getGlobalMatrix(const Transform& transform) {
+        return transform.world;
+    }
+
+    //returns normal matrix of transform, computed with its world matrix
+    const lm::mat3& getNormalMatrix(const Transform& transform) {
+        return transform.normal_matrix;
+    }
+
+    //sets parent of transform of entity (an invalid handle makes it a root).
+    //Its subtree moves to the end of the new parent's subtree (or of the
+    //array), so only the transforms between its old and new place move. A
+    //parent inside the subtree would make a cycle, and is refused
+    void setParent(int entity_id, EntityHandle parent) {
+        Transform& transform = getComponentFromEntity<Transform>(entity_id);
+        //while the array is out of order (e.g. loading a level) parents are
+        //only recorded, and the whole array is sorted once before its use
+        if (hierarchy_dirty_) {
+            transform.parent = parent;
+            markDirty(transform);
+            return;
+        }
+        ComponentPool<Transform>& transforms = get<ComponentPool<Transform>>(components);
+        const int i = transform.index;
+        const int size = transform.num_descendants + 1;
+        int p = -1;
+        if (isValid(parent))
+            p = entities[parent.id].components[type2int<Transform>::result];
+        if (p >= i && p < i + size) {
+            std::cerr << "ERROR: setParent of entity " << entity_id << " would make a cycle, ignored" << std::endl;
+            return;
+        }
+        transform.parent = parent;
+        markDirty(transform);
+        if (p == transform.parent_index)
+            return;
+
+        //end of subtree of new parent, before anything changes
+        const int dest = p == -1 ? (int)transforms.size() : p + transforms[p].num_descendants + 1;
+        for (int a = transform.parent_index; a != -1; a = transforms[a].parent_index)
+            transforms[a].num_descendants -= size;
+        for (int a = p; a != -1; a = transforms[a].parent_index)
+            transforms[a].num_descendants += size;
+        transform.parent_index = p;
+        moveTransforms_(i, size, dest);
+    }
+
+    //reorders Transform array so that every transform comes after its parent
+    //and each subtree is contiguous: transform i and its descendants are
+    //[i, i + num_descendants]. Sets Transform::parent_index and
+    //num_descendants. Creating, deleting and reparenting transforms keep this
+    //order as they go, so a full sort is only needed after loading (a level
+    //or snapshot) or reordering the array some other way. Returns true if it
+    //sorted
+    bool sortTransformHierarchy() {
+        if (!hierarchy_dirty_) return false;
+        ComponentPool<Transform>& transforms = get<ComponentPool<Transform>>(components);
+        const int n = (int)transforms.size();
+
+        //parent of each transform (by old index), and children lists in one
+        //array (children of i are children[first_child[i]..first_child[i+1]])
+        vector<int> parent_of(n, -1);
+        vector<int> first_child(n + 1, 0);
+        for (int i = 0; i < n; i++) {
+            const EntityHandle& parent = transforms[i].parent;
+            if (isValid(parent) && entities[parent.id].components[type2int<Transform>::result] != -1) {
+                parent_of[i] = getComponentID<Transform>(parent.id);
+                first_child[parent_of[i] + 1]++;
+            }
+        }
+        for (int i = 0; i < n; i++) first_child[i + 1] += first_child[i];
+        vector<int> children(first_child[n]);
+        vector<int> fill(first_child.begin(), first_child.end() - 1);
+        for (int i = 0; i < n; i++)
+            if (parent_of[i] != -1) children[fill[parent_of[i]]++] = i;
+
+        vector<int> roots;
+        for (int i = 0; i < n; i++)
+            if (parent_of[i] == -1) roots.push_back(i);
+
+        //depth first, parents before children
+        vector<int> order;
+        order.reserve(n);
+        vector<char> visited(n, 0);
+        vector<int> stack;
+        auto visit = [&](int root) {
+            stack.push_back(root);
+            while (!stack.empty()) {
+                const int i = stack.back();
+                stack.pop_back();
+                if (visited[i]) continue;
+                visited[i] = 1;
+                order.push_back(i);
+                //reversed, so that children are visited in array order
+                for (int c = first_child[i + 1] - 1; c >= first_child[i]; c--)
+                    stack.push_back(children[c]);
+            }
+        };
+        for (int root : roots) visit(root);
+        //whatever is left is in a parent cycle: cut it, making one a root
+        for (int i = 0; i < n; i++) {
+            if (visited[i]) continue;
+            parent_of[i] = -1;
+            visit(i);
+        }
+
+        //new position of each transform, and its descendants counted from
+        //the leaves up
+        vector<int> new_index(n);
+        for (int i = 0; i < n; i++) new_index[order[i]] = i;
+        vector<int> num_descendants(n, 0);
+        for (int i = n - 1; i >= 0; i--) {
+            const int parent = parent_of[order[i]];
+            if (parent != -1) num_descendants[new_index[parent]] += num_descendants[i] + 1;
+        }
+
+        //transforms whose parent changed need new world matrices
+        const unsigned int v = getVersion();
+        for (int i = 0; i < n; i++) {
+            const int old_parent = transforms[i].parent_index;
+            if (old_parent != parent_of[i]) transforms[i].version = v;
+        }
+
+        reorderComponents_<Transform>(order);
+        for (int i = 0; i < n; i++) {
+            const int parent = parent_of[order[i]];
+            transforms[i].parent_index = parent == -1 ? -1 : new_index[parent];
+            transforms[i].num_descendants = num_descendants[i];
+        }
+        hierarchy_dirty_ = false;
+        return true;
+    }
+
+    //changes whenever the set of root subtrees of the Transform array may
+    //have changed (e.g. for TransformSystem's list of roots)
+    unsigned int getHierarchyVersion() { return hierarchy_version_; }
+
+    //sorts array of components of type T (comp is a 'less than' function of
+    //two components), updating entities and handles to the new positions
+    //enabled and disabled components are sorted separately
+    template<typename T, typename Compare>
+    void sortComponents(Compare comp) {
+        ComponentPool<T>& the_vec = get<ComponentPool<T>>(components);
+        ComponentSlots& slots = component_slots[type2int<T>::result];
+
+        //sort a list of indices rather than components themselves so that we
+        //know where every component came from
+        vector<int> order(the_vec.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(), [&](int a, int b) {
+            const bool a_disabled = a >= slots.num_enabled;
+            const bool b_disabled = b >= slots.num_enabled;
+            if (a_disabled != b_disabled) return b_disabled;
+            return comp(the_vec[a], the_vec[b]);
+        });
+        reorderComponents_<T>(order);
+    }
+
+
+	//deletes all entities with this name
+	void deleteEntity(string_view name) {
+		int ent_id = getEntity(name);
+		while (ent_id != -1) {
+			deleteEntity(ent_id);
+			ent_id = getEntity(name);
 		}
-		components.pop_back();
 	}
 
-	template<typename T>
-	void deleteComponent(int entity_id, std::map<int, int> entity_delete_map) {
-		int rest = 0;
-		auto& components = getAllComponents<T>();
-		if (getComponentID<T>(entity_id) == -1) {
-			for (size_t i = 0; i < components.size(); i++) {
-				components[i].owner = entity_delete_map[components[i].owner];
-			}
-			return;
-		}
-		for (size_t i = 0; i < components.size(); i++) {
-			if (components[i].owner == entity_id) {
-				rest = 1;
-			}
-			else {
-				components[i - rest] = components[i];
-				components[i - rest].index = i - rest;
-				const int type_index = type2int<T>::result;
-				entities[components[i - rest].owner].components[type_index] = i - rest;
-				components[i - rest].owner = entity_delete_map[components[i - rest].owner];
-			}
-		}
-		components.pop_back();
+    //deletes all components of entity and frees its slot. O(number of types)
+	void deleteEntity(int id) {
+        if (id < 0 || id >= (int)entities.size() || !entities[id].alive)
+            return;
+
+		deleteComponent<Transform>(id);
+		deleteComponent<Light>(id);
+		deleteComponent<Collider>(id);
+		deleteComponent<Camera>(id);
+		deleteComponent<GUIElement>(id);
+		deleteComponent<GUIText>(id);
+		deleteComponent<Mesh>(id);
+		deleteComponent<Animation>(id);
+		deleteComponent<SkinnedMesh>(id);
+		deleteComponent<BlendShapes>(id);
+
+        //remove from name index
+        auto it = entity_name_index.find(hash<string_view>()(entities[id].name));
+        vector<int>& bucket = it->second;
+        bucket.erase(std::find(bucket.begin(), bucket.end(), id));
+        if (bucket.empty()) entity_name_index.erase(it);
+
+        //kill slot, any handle to this entity is now stale
+        entities[id].name = "";
+        entities[id].alive = false;
+        entities[id].generation++;
+        free_entities.push_back(id);
 	}
 
+    //deletes component of type T from entity (if it has one) by moving the last
+    //component of the array into its place. O(1)
 	template<typename T>
 	void deleteComponent(int entity_id) {
-		std::map<int, int> entity_delete_map;
-		int rest = 0;
-		for (size_t i = 0; i < entities.size(); i++) {
-			if (i == entity_id) {
-				rest = 1;
-			}
-			else {
-				entity_delete_map[i] = i - rest;
-			}
-		}
+        const int type_index = type2int<T>::result;
+        int comp_index = entities[entity_id].components[type_index];
+        if (comp_index == -1)
+            return;
+
+        //a transform leaves the hierarchy first, so that the order is kept
+        //(and the swap and move below do nothing): its subtree moves to the
+        //end of the array, its children become roots, and it moves to the
+        //very end, after them
+        if constexpr (std::is_same<T, Transform>::value) {
+            if (!hierarchy_dirty_) {
+                ComponentPool<Transform>& transforms = get<ComponentPool<Transform>>(components);
+                const int n = (int)transforms.size();
+                const int size = transforms[comp_index].num_descendants + 1;
+                for (int a = transforms[comp_index].parent_index; a != -1; a = transforms[a].parent_index)
+                    transforms[a].num_descendants -= size;
+                transforms[comp_index].parent_index = -1;
+                moveTransforms_(comp_index, size, n);
+                comp_index = n - size;
+                for (int c = comp_index + 1; c < n; c += transforms[c].num_descendants + 1) {
+                    transforms[c].parent_index = -1;
+                    markDirty(transforms[c]);
+                }
+                transforms[comp_index].num_descendants = 0;
+                moveTransforms_(comp_index, 1, n);
+                comp_index = n - 1;
+            }
+        }
+
+        //move it out of enabled part first, so that partition is kept
+        ComponentSlots& slots = component_slots[type_index];
+        if (comp_index < slots.num_enabled) {
+            swapComponents_<T>(comp_index, slots.num_enabled - 1);
+            slots.num_enabled--;
+            comp_index = slots.num_enabled;
+        }
 
-		deleteComponent<T>(entity_id, entity_delete_map);
+        ComponentPool<T>& the_vec = get<ComponentPool<T>>(components);
+        const int last_index = (int)the_vec.size() - 1;
+        if (comp_index != last_index) {
+            //move last component into hole and tell its entity where it went
+            the_vec[comp_index] = std::move(the_vec[last_index]);
+            the_vec[comp_index].index = comp_index;
+            the_vec[comp_index].version = getVersion();
+            if (the_vec[comp_index].owner != -1)
+                entities[the_vec[comp_index].owner].components[type_index] = comp_index;
+        }
+        the_vec.pop_back();
+
+        slots.remove(comp_index);
+        entities[entity_id].components[type_index] = -1;
+        markDirty<T>();
+        structureChanged_<T>();
 	}
-    
+
+private:
+    //true when Transform array may be out of hierarchy order, see
+    //sortTransformHierarchy. An empty store counts as unsorted, so that a
+    //level is loaded without keeping order and sorted once
+    bool hierarchy_dirty_ = true;
+    unsigned int hierarchy_version_ = 0;
+
+    //components of type T were created, deleted or moved in their array
+    template<typename T>
+    void structureChanged_() {
+        if constexpr (std::is_same<T, Transform>::value)
+            hierarchy_version_++;
+    }
+
+    //components of type T were moved without regard to hierarchy order
+    template<typename T>
+    void orderChanged_() {
+        if constexpr (std::is_same<T, Transform>::value)
+            hierarchy_dirty_ = true;
+        structureChanged_<T>();
+    }
+
+    //moves transforms [first, first + count) so that they come right before
+    //the transform now at dest (which is not inside the range; the size of
+    //the array to move them to the end). Only the transforms between the two
+    //places move. Fixes parent_index of everything from there on
+    void moveTransforms_(int first, int count, int dest) {
+        if (dest >= first && dest <= first + count)
+            return;
+        ComponentPool<Transform>& transforms = get<ComponentPool<Transform>>(components);
+        const int type_index = type2int<Transform>::result;
+        ComponentSlots& slots = component_slots[type_index];
+        const int n = (int)transforms.size();
+        const int lo = std::min(first, dest);
+        const int hi = std::max(first + count, dest);
+        //new position of transform at old position x
+        auto moved = [&](int x) {
+            if (x < lo || x >= hi) return x;
+            if (x >= first && x < first + count)
+                return dest > first ? x + dest - first - count : x - (first - dest);
+            return dest > first ? x - count : x + count;
+        };
+        for (int j = lo; j < n; j++)
+            if (transforms[j].parent_index != -1)
+                transforms[j].parent_index = moved(transforms[j].parent_index);
+
+        vector<Transform> range;
+        vector<int> range_dense;
+        range.reserve(hi - lo);
+        range_dense.reserve(hi - lo);
+        for (int j = lo; j < hi; j++) {
+            range.push_back(std::move(transforms[j]));
+            range_dense.push_back(slots.dense[j]);
+        }
+        for (int j = lo; j < hi; j++) {
+            const int k = moved(j);
+            transforms[k] = std::move(range[j - lo]);
+            slots.dense[k] = range_dense[j - lo];
+        }
+        for (int j = lo; j < hi; j++) {
+            Transform& t = transforms[j];
+            t.index = j;
+            slots.sparse[slots.dense[j]] = j;
+            if (t.owner != -1)
+                entities[t.owner].components[type_index] = j;
+            markDirty(t);
+        }
+        structureChanged_<Transform>();
+    }
+
+    //moves components of type T so that the one at order[i] ends up at i,
+    //updating entities and handles to the new positions
+    template<typename T>
+    void reorderComponents_(const vector<int>& order) {
+        ComponentPool<T>& the_vec = get<ComponentPool<T>>(components);
+        const int type_index = type2int<T>::result;
+        ComponentSlots& slots = component_slots[type_index];
+
+        //move components out in new order and back into the same pages
+        vector<T> sorted_vec;
+        sorted_vec.reserve(the_vec.size());
+        vector<int> sorted_dense(the_vec.size());
+        for (size_t i = 0; i < order.size(); i++) {
+            sorted_vec.push_back(std::move(the_vec[order[i]]));
+            sorted_dense[i] = slots.dense[order[i]];
+        }
+        for (size_t i = 0; i < sorted_vec.size(); i++)
+            the_vec[i] = std::move(sorted_vec[i]);
+        slots.dense.swap(sorted_dense);
+
+        //patch indices in components, entities and slots
+        const unsigned int v = getVersion();
+        for (size_t i = 0; i < the_vec.size(); i++) {
+            if (the_vec[i].index != (int)i) the_vec[i].version = v;
+            the_vec[i].index = (int)i;
+            slots.sparse[slots.dense[i]] = (int)i;
+            if (the_vec[i].owner != -1)
+                entities[the_vec[i].owner].components[type_index] = (int)i;
+        }
+        markDirty<T>();
+        orderChanged_<T>();
+    }
+
+    //change tracking, see advanceVersion(). Starts at 1 so that a system
+    //which has never looked (since = 0) sees everything as changed
+    std::atomic<unsigned int> version_{ 1 };
+    std::atomic<unsigned int> type_versions_[NUM_TYPE_COMPONENTS] = {};
+
+    //swaps two components in array, updating entities and slots
+    template<typename T>
+    void swapComponents_(int a, int b) {
+        if (a == b) return;
+        ComponentPool<T>& the_vec = get<ComponentPool<T>>(components);
+        const int type_index = type2int<T>::result;
+        ComponentSlots& slots = component_slots[type_index];
+        std::swap(the_vec[a], the_vec[b]);
+        the_vec[a].index = a;
+        the_vec[b].index = b;
+        if (the_vec[a].owner != -1) entities[the_vec[a].owner].components[type_index] = a;
+        if (the_vec[b].owner != -1) entities[the_vec[b].owner].components[type_index] = b;
+        std::swap(slots.dense[a], slots.dense[b]);
+        slots.sparse[slots.dense[a]] = a;
+        slots.sparse[slots.dense[b]] = b;
+        //both moved, which matters to anyone indexing by position
+        markDirty(the_vec[a]);
+        markDirty(the_vec[b]);
+        orderChanged_<T>();
+    }
+
+    //moves component of entity (if any) across the enabled/disabled boundary
+    template<typename T>
+    void setComponentEnabled_(int entity_id, bool enabled) {
+        const int comp_index = getComponentID<T>(entity_id);
+        if (comp_index == -1)
+            return;
+        ComponentSlots& slots = component_slots[type2int<T>::result];
+        if (enabled && comp_index >= slots.num_enabled) {
+            swapComponents_<T>(comp_index, slots.num_enabled);
+            slots.num_enabled++;
+        }
+        else if (!enabled && comp_index < slots.num_enabled) {
+            swapComponents_<T>(comp_index, slots.num_enabled - 1);
+            slots.num_enabled--;
+        }
+    }
+
 };
@@ -0,0 +1,160 @@
+#include "Frustum.h"
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FRUSTUM_SSE 1
+#include <emmintrin.h>
+#endif
+
+void Frustum::extract(const lm::mat4& vp) {
+    //row r of column major matrix is m[r], m[4 + r], m[8 + r], m[12 + r].
+    //Clip space point is inside if -w <= x, y, z <= w, so each plane is the
+    //last row plus or minus one of the others
+    const float* m = vp.m;
+    for (int i = 0; i < 3; i++) {
+        planes[2 * i] = lm::vec4(m[3] + m[i], m[7] + m[4 + i], m[11] + m[8 + i], m[15] + m[12 + i]);
+        planes[2 * i + 1] = lm::vec4(m[3] - m[i], m[7] - m[4 + i], m[11] - m[8 + i], m[15] - m[12 + i]);
+    }
+    for (auto& p : planes) {
+        const float length = sqrtf(p.x * p.x + p.y * p.y + p.z * p.z);
+        if (length > 0.0f) p = p * (1.0f / length);
+    }
+}
+
+bool Frustum::testBox(const lm::vec3& c, const lm::vec3& e) const {
+    //box is outside a plane if its center is further behind it than the
+    //projection of the half size onto the plane normal
+    for (const auto& p : planes) {
+        const float distance = p.x * c.x + p.y * c.y + p.z * c.z + p.w;
+        const float radius = fabsf(p.x) * e.x + fabsf(p.y) * e.y + fabsf(p.z) * e.z;
+        if (distance + radius < 0.0f) return false;
+    }
+    return true;
+}
+
+bool Frustum::testSphere(const lm::vec3& c, float radius) const {
+    for (const auto& p : planes) {
+        if (p.x * c.x + p.y * c.y + p.z * c.z + p.w < -radius) return false;
+    }
+    return true;
+}
+
+void transformBox(const lm::mat4& m, lm::vec3& c, lm::vec3& e) {
+    //center is transformed as a point; half size along each world axis is
+    //the sum of the absolute values of the transformed box axes (Arvo)
+    const lm::vec3 center(m.m[0] * c.x + m.m[4] * c.y + m.m[8] * c.z + m.m[12],
+                          m.m[1] * c.x + m.m[5] * c.y + m.m[9] * c.z + m.m[13],
+                          m.m[2] * c.x + m.m[6] * c.y + m.m[10] * c.z + m.m[14]);
+    const lm::vec3 half_width(fabsf(m.m[0]) * e.x + fabsf(m.m[4]) * e.y + fabsf(m.m[8]) * e.z,
+                              fabsf(m.m[1]) * e.x + fabsf(m.m[5]) * e.y + fabsf(m.m[9]) * e.z,
+                              fabsf(m.m[2]) * e.x + fabsf(m.m[6]) * e.y + fabsf(m.m[10]) * e.z);
+    c = center;
+    e = half_width;
+}
+
+void CullBoxes::resize(int n) {
+    size_ = n;
+    //padding boxes are empty boxes at origin, masked out by cullBoxes
+    const size_t padded = (size_t)cullMaskWords(n) * 32;
+    cx.resize(padded); cy.resize(padded); cz.resize(padded);
+    ex.resize(padded); ey.resize(padded); ez.resize(padded);
+}
+
+void CullBoxes::set(int i, const lm::vec3& c, const lm::vec3& e) {
+    cx[i] = c.x; cy[i] = c.y; cz[i] = c.z;
+    ex[i] = e.x; ey[i] = e.y; ez[i] = e.z;
+}
+
+void CullBoxes::setTransformed(int i, const lm::vec3& center, const lm::vec3& half_width, const lm::mat4& m) {
+    lm::vec3 c = center, e = half_width;
+    transformBox(m, c, e);
+    set(i, c, e);
+}
+
+void cullBoxes(const Frustum& frustum, const CullBoxes& boxes, int first, int count, uint32_t* visible) {
+    cullBoxesMulti(&frustum, 1, boxes, first, count, visible, 0);
+}
+
+#if FRUSTUM_SSE
+//planes of a frustum, each component in all four lanes, plus absolute
+//values of normals
+struct FrustumSSE {
+    __m128 n[Frustum::NUM_PLANES][4];
+    __m128 a[Frustum::NUM_PLANES][3];
+    void set(const Frustum& frustum) {
+        for (int p = 0; p < Frustum::NUM_PLANES; p++) {
+            const lm::vec4& plane = frustum.planes[p];
+            n[p][0] = _mm_set1_ps(plane.x); a[p][0] = _mm_set1_ps(fabsf(plane.x));
+            n[p][1] = _mm_set1_ps(plane.y); a[p][1] = _mm_set1_ps(fabsf(plane.y));
+            n[p][2] = _mm_set1_ps(plane.z); a[p][2] = _mm_set1_ps(fabsf(plane.z));
+            n[p][3] = _mm_set1_ps(plane.w);
+        }
+    }
+};
+#endif
+
+void cullBoxesMulti(const Frustum* frusta, int num_frusta, const CullBoxes& boxes, int first, int count,
+                    uint32_t* visible, int mask_stride) {
+    //frusta are done in groups, so that their planes stay on the stack
+    const int GROUP = 8;
+    const int end = first + count;
+    for (int group = 0; group < num_frusta; group += GROUP) {
+        const int group_size = num_frusta - group < GROUP ? num_frusta - group : GROUP;
+#if FRUSTUM_SSE
+        FrustumSSE planes[GROUP];
+        for (int f = 0; f < group_size; f++)
+            planes[f].set(frusta[group + f]);
+        const __m128 zero = _mm_setzero_ps();
+
+        //four boxes per iteration, eight iterations per mask word
+        for (int word_start = first; word_start < end; word_start += 32) {
+            uint32_t bits[GROUP] = { 0 };
+            for (int i = word_start; i < word_start + 32; i += 4) {
+                const __m128 cx = _mm_loadu_ps(&boxes.cx[i]), cy = _mm_loadu_ps(&boxes.cy[i]), cz = _mm_loadu_ps(&boxes.cz[i]);
+                const __m128 ex = _mm_loadu_ps(&boxes.ex[i]), ey = _mm_loadu_ps(&boxes.ey[i]), ez = _mm_loadu_ps(&boxes.ez[i]);
+                for (int f = 0; f < group_size; f++) {
+                    const FrustumSSE& fr = planes[f];
+                    __m128 outside = zero;
+                    for (int p = 0; p < Frustum::NUM_PLANES; p++) {
+                        __m128 d = _mm_add_ps(_mm_mul_ps(fr.n[p][0], cx), fr.n[p][3]);
+                        d = _mm_add_ps(d, _mm_mul_ps(fr.n[p][1], cy));
+                        d = _mm_add_ps(d, _mm_mul_ps(fr.n[p][2], cz));
+                        d = _mm_add_ps(d, _mm_mul_ps(fr.a[p][0], ex));
+                        d = _mm_add_ps(d, _mm_mul_ps(fr.a[p][1], ey));
+                        d = _mm_add_ps(d, _mm_mul_ps(fr.a[p][2], ez));
+                        outside = _mm_or_ps(outside, _mm_cmplt_ps(d, zero));
+                    }
+                    bits[f] |= (uint32_t)(~_mm_movemask_ps(outside) & 0xF) << (i - word_start);
+                }
+            }
+            for (int f = 0; f < group_size; f++)
+                visible[(group + f) * mask_stride + (word_start >> 5)] = bits[f];
+        }
+#else
+        for (int word_start = first; word_start < end; word_start += 32) {
+            uint32_t bits[GROUP] = { 0 };
+            for (int i = word_start; i < word_start + 32; i++) {
+                lm::vec3 c(boxes.cx[i], boxes.cy[i], boxes.cz[i]);
+                lm::vec3 e(boxes.ex[i], boxes.ey[i], boxes.ez[i]);
+                for (int f = 0; f < group_size; f++)
+                    if (frusta[group + f].testBox(c, e)) bits[f] |= 1u << (i - word_start);
+            }
+            for (int f = 0; f < group_size; f++)
+                visible[(group + f) * mask_stride + (word_start >> 5)] = bits[f];
+        }
+#endif
+        //clear bits past end of range (padding, or boxes of the next range)
+        if (end & 31)
+            for (int f = 0; f < group_size; f++)
+                visible[(group + f) * mask_stride + (end >> 5)] &= (1u << (end & 31)) - 1;
+    }
+}
+
+void cullMaskToList(const uint32_t* visible, int n, std::vector<int>& list) {
+    for (int word = 0; word < cullMaskWords(n); word++) {
+        uint32_t bits = visible[word];
+        //bits past n are never set by cullBoxes
+        for (int bit = 0; bits; bit++, bits >>= 1)
+            if (bits & 1) list.push_back(word * 32 + bit);
+    }
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include "linmath.h"
+#include <cstdint>
+#include <vector>
+
+/**** FRUSTUM CULLING ****/
+
+//view frustum as six world space planes, extracted from a view projection
+//matrix (Gribb & Hartmann). Each plane is (a, b, c, d), normalized, with
+//a*x + b*y + c*z + d >= 0 on the inside
+struct Frustum {
+    enum { LEFT, RIGHT, BOTTOM, TOP, NEAR_PLANE, FAR_PLANE, NUM_PLANES };
+    lm::vec4 planes[NUM_PLANES];
+
+    Frustum() {}
+    explicit Frustum(const lm::mat4& view_projection) { extract(view_projection); }
+    void extract(const lm::mat4& view_projection);
+
+    //true if box (center and half size on each axis) is at least partly
+    //inside. Conservative: a box crossing two planes outside a corner of the
+    //frustum still counts as inside
+    bool testBox(const lm::vec3& center, const lm::vec3& half_width) const;
+    //true if sphere is at least partly inside (also conservative)
+    bool testSphere(const lm::vec3& center, float radius) const;
+};
+
+//transforms box (center and half size) by m, and replaces it with the axis
+//aligned box around the result
+void transformBox(const lm::mat4& m, lm::vec3& center, lm::vec3& half_width);
+
+//axis aligned boxes stored as one array per component (structure of arrays)
+//so that cullBoxes tests four at a time. Arrays are padded to a multiple of
+//32 boxes, one word of the visibility bitmask
+struct CullBoxes {
+    std::vector<float> cx, cy, cz; //centers
+    std::vector<float> ex, ey, ez; //half sizes
+
+    int size() const { return size_; }
+    void resize(int n);
+    void set(int i, const lm::vec3& center, const lm::vec3& half_width);
+    //sets box i to the world space box around local box transformed by m
+    void setTransformed(int i, const lm::vec3& center, const lm::vec3& half_width, const lm::mat4& m);
+
+private:
+    int size_ = 0;
+};
+
+//number of 32 bit words in bitmask for n boxes
+inline int cullMaskWords(int n) { return (n + 31) / 32; }
+
+//tests boxes [first, first + count) against frustum and writes one bit per
+//box (1 = visible) to visible, bit i of word i / 32. first must be a multiple
+//of 32, so that several jobs can cull separate ranges into the same mask;
+//only the words of the range are written
+void cullBoxes(const Frustum& frustum, const CullBoxes& boxes, int first, int count, uint32_t* visible);
+
+//same as cullBoxes against several frusta in one pass, so each box is
+//loaded once (e.g. shadow casters of all lights). Mask of frustum f starts
+//at visible + f * mask_stride words
+void cullBoxesMulti(const Frustum* frusta, int num_frusta, const CullBoxes& boxes, int first, int count,
+                    uint32_t* visible, int mask_stride);
+
+//appends index of each bit set in first n bits of mask to list, in order
+void cullMaskToList(const uint32_t* visible, int n, std::vector<int>& list);
+
+//true if bit i of mask from cullBoxes is set
+inline bool cullMaskTest(const uint32_t* visible, int i) { return (visible[i >> 5] >> (i & 31)) & 1u; }
@@ -0,0 +1,165 @@
+#include "GLState.h"
+
+static const GLuint UNKNOWN = (GLuint)-1;
+
+//index of texture target in bindings of a unit, -1 if not tracked
+static int targetIndex(GLenum target) {
+    if (target == GL_TEXTURE_2D) return 0;
+    if (target == GL_TEXTURE_CUBE_MAP) return 1;
+    return -1;
+}
+
+void GLState::invalidate() {
+    program_ = UNKNOWN;
+    vao_ = UNKNOWN;
+    active_unit_ = UNKNOWN;
+    for (int i = 0; i < GL_STATE_TEXTURE_UNITS; i++) {
+        textures_[i][0] = textures_[i][1] = UNKNOWN;
+        samplers_[i] = UNKNOWN;
+    }
+    read_framebuffer_ = draw_framebuffer_ = UNKNOWN;
+    for (int i = 0; i < 4; i++)
+        viewport_[i] = scissor_[i] = -1;
+    for (int i = 0; i < NUM_CAPS; i++)
+        caps_[i] = -1;
+    blend_src_ = blend_dst_ = UNKNOWN;
+    depth_mask_ = -1;
+    depth_func_ = UNKNOWN;
+    cull_face_ = UNKNOWN;
+}
+
+void GLState::newFrame() {
+    frame_stats_ = stats_;
+    stats_ = Stats();
+}
+
+void GLState::useProgram(GLuint program) {
+    if (changed_(program_ != program)) {
+        glUseProgram(program);
+        program_ = program;
+    }
+}
+
+void GLState::bindVertexArray(GLuint vao) {
+    if (changed_(vao_ != vao)) {
+        glBindVertexArray(vao);
+        vao_ = vao;
+    }
+}
+
+void GLState::activeTexture_(GLuint unit) {
+    if (changed_(active_unit_ != unit)) {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        active_unit_ = unit;
+    }
+}
+
+void GLState::bindTexture(GLenum target, GLuint texture, GLuint unit) {
+    const int t = targetIndex(target);
+    if (t < 0 || unit >= GL_STATE_TEXTURE_UNITS) {
+        activeTexture_(unit);
+        changed_(true);
+        glBindTexture(target, texture);
+        return;
+    }
+    if (changed_(textures_[unit][t] != texture)) {
+        activeTexture_(unit);
+        glBindTexture(target, texture);
+        textures_[unit][t] = texture;
+    }
+}
+
+void GLState::bindSampler(GLuint unit, GLuint sampler) {
+    if (unit >= GL_STATE_TEXTURE_UNITS) {
+        changed_(true);
+        glBindSampler(unit, sampler);
+        return;
+    }
+    if (changed_(samplers_[unit] != sampler)) {
+        glBindSampler(unit, sampler);
+        samplers_[unit] = sampler;
+    }
+}
+
+void GLState::bindFramebuffer(GLenum target, GLuint framebuffer) {
+    const bool read = target == GL_FRAMEBUFFER || target == GL_READ_FRAMEBUFFER;
+    const bool draw = target == GL_FRAMEBUFFER || target == GL_DRAW_FRAMEBUFFER;
+    if (changed_((read && read_framebuffer_ != framebuffer) || (draw && draw_framebuffer_ != framebuffer))) {
+        glBindFramebuffer(target, framebuffer);
+        if (read) read_framebuffer_ = framebuffer;
+        if (draw) draw_framebuffer_ = framebuffer;
+    }
+}
+
+void GLState::viewport(GLint x, GLint y, GLsizei width, GLsizei height) {
+    if (changed_(viewport_[0] != x || viewport_[1] != y || viewport_[2] != width || viewport_[3] != height)) {
+        glViewport(x, y, width, height);
+        viewport_[0] = x; viewport_[1] = y; viewport_[2] = width; viewport_[3] = height;
+    }
+}
+
+void GLState::scissor(GLint x, GLint y, GLsizei width, GLsizei height) {
+    if (changed_(scissor_[0] != x || scissor_[1] != y || scissor_[2] != width || scissor_[3] != height)) {
+        glScissor(x, y, width, height);
+        scissor_[0] = x; scissor_[1] = y; scissor_[2] = width; scissor_[3] = height;
+    }
+}
+
+void GLState::setEnabled_(GLenum cap, bool enabled) {
+    int c;
+    switch (cap) {
+        case GL_BLEND: c = CAP_BLEND; break;
+        case GL_DEPTH_TEST: c = CAP_DEPTH_TEST; break;
+        case GL_CULL_FACE: c = CAP_CULL_FACE; break;
+        case GL_SCISSOR_TEST: c = CAP_SCISSOR_TEST; break;
+        default: c = -1;
+    }
+    if (changed_(c < 0 || caps_[c] != (int)enabled)) {
+        if (enabled) glEnable(cap);
+        else glDisable(cap);
+        if (c >= 0) caps_[c] = enabled;
+    }
+}
+
+void GLState::blendFunc(GLenum src, GLenum dst) {
+    if (changed_(blend_src_ != src || blend_dst_ != dst)) {
+        glBlendFunc(src, dst);
+        blend_src_ = src;
+        blend_dst_ = dst;
+    }
+}
+
+void GLState::depthMask(GLboolean mask) {
+    if (changed_(depth_mask_ != (mask ? 1 : 0))) {
+        glDepthMask(mask);
+        depth_mask_ = mask ? 1 : 0;
+    }
+}
+
+void GLState::depthFunc(GLenum func) {
+    if (changed_(depth_func_ != func)) {
+        glDepthFunc(func);
+        depth_func_ = func;
+    }
+}
+
+void GLState::cullFace(GLenum mode) {
+    if (changed_(cull_face_ != mode)) {
+        glCullFace(mode);
+        cull_face_ = mode;
+    }
+}
+
+void GLState::deleteTextures(GLsizei n, const GLuint* textures) {
+    glDeleteTextures(n, textures);
+    for (GLsizei i = 0; i < n; i++)
+        for (auto& unit : textures_)
+            for (auto& bound : unit)
+                if (bound == textures[i]) bound = 0;
+}
+
+void GLState::deleteFramebuffer(GLuint framebuffer) {
+    glDeleteFramebuffers(1, &framebuffer);
+    if (read_framebuffer_ == framebuffer) read_framebuffer_ = 0;
+    if (draw_framebuffer_ == framebuffer) draw_framebuffer_ = 0;
+}
@@ -0,0 +1,79 @@
+#pragma once
+#include "includes.h"
+
+/**** GL STATE CACHE ****/
+
+//texture units whose bindings are tracked; binds to higher units go
+//straight to GL
+#define GL_STATE_TEXTURE_UNITS 32
+
+//copy of the GL state which the engine changes, so that setting a value
+//which is already set costs no GL call. All code must change this state
+//through GL_STATE (see extern.h), or the copy goes stale. Code which can't
+//must restore what it changes (as the ImGui backend does), or call
+//invalidate() after.
+//
+//Capabilities other than blend, depth test, cull face and scissor test, and
+//texture targets other than 2D and cube map, are passed straight to GL
+class GLState {
+public:
+    GLState() { invalidate(); }
+    //forgets everything, so that the next call of each setter goes to GL
+    void invalidate();
+
+    void useProgram(GLuint program);
+    GLuint program() const { return program_; }
+    void bindVertexArray(GLuint vao);
+    //binds texture to target of unit (for creating a texture, any unit will do)
+    void bindTexture(GLenum target, GLuint texture, GLuint unit = 0);
+    void bindSampler(GLuint unit, GLuint sampler);
+    //GL_FRAMEBUFFER binds both read and draw framebuffers
+    void bindFramebuffer(GLenum target, GLuint framebuffer);
+    void viewport(GLint x, GLint y, GLsizei width, GLsizei height);
+    void scissor(GLint x, GLint y, GLsizei width, GLsizei height);
+
+    void enable(GLenum cap) { setEnabled_(cap, true); }
+    void disable(GLenum cap) { setEnabled_(cap, false); }
+    void blendFunc(GLenum src, GLenum dst);
+    void depthMask(GLboolean mask);
+    void depthFunc(GLenum func);
+    void cullFace(GLenum mode);
+
+    //GL unbinds deleted objects, so they must be deleted through the cache
+    void deleteTextures(GLsizei n, const GLuint* textures);
+    void deleteFramebuffer(GLuint framebuffer);
+
+    //counts of state calls: made (passed to GL) and elided (already set)
+    struct Stats {
+        int calls = 0;
+        int elided = 0;
+    };
+    //counts of the last whole frame
+    const Stats& frameStats() const { return frame_stats_; }
+    //call once at the start of each frame
+    void newFrame();
+
+private:
+    enum { CAP_BLEND, CAP_DEPTH_TEST, CAP_CULL_FACE, CAP_SCISSOR_TEST, NUM_CAPS };
+    //-1 is unknown, see invalidate
+    GLuint program_;
+    GLuint vao_;
+    GLuint active_unit_;
+    GLuint textures_[GL_STATE_TEXTURE_UNITS][2]; //2D, cube map
+    GLuint samplers_[GL_STATE_TEXTURE_UNITS];
+    GLuint read_framebuffer_;
+    GLuint draw_framebuffer_;
+    GLint viewport_[4];
+    GLint scissor_[4];
+    int caps_[NUM_CAPS];
+    GLenum blend_src_, blend_dst_;
+    int depth_mask_;
+    GLenum depth_func_;
+    GLenum cull_face_;
+    Stats stats_, frame_stats_;
+
+    //counts call, true if it must go to GL
+    bool changed_(bool changed) { changed ? stats_.calls++ : stats_.elided++; return changed; }
+    void setEnabled_(GLenum cap, bool enabled);
+    void activeTexture_(GLuint unit);
+};
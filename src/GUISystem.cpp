@@ -26,7 +26,7 @@ void GUISystem::lateInit() {
 	for (auto& el : elements) {
 
 		//check to see if we have specified gui width and height, if not, set them according to texture
-		glBindTexture(GL_TEXTURE_2D, el.texture);
+		GL_STATE.bindTexture(GL_TEXTURE_2D, el.texture);
 		if (el.width == 0)
 			glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &(el.width));
 		if (el.height == 0)
@@ -63,15 +63,15 @@ void GUISystem::lateInit() {
 void GUISystem::update(float dt) {
 
 	//we draw GUI last, want it to be on top of everything
-	glDisable(GL_DEPTH_TEST);
-	glEnable(GL_BLEND);
-	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	GL_STATE.disable(GL_DEPTH_TEST);
+	GL_STATE.enable(GL_BLEND);
+	GL_STATE.blendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
 	//draw GUI images first
-	glUseProgram(icon_shader_->program);
+	GL_STATE.useProgram(icon_shader_->program);
 
 	//for all images
-	auto& elements = ECS.getAllComponents<GUIElement>();
+	auto elements = ECS.getEnabledComponents<GUIElement>();
 	for (auto& el : elements) {
 
 		//scale -1->+1 quad to size of image
@@ -91,19 +91,18 @@ void GUISystem::update(float dt) {
 		GLint u_icon = glGetUniformLocation(icon_shader_->program, "u_icon");
 		glUniform1i(u_icon, 10);
 
-		glActiveTexture(GL_TEXTURE0 + 10);
-		glBindTexture(GL_TEXTURE_2D, el.texture);
+		GL_STATE.bindTexture(GL_TEXTURE_2D, el.texture, 10);
 
 		//draw
-		glBindVertexArray(vao_);
+		GL_STATE.bindVertexArray(vao_);
 		glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
 	}
 
 	//use a different shader for text
-	glUseProgram(text_shader_->program);
+	GL_STATE.useProgram(text_shader_->program);
 
 	//for all texts
-	auto& text_elements = ECS.getAllComponents<GUIText>();
+	auto text_elements = ECS.getEnabledComponents<GUIText>();
 	for (auto& el : text_elements) {
 
 		//scale -1->+1 quad to size of image
@@ -126,16 +125,15 @@ void GUISystem::update(float dt) {
 		GLint u_icon = glGetUniformLocation(text_shader_->program, "u_icon");
 		glUniform1i(u_icon, 10);
 
-		glActiveTexture(GL_TEXTURE0 + 10);
-		glBindTexture(GL_TEXTURE_2D, el.texture);
+		GL_STATE.bindTexture(GL_TEXTURE_2D, el.texture, 10);
 
 		//draw
-		glBindVertexArray(vao_);
+		GL_STATE.bindVertexArray(vao_);
 		glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
 	}
 
-	glEnable(GL_DEPTH_TEST);
-	glDisable(GL_BLEND);
+	GL_STATE.enable(GL_DEPTH_TEST);
+	GL_STATE.disable(GL_BLEND);
 
 }
 
@@ -192,7 +190,7 @@ GLuint GUISystem::createTextTexture(std::string text, std::string font_path, int
 	GLuint texture_id;
 	//create texture according to size
 	glGenTextures(1, &texture_id);
-	glBindTexture(GL_TEXTURE_2D, texture_id);
+	GL_STATE.bindTexture(GL_TEXTURE_2D, texture_id);
 
 	// disable default 4-byte alignment as freetype creates textures as single byte greyscale
 	// so set byte-alignment to 1
@@ -250,7 +248,7 @@ GLuint GUISystem::createTextTexture(std::string text, std::string font_path, int
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 	//unbind texture
-	glBindTexture(GL_TEXTURE_2D, 0);
+	GL_STATE.bindTexture(GL_TEXTURE_2D, 0);
 
 	//reset alignment
 	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
@@ -266,7 +264,7 @@ GLuint GUISystem::createTextTexture(std::string text, std::string font_path, int
 void GUISystem::key_mouse_callback(int key, int action, int mods) {
 	if (key == GLFW_MOUSE_BUTTON_1 && action == GLFW_PRESS) {
 
-		auto& elements = ECS.getAllComponents<GUIElement>();
+		auto elements = ECS.getEnabledComponents<GUIElement>();
 		for (auto& el : elements) {
 			if (el.screen_bounds.pointInBounds(mouse_x_, mouse_y_)) {
 				el.onClick();
@@ -294,7 +292,7 @@ void GUISystem::createGeometry_() {
 
 	//generate the OpenGL buffers and create geometry
 	glGenVertexArrays(1, &vao_);
-	glBindVertexArray(vao_);
+	GL_STATE.bindVertexArray(vao_);
 	GLuint vbo;
 	//positions
 	glGenBuffers(1, &vbo);
@@ -315,5 +313,5 @@ void GUISystem::createGeometry_() {
 	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &(indices[0]), GL_STATIC_DRAW);
 	//unbind
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
-	glBindVertexArray(0);
+	GL_STATE.bindVertexArray(0);
 }
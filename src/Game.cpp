@@ -18,6 +18,10 @@ Game::Game() {
 void Game::init(int w, int h) {
 
 	window_width_ = w; window_height_ = h;
+
+	//worker threads, before systems which may load assets with them
+	JOBS.init();
+
 	//******* INIT SYSTEMS *******
 
 	//init systems except debug, which needs info about scene
@@ -98,37 +102,73 @@ void Game::init(int w, int h) {
 
 	debug_system_.setActive(true);
 
-}
+	registerSystems_();
 
-//update each system in turn
-void Game::update(float dt) {
+}
 
-	if (ECS.getAllComponents<Camera>().size() == 0) {print("There is no camera set!"); return;}
+//tell scheduler which components each system reads and writes. Systems
+//which don't conflict run at the same time; those using GL or imGUI run on
+//main thread, in the order they are added
+void Game::registerSystems_() {
+	scheduler_.init(&JOBS);
 
 	//update input
-	control_system_.update(dt);
+	scheduler_.addSystem("control", componentMask<Collider>(), componentMask<Transform, Camera>(), false,
+		[this](float dt) { control_system_.update(dt); });
 
-	//collision
-	collision_system_.update(dt);
+	//animation: transforms, and joints and blend shapes at same time
+	scheduler_.addSystem("animation", 0, componentMask<Transform, Animation>(), false,
+		[this](float dt) { animation_system_.updateTransforms(); });
+	scheduler_.addSystem("skinning", componentMask<Mesh>(), componentMask<SkinnedMesh, BlendShapes>(), false,
+		[this](float dt) { animation_system_.updateSkinning(); });
 
-    //animation
-    animation_system_.update(dt);
-    
-	//scripts
-	script_system_.update(dt);
+	//scripts may touch anything
+	scheduler_.addSystem("scripts", 0, ALL_COMPONENTS, true,
+		[this](float dt) { script_system_.update(dt); });
+
+	//sync point: apply entities and components created or destroyed by
+	//systems, before rendering
+	scheduler_.addSystem("ecs commands", 0, ALL_COMPONENTS, false,
+		[](float dt) { ECS_COMMANDS.playback(ECS); });
+
+	//world matrices, once all transforms of the frame have moved. Systems
+	//below read them from Transform::world
+	scheduler_.addSystem("transforms", 0, componentMask<Transform>(), false,
+		[this](float dt) { transform_system_.update(dt); });
+
+	//collision (results are used by control next frame)
+	scheduler_.addSystem("collision", componentMask<Transform>(), componentMask<Collider>(), false,
+		[this](float dt) { collision_system_.update(dt); });
 
 	//render
-	graphics_system_.update(dt);
-    
-    //particles
-    //particle_emitter_->update();
-    
+	scheduler_.addSystem("graphics", ALL_COMPONENTS, componentMask<Camera>(), true,
+		[this](float dt) { graphics_system_.update(dt); });
+
+	//particles
+	//particle_emitter_->update();
+
 	//gui
-	gui_system_.update(dt);
+	scheduler_.addSystem("gui", componentMask<GUIElement, GUIText>(), 0, true,
+		[this](float dt) { gui_system_.update(dt); });
 
 	//debug
-	debug_system_.update(dt);
-   
+	scheduler_.addSystem("debug", 0, ALL_COMPONENTS, true,
+		[this](float dt) { debug_system_.update(dt); });
+
+	debug_system_.setScheduler(&scheduler_);
+}
+
+//update all systems, see registerSystems_
+void Game::update(float dt) {
+
+	if (ECS.getAllComponents<Camera>().size() == 0) {print("There is no camera set!"); return;}
+
+	//animation frame counter, shared by animation and skinning
+	animation_system_.updateClock(dt);
+	//counts of GL state calls are per frame
+	GL_STATE.newFrame();
+
+	scheduler_.update(dt);
 }
 //update game viewports
 void Game::update_viewports(int window_width, int window_height) {
@@ -159,7 +199,8 @@ int Game::createFreeCamera_(float px, float py, float pz, float fx, float fy, fl
 	player_cam.forward = lm::vec3(fx, fy, fz);
 	player_cam.setPerspective(60.0f*DEG2RAD, (float)window_width_/(float)window_height_, 0.1f, 1000.0f);
 
-	ECS.main_camera = ECS.getComponentID<Camera>(ent_player);
+	ECS.main_camera = ECS.getComponentHandle<Camera>(ent_player);
+	control_system_.debug_camera = ECS.main_camera;
 
 	control_system_.control_type = ControlTypeFree;
 
@@ -178,53 +219,49 @@ int Game::createPlayer_(float aspect, ControlSystem& sys) {
 	//FPS colliders 
 	//each collider ray entity is parented to the playerFPS entity
 	int ent_down_ray = ECS.createEntity("Down Ray");
-	Transform& down_ray_trans = ECS.getComponentFromEntity<Transform>(ent_down_ray);
-	down_ray_trans.parent = ECS.getComponentID<Transform>(ent_player); //set parent as player entity *transform*!
+	ECS.setParent(ent_down_ray, ECS.getEntityHandle(ent_player)); //set parent as player entity
 	Collider& down_ray_collider = ECS.createComponentForEntity<Collider>(ent_down_ray);
 	down_ray_collider.collider_type = ColliderTypeRay;
 	down_ray_collider.direction = lm::vec3(0.0, -1.0, 0.0);
 	down_ray_collider.max_distance = 100.0f;
 
 	int ent_left_ray = ECS.createEntity("Left Ray");
-	Transform& left_ray_trans = ECS.getComponentFromEntity<Transform>(ent_left_ray);
-	left_ray_trans.parent = ECS.getComponentID<Transform>(ent_player); //set parent as player entity *transform*!
+	ECS.setParent(ent_left_ray, ECS.getEntityHandle(ent_player)); //set parent as player entity
 	Collider& left_ray_collider = ECS.createComponentForEntity<Collider>(ent_left_ray);
 	left_ray_collider.collider_type = ColliderTypeRay;
 	left_ray_collider.direction = lm::vec3(-1.0, 0.0, 0.0);
 	left_ray_collider.max_distance = 1.0f;
 
 	int ent_right_ray = ECS.createEntity("Right Ray");
-	Transform& right_ray_trans = ECS.getComponentFromEntity<Transform>(ent_right_ray);
-	right_ray_trans.parent = ECS.getComponentID<Transform>(ent_player); //set parent as player entity *transform*!
+	ECS.setParent(ent_right_ray, ECS.getEntityHandle(ent_player)); //set parent as player entity
 	Collider& right_ray_collider = ECS.createComponentForEntity<Collider>(ent_right_ray);
 	right_ray_collider.collider_type = ColliderTypeRay;
 	right_ray_collider.direction = lm::vec3(1.0, 0.0, 0.0);
 	right_ray_collider.max_distance = 1.0f;
 
 	int ent_forward_ray = ECS.createEntity("Forward Ray");
-	Transform& forward_ray_trans = ECS.getComponentFromEntity<Transform>(ent_forward_ray);
-	forward_ray_trans.parent = ECS.getComponentID<Transform>(ent_player); //set parent as player entity *transform*!
+	ECS.setParent(ent_forward_ray, ECS.getEntityHandle(ent_player)); //set parent as player entity
 	Collider& forward_ray_collider = ECS.createComponentForEntity<Collider>(ent_forward_ray);
 	forward_ray_collider.collider_type = ColliderTypeRay;
 	forward_ray_collider.direction = lm::vec3(0.0, 0.0, -1.0);
 	forward_ray_collider.max_distance = 1.0f;
 
 	int ent_back_ray = ECS.createEntity("Back Ray");
-	Transform& back_ray_trans = ECS.getComponentFromEntity<Transform>(ent_back_ray);
-	back_ray_trans.parent = ECS.getComponentID<Transform>(ent_player); //set parent as player entity *transform*!
+	ECS.setParent(ent_back_ray, ECS.getEntityHandle(ent_player)); //set parent as player entity
 	Collider& back_ray_collider = ECS.createComponentForEntity<Collider>(ent_back_ray);
 	back_ray_collider.collider_type = ColliderTypeRay;
 	back_ray_collider.direction = lm::vec3(0.0, 0.0, 1.0);
 	back_ray_collider.max_distance = 1.0f;
 
 	//the control system stores the FPS colliders 
-	sys.FPS_collider_down = ECS.getComponentID<Collider>(ent_down_ray);
-	sys.FPS_collider_left = ECS.getComponentID<Collider>(ent_left_ray);
-	sys.FPS_collider_right = ECS.getComponentID<Collider>(ent_right_ray);
-	sys.FPS_collider_forward = ECS.getComponentID<Collider>(ent_forward_ray);
-	sys.FPS_collider_back = ECS.getComponentID<Collider>(ent_back_ray);
-
-	ECS.main_camera = ECS.getComponentID<Camera>(ent_player);
+	sys.FPS_collider_down = ECS.getComponentHandle<Collider>(ent_down_ray);
+	sys.FPS_collider_left = ECS.getComponentHandle<Collider>(ent_left_ray);
+	sys.FPS_collider_right = ECS.getComponentHandle<Collider>(ent_right_ray);
+	sys.FPS_collider_forward = ECS.getComponentHandle<Collider>(ent_forward_ray);
+	sys.FPS_collider_back = ECS.getComponentHandle<Collider>(ent_back_ray);
+
+	ECS.main_camera = ECS.getComponentHandle<Camera>(ent_player);
+	sys.FPS_camera = ECS.main_camera;
 
 	sys.control_type = ControlTypeFPS;
 
@@ -13,6 +13,8 @@
 #include "ScriptSystem.h"
 #include "GUISystem.h"
 #include "AnimationSystem.h"
+#include "TransformSystem.h"
+#include "SystemScheduler.h"
 //#include "ParticleSystem.h"
 #include "ParticleEmitter.h"
 
@@ -86,8 +88,13 @@ private:
 	ScriptSystem script_system_;
 	GUISystem gui_system_;
 	AnimationSystem animation_system_;
+	TransformSystem transform_system_;
 	//ParticleSystem particle_system_;
 
+	//runs systems above every frame, in parallel where they allow it
+	SystemScheduler scheduler_;
+	void registerSystems_();
+
 	//particles
 	ParticleEmitter* particle_emitter_;
 
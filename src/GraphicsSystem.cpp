@@ -5,6 +5,22 @@
 #include "Parsers.h"
 #include "extern.h"
 #include <algorithm>
+#include <cstring>
+#include <cmath>
+
+//size of a light in light ubo (std140 layout), and offset of its cascades
+static const GLsizeiptr LIGHT_UBO_SIZE = 496;
+static const GLsizeiptr LIGHT_UBO_CASCADES = 160;
+//size of per object block: mvp, model and normal matrices (std140 layout,
+//so mat3 columns take a vec4 each)
+static const GLsizeiptr OBJECT_UBO_SIZE = 64 + 64 + 48;
+
+//number of cascades a light is drawn with, 0 if it has one shadow map
+static int lightCascades(const Light& light) {
+	if (light.type != LightTypeDirectional || light.num_cascades <= 0)
+		return 0;
+	return std::min(light.num_cascades, MAX_CASCADES);
+}
 
 //destructor
 GraphicsSystem::~GraphicsSystem() {
@@ -22,22 +38,24 @@ void GraphicsSystem::init(int window_width, int window_height, std::string asset
     updateMainViewport(window_width, window_height);
     
     //enable culling and depth test
-    glEnable(GL_DEPTH_TEST);
-    glDepthFunc(GL_LEQUAL); //for cubemap optimization
-    glEnable(GL_CULL_FACE);
-    glCullFace(GL_BACK);
+    GL_STATE.enable(GL_DEPTH_TEST);
+    GL_STATE.depthFunc(GL_LEQUAL); //for cubemap optimization
+    GL_STATE.enable(GL_CULL_FACE);
+    GL_STATE.cullFace(GL_BACK);
     
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    GL_STATE.enable(GL_BLEND);
+    GL_STATE.blendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
     
     //enable seamless cubemap sampling
-    glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+    GL_STATE.enable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
     
 	//set assets folder
     assets_folder_ = assets_folder;
 
-	//generate light ubo
-	glGenBuffers(1, &light_ubo_);
+	//buffer for uniforms written each frame (lights, per object matrices)
+	uniform_ring_.init();
+	//and buffer of per instance matrices, see renderInstances_
+	glGenBuffers(1, &instance_buffer_);
 
 
 	//screen space geometry
@@ -46,9 +64,10 @@ void GraphicsSystem::init(int window_width, int window_height, std::string asset
 	geometries_.push_back(ss_geom);
 	screen_space_geom_ = (int)(geometries_.size() - 1);
     
-    sphere_volume_geom_ = createGeometryFromFile("data/assets/sphere.obj");
-    
-    cone_volume_geom_ = createGeometryFromFile("data/assets/cone.obj");
+    //light volumes, parsed at the same time
+    std::vector<int> volume_geoms = createGeometriesFromFiles({ "data/assets/sphere.obj", "data/assets/cone.obj" });
+    sphere_volume_geom_ = volume_geoms[0];
+    cone_volume_geom_ = volume_geoms[1];
 
     //screen space texture shader
     screen_space_shader_ = new Shader("data/shaders/screen.vert", "data/shaders/screen.frag");
@@ -70,45 +89,36 @@ void GraphicsSystem::init(int window_width, int window_height, std::string asset
 
 //called after loading everything
 void GraphicsSystem::lateInit() {
-	// sort meshes initially
-    sortMeshes_();
-
-	//create shadow buffers depending on number of lights
-	for (size_t i = 0; i < ECS.getAllComponents<Light>().size(); i++) {
-		shadow_frame_[i].initDepth(2048, 2048);
-	}
+	//put transforms in hierarchy order once after loading, see
+	//EntityComponentStore::sortTransformHierarchy
+	ECS.sortTransformHierarchy();
 
+	//shadow maps of all lights go in one atlas, see layoutShadowAtlas_
+	shadow_atlas_.initDepth(shadow_atlas_size, shadow_atlas_size);
 }
 
 void GraphicsSystem::update(float dt) {
-    
+	//nothing to render from if every camera was deleted
+	if (!ECS.isValid<Camera>(ECS.main_camera)) return;
+
 	updateAllCameras_();
 
-	if (needUpdateLights)
+	//upload lights only if they changed
+	if (lightsChanged_())
 		updateLights_();
+
+	cullMeshes_();
+	fillRenderQueue_();
+	cullShadowCasters_();
+	uploadFrameUniforms_();
     
-	/* SHADOW PASS FOR ALL LIGHTS */
-	glCullFace(GL_FRONT);
-	useShader(depth_shader_);
-	const auto& lights = ECS.getAllComponents<Light>();
-	for (size_t i = 0; i < lights.size(); i++) {
-		shadow_frame_[i].bindAndClear();
-		auto& mesh_components = ECS.getAllComponents<Mesh>();
-		for (auto &curr_comp : mesh_components) {
-			renderDepth_(curr_comp, lights[i]);
-		}
-	}
-	glCullFace(GL_BACK);
+	/* SHADOW PASS FOR LIGHTS WHICH CAST SHADOWS */
+	updateShadowMaps_();
 
     /* GBUFFER PASS */
     gbuffer_.bindAndClear(screen_background_color);
     useShader(gbuffer_shader_);
-    for (auto &mesh : ECS.getAllComponents<Mesh>()) {
-        if (mesh.render_mode != RenderModeDeferred)
-            continue;
-        checkMaterial_(mesh);
-        renderMeshComponent_(mesh);
-    }
+    renderQueuePass_(RenderQueue::PASS_GBUFFER);
     
 	/* SCREEN BUFFER */
 	bindAndClearScreen_();
@@ -119,19 +129,14 @@ void GraphicsSystem::update(float dt) {
     renderLightVolumes();
     
     /* FORWARD RENDERING */
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-    glEnable(GL_BLEND);
-    for (auto &mesh : ECS.getAllComponents<Mesh>()) {
-        if (mesh.render_mode != RenderModeForward)
-            continue;
-        checkShaderAndMaterial_(mesh);
-        renderMeshComponent_(mesh);
-    }
+    GL_STATE.blendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    GL_STATE.enable(GL_BLEND);
+    renderQueuePass_(RenderQueue::PASS_OPAQUE);
+    renderQueuePass_(RenderQueue::PASS_TRANSPARENT);
     
-    auto& skinnedmesh_components = ECS.getAllComponents<SkinnedMesh>();
-    for (auto &skinnedmesh : skinnedmesh_components) {
+    for (auto [skinnedmesh, transform] : ECS.view<SkinnedMesh, Transform>()) {
         checkShaderAndMaterial_(skinnedmesh);
-        renderSkinnedMeshComponent_(skinnedmesh);
+        renderSkinnedMeshComponent_(skinnedmesh, transform);
     }
     
     /* ENVIRONMENT */
@@ -139,17 +144,18 @@ void GraphicsSystem::update(float dt) {
     
 	/* VIEW FRAMES */
     //previewTextureViewport(gbuffer_.color_textures[2]);
-    
+
+	uniform_ring_.end();
 }
 
 void GraphicsSystem::previewTextureViewport(GLuint texture_id) {
-    glDisable(GL_DEPTH_TEST);
+    GL_STATE.disable(GL_DEPTH_TEST);
     useShader(screen_space_shader_);
-    glViewport(0, 0, GLsizei(viewport_width_/4), GLsizei(viewport_height_/4));
+    GL_STATE.viewport(0, 0, GLsizei(viewport_width_/4), GLsizei(viewport_height_/4));
     screen_space_shader_->setTexture(U_SCREEN_TEXTURE, texture_id, 0);
     geometries_[screen_space_geom_].render();
-    glEnable(GL_DEPTH_TEST);
-    glViewport(0, 0, GLsizei(viewport_width_), GLsizei(viewport_height_));
+    GL_STATE.enable(GL_DEPTH_TEST);
+    GL_STATE.viewport(0, 0, GLsizei(viewport_width_), GLsizei(viewport_height_));
 }
 
 void GraphicsSystem::renderLightVolumes() {
@@ -157,25 +163,20 @@ void GraphicsSystem::renderLightVolumes() {
     //activate shader
     useShader(deferred_volume_shader_);
     
-    //set uniforms common for all light passes
-    auto lights = ECS.getAllComponents<Light>();
-    for (size_t i = 0; i < lights.size(); i++) {
-        //this static cast assumes shadowmap enums are consecutive
-        UniformID new_enum = static_cast<UniformID>((int)U_SHADOW_MAP0 + (int)i);
-        shader_->setTexture(new_enum, shadow_frame_[i].color_textures[0], (int)i);
-    }
+    //set uniforms common for all light passes (shadow atlas is already bound)
+    auto lights = ECS.getEnabledComponents<Light>();
     shader_->setUniformBlock(U_LIGHTS_UBO, LIGHTS_BINDING_POINT);
     shader_->setTexture(U_TEX_POSITION, gbuffer_.color_textures[0], 8);
     shader_->setTexture(U_TEX_NORMAL, gbuffer_.color_textures[1], 9);
     shader_->setTexture(U_TEX_ALBEDO, gbuffer_.color_textures[2], 10);
-    shader_->setUniform(U_CAM_POS, ECS.getComponentInArray<Camera>(ECS.main_camera).position);
+    shader_->setUniform(U_CAM_POS, ECS.getComponent<Camera>(ECS.main_camera).position);
     
-    glBlendFunc(GL_ONE, GL_ONE);
-    glEnable(GL_BLEND);
-    glDepthMask(GL_FALSE);
+    GL_STATE.blendFunc(GL_ONE, GL_ONE);
+    GL_STATE.enable(GL_BLEND);
+    GL_STATE.depthMask(GL_FALSE);
 
     //render directional 
-    for (size_t i = 0; i < lights.size(); i++) {
+    for (size_t i = 0; i < num_lights_uploaded_; i++) {
         if (lights[i].type == 0) {
             //set light id
             shader_->setUniform(U_LIGHT_ID,(int)i);
@@ -187,7 +188,7 @@ void GraphicsSystem::renderLightVolumes() {
         }
     }
     
-    for (size_t i = 0; i < lights.size(); i++) {
+    for (size_t i = 0; i < num_lights_uploaded_; i++) {
         if (lights[i].type == 2) {
             //set light id
             shader_->setUniform(U_LIGHT_ID,(int)i);
@@ -212,18 +213,18 @@ void GraphicsSystem::renderLightVolumes() {
             model = rotate_matrix * model;
             model.translate(light_pos);
             
-            lm::mat4 view_projection = ECS.getComponentInArray<Camera>(ECS.main_camera).view_projection;
+            lm::mat4 view_projection = ECS.getComponent<Camera>(ECS.main_camera).view_projection;
             lm::mat4 mvp = view_projection * model;
             shader_->setUniform(U_MVP, mvp);
             //draw
-            glCullFace(GL_FRONT);
+            GL_STATE.cullFace(GL_FRONT);
             geometries_[cone_volume_geom_].render();
-            glCullFace(GL_BACK);
+            GL_STATE.cullFace(GL_BACK);
         }
     }
     
     //now render point lights
-    for (size_t i = 0; i < lights.size(); i++) {
+    for (size_t i = 0; i < num_lights_uploaded_; i++) {
         if (lights[i].type != 1)
             continue;
         //set light id
@@ -234,21 +235,21 @@ void GraphicsSystem::renderLightVolumes() {
         lm::mat4 model;
         model.scale(lights[i].radius, lights[i].radius, lights[i].radius);
         model.translate(light_pos);
-        lm::mat4 view_projection = ECS.getComponentInArray<Camera>(ECS.main_camera).view_projection;
+        lm::mat4 view_projection = ECS.getComponent<Camera>(ECS.main_camera).view_projection;
         lm::mat4 mvp = view_projection * model;
         shader_->setUniform(U_MVP, mvp);
         
         //draw
-        glCullFace(GL_FRONT);
+        GL_STATE.cullFace(GL_FRONT);
         geometries_[sphere_volume_geom_].render();
-        glCullFace(GL_BACK);
+        GL_STATE.cullFace(GL_BACK);
     }
-    glDisable(GL_BLEND);
-    glDepthMask(GL_TRUE);
+    GL_STATE.disable(GL_BLEND);
+    GL_STATE.depthMask(GL_TRUE);
     
     //blit depth
-    glBindFramebuffer(GL_READ_FRAMEBUFFER, gbuffer_.framebuffer);
-    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0); // write to default framebuffer
+    GL_STATE.bindFramebuffer(GL_READ_FRAMEBUFFER, gbuffer_.framebuffer);
+    GL_STATE.bindFramebuffer(GL_DRAW_FRAMEBUFFER, 0); // write to default framebuffer
     glBlitFramebuffer(0, 0, viewport_width_, viewport_height_, 0, 0, viewport_width_, viewport_height_, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
 }
 
@@ -257,40 +258,365 @@ void GraphicsSystem::renderGbuffer() {
     //activate shader
     useShader(deferred_shader_);
     
-    auto lights = ECS.getAllComponents<Light>();
-    for (size_t i = 0; i < lights.size(); i++) {
-        //this static cast assumes shadowmap enums are consecutive
-        UniformID new_enum = static_cast<UniformID>((int)U_SHADOW_MAP0 + (int)i);
-        shader_->setTexture(new_enum, shadow_frame_[i].color_textures[0], (int)i);
-    }
-    
-    //set light uniforms
+    //set light uniforms (shadow atlas is already bound)
     shader_->setUniformBlock(U_LIGHTS_UBO, LIGHTS_BINDING_POINT);
-    shader_->setUniform(U_NUM_LIGHTS,
-                                 (int)ECS.getAllComponents<Light>().size());
+    shader_->setUniform(U_NUM_LIGHTS, (int)num_lights_uploaded_);
     
     //gbuffer textures
     shader_->setTexture(U_TEX_POSITION, gbuffer_.color_textures[0], 8);
     shader_->setTexture(U_TEX_NORMAL, gbuffer_.color_textures[1], 9);
     shader_->setTexture(U_TEX_ALBEDO, gbuffer_.color_textures[2], 10);
-    shader_->setUniform(U_CAM_POS, ECS.getComponentInArray<Camera>(ECS.main_camera).position);
+    shader_->setUniform(U_CAM_POS, ECS.getComponent<Camera>(ECS.main_camera).position);
     
     //draw
     geometries_[screen_space_geom_].render();
     
     //blit depth
-    glBindFramebuffer(GL_READ_FRAMEBUFFER, gbuffer_.framebuffer);
-    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0); // write to default framebuffer
+    GL_STATE.bindFramebuffer(GL_READ_FRAMEBUFFER, gbuffer_.framebuffer);
+    GL_STATE.bindFramebuffer(GL_DRAW_FRAMEBUFFER, 0); // write to default framebuffer
     glBlitFramebuffer(0, 0, viewport_width_, viewport_height_, 0, 0, viewport_width_, viewport_height_, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
 }
 
-//renders a mesh from a Light/Camera, only setting its MVP
+//view frustum culling of all mesh components against main camera. In
+//parallel ranges of meshes, the world space box of each mesh is computed
+//from its geometry's box, then the whole range is tested by cullBoxes.
+//Result is the bitmask mesh_visible_, by index in mesh array
+void GraphicsSystem::cullMeshes_() {
+	const Frustum frustum(ECS.getComponent<Camera>(ECS.main_camera).view_projection);
+	auto meshes = ECS.getEnabledComponents<Mesh>();
+	const int num_meshes = (int)meshes.size();
+	mesh_boxes_.resize((int)ECS.getAllComponents<Mesh>().size());
+	mesh_visible_.assign(cullMaskWords(mesh_boxes_.size()), 0);
+	//multiple of 32, so ranges write separate words of mask
+	const int range = 1024;
+	JOBS.parallel_for(0, (num_meshes + range - 1) / range, 1, [&](int r) {
+		const int first = r * range;
+		const int count = std::min(range, num_meshes - first);
+		for (int i = first; i < first + count; i++) {
+			Mesh& mesh = meshes[i];
+			const AABB& aabb = geometries_[mesh.geometry].aabb;
+			if (ECS.hasComponent<Transform>(mesh.owner))
+				mesh_boxes_.setTransformed(i, aabb.center, aabb.half_width, ECS.getGlobalMatrix(ECS.getComponentFromEntity<Transform>(mesh.owner)));
+			else
+				mesh_boxes_.set(i, aabb.center, aabb.half_width); //never drawn
+		}
+		cullBoxes(frustum, mesh_boxes_, first, count, mesh_visible_.data());
+	});
+}
+
+//finds shadow maps which need drawing this frame: those of lights which
+//cast shadows and, unless directional, whose volume is in view of main
+//camera, with cascades of directional lights fitted to the camera. Then
+//culls the mesh boxes of cullMeshes_ against the frusta of all of them in
+//one pass, giving a list of shadow casters per map
+void GraphicsSystem::cullShadowCasters_() {
+	const Frustum camera_frustum(ECS.getComponent<Camera>(ECS.main_camera).view_projection);
+	auto lights = ECS.getEnabledComponents<Light>();
+	shadow_views_.clear();
+	for (int i = 0; i < (int)lights.size() && i < MAX_LIGHTS; i++) {
+		Light& light = lights[i];
+		if (!light.cast_shadow || !hasShadowMap_(i))
+			continue;
+		if (lightCascades(light) > 0) {
+			fitCascades_(i);
+			continue;
+		}
+		if (light.type != LightTypeDirectional) {
+			const lm::vec3 position = ECS.getGlobalMatrix(ECS.getComponentFromEntity<Transform>(light.owner)).position();
+			if (!camera_frustum.testSphere(position, light.radius))
+				continue;
+		}
+		ShadowView view;
+		view.light = i;
+		view.map = i * MAX_CASCADES;
+		view.view_projection = light.view_projection;
+		shadow_views_.push_back(view);
+	}
+	const int num_views = (int)shadow_views_.size();
+	if (num_views == 0)
+		return;
+
+	Frustum frusta[MAX_SHADOW_MAPS];
+	for (int l = 0; l < num_views; l++) {
+		frusta[l].extract(shadow_views_[l].view_projection);
+		//casters between the light and a cascade throw shadows into it
+		if (shadow_views_[l].cascade)
+			frusta[l].planes[Frustum::NEAR_PLANE] = lm::vec4(0, 0, 0, 1);
+	}
+
+	const int num_meshes = ECS.getNumEnabled<Mesh>();
+	const int words = cullMaskWords(num_meshes);
+	shadow_visible_.assign((size_t)words * num_views, 0);
+	const int range = 1024;
+	JOBS.parallel_for(0, (num_meshes + range - 1) / range, 1, [&](int r) {
+		const int first = r * range;
+		cullBoxesMulti(frusta, num_views, mesh_boxes_, first, std::min(range, num_meshes - first),
+		               shadow_visible_.data(), words);
+	});
+	for (int l = 0; l < num_views; l++) {
+		shadow_casters_[l].clear();
+		cullMaskToList(shadow_visible_.data() + (size_t)l * words, num_meshes, shadow_casters_[l]);
+		if (shadow_views_[l].cascade)
+			fitCascadeDepth_(shadow_views_[l], shadow_casters_[l]);
+	}
+	uploadCascades_();
+}
+
+//adds a shadow map for each cascade of a directional light. Main camera
+//view up to shadow_distance is cut into slices, and each cascade is an
+//orthographic box around the bounding sphere of its slice, so its size
+//doesn't change as the camera turns. Boxes move in whole texels of the
+//map, so shadow edges don't crawl as the camera moves. Depth range is set
+//by fitCascadeDepth_ once casters are known
+void GraphicsSystem::fitCascades_(int light_index) {
+	const Light& light = ECS.getEnabledComponents<Light>()[light_index];
+	const Camera& camera = ECS.getComponent<Camera>(ECS.main_camera);
+	lm::mat4 inverse_vp = camera.view_projection;
+	if (!inverse_vp.inverse())
+		return;
+
+	//corners of near (0-3) and far (4-7) planes of camera frustum
+	lm::vec3 corners[8];
+	const float* m = inverse_vp.m;
+	for (int k = 0; k < 8; k++) {
+		const float x = (k & 1) ? 1.0f : -1.0f, y = (k & 2) ? 1.0f : -1.0f, z = (k & 4) ? 1.0f : -1.0f;
+		const float w = m[3] * x + m[7] * y + m[11] * z + m[15];
+		corners[k] = lm::vec3(m[0] * x + m[4] * y + m[8] * z + m[12],
+		                      m[1] * x + m[5] * y + m[9] * z + m[13],
+		                      m[2] * x + m[6] * y + m[10] * z + m[14]) * (1.0f / w);
+	}
+	const float near_plane = camera.near_plane, far_plane = camera.far_plane;
+	const float end = std::max(near_plane, std::min(far_plane, light.shadow_distance));
+	//view depth at end of slice k of num
+	const int num = lightCascades(light);
+	auto split = [&](int k) {
+		const float t = (float)k / num;
+		const float uniform = near_plane + (end - near_plane) * t;
+		const float logarithmic = near_plane * powf(end / near_plane, t);
+		return uniform + (logarithmic - uniform) * light.cascade_split;
+	};
+
+	//light view looks along light direction from origin, so it only
+	//changes when the light turns
+	lm::vec3 direction = light.direction;
+	direction.normalize();
+	const lm::vec3 up = fabsf(direction.y) > 0.99f ? lm::vec3(1, 0, 0) : lm::vec3(0, 1, 0);
+	lm::mat4 light_view;
+	light_view.lookAt(lm::vec3(0, 0, 0), direction, up);
+	const float* v = light_view.m;
+
+	for (int c = 0; c < num; c++) {
+		//corners of slice, along edges of camera frustum
+		const float t0 = (split(c) - near_plane) / (far_plane - near_plane);
+		const float t1 = (split(c + 1) - near_plane) / (far_plane - near_plane);
+		lm::vec3 slice[8];
+		lm::vec3 center(0, 0, 0);
+		for (int k = 0; k < 4; k++) {
+			const lm::vec3 edge = corners[k + 4] - corners[k];
+			slice[k] = corners[k] + edge * t0;
+			slice[k + 4] = corners[k] + edge * t1;
+			center = center + slice[k] + slice[k + 4];
+		}
+		center = center * (1.0f / 8.0f);
+		float radius = 0;
+		for (auto& corner : slice)
+			radius = std::max(radius, (corner - center).length());
+		//rounded up so float error doesn't change texel size
+		radius = ceilf(radius * 16.0f) / 16.0f;
+
+		ShadowView view;
+		view.light = light_index;
+		view.map = light_index * MAX_CASCADES + c;
+		view.cascade = true;
+		view.view = light_view;
+		const float texel = 2.0f * radius / shadow_tiles_[view.map].size;
+		const lm::vec3 light_center(floorf((v[0] * center.x + v[4] * center.y + v[8] * center.z) / texel) * texel,
+		                            floorf((v[1] * center.x + v[5] * center.y + v[9] * center.z) / texel) * texel,
+		                            v[2] * center.x + v[6] * center.y + v[10] * center.z);
+		view.box_min = light_center - lm::vec3(radius, radius, radius);
+		view.box_max = light_center + lm::vec3(radius, radius, radius);
+		lm::mat4 projection;
+		projection.orthographic(view.box_min.x, view.box_max.x, view.box_min.y, view.box_max.y, -view.box_max.z, -view.box_min.z);
+		view.view_projection = projection * light_view;
+		shadow_views_.push_back(view);
+	}
+}
+
+//pulls near plane of a cascade back to the caster nearest the light, so
+//that casters outside the camera slice still throw shadows into it
+void GraphicsSystem::fitCascadeDepth_(ShadowView& view, const std::vector<int>& casters) {
+	const float* v = view.view.m;
+	float max_z = view.box_max.z;
+	for (int k : casters) {
+		const float z = v[2] * mesh_boxes_.cx[k] + v[6] * mesh_boxes_.cy[k] + v[10] * mesh_boxes_.cz[k] +
+		                fabsf(v[2]) * mesh_boxes_.ex[k] + fabsf(v[6]) * mesh_boxes_.ey[k] + fabsf(v[10]) * mesh_boxes_.ez[k];
+		max_z = std::max(max_z, z);
+	}
+	lm::mat4 projection;
+	projection.orthographic(view.box_min.x, view.box_max.x, view.box_min.y, view.box_max.y, -max_z, -view.box_min.z);
+	view.view_projection = projection * view.view;
+}
+
+//writes matrices and atlas tiles of cascades of this frame to light ubo
+void GraphicsSystem::uploadCascades_() {
+	const float atlas_size = (float)shadow_atlas_size;
+	for (size_t first = 0; first < shadow_views_.size(); ) {
+		const int light_index = shadow_views_[first].light;
+		size_t last = first;
+		while (last < shadow_views_.size() && shadow_views_[last].light == light_index)
+			last++;
+		if (shadow_views_[first].cascade && light_index < (int)num_lights_uploaded_) {
+			//mat4 cascade_view_projection[MAX_CASCADES], vec4 cascade_rect[MAX_CASCADES]
+			GLfloat data[MAX_CASCADES * 20] = { 0 };
+			for (size_t l = first; l < last; l++) {
+				const int c = shadow_views_[l].map - light_index * MAX_CASCADES;
+				const ShadowTile& tile = shadow_tiles_[shadow_views_[l].map];
+				memcpy(&data[c * 16], shadow_views_[l].view_projection.m, 64);
+				GLfloat* rect = &data[MAX_CASCADES * 16 + c * 4];
+				rect[0] = tile.x / atlas_size; rect[1] = tile.y / atlas_size;
+				rect[2] = tile.size / atlas_size; rect[3] = tile.size / atlas_size;
+			}
+			memcpy(&light_data_[light_index * LIGHT_UBO_SIZE + LIGHT_UBO_CASCADES], data, sizeof(data));
+		}
+		first = last;
+	}
+}
+
+//draws shadow maps of lights found by cullShadowCasters_, reusing as much
+//of last frame's as possible. Casters which haven't moved for
+//SHADOW_STATIC_FRAMES frames are static, and are drawn into a separate
+//depth buffer per light only when they (or the light) change; each frame
+//this is copied into the shadow map and moving casters are drawn on top.
+//A map with no moving casters, whose static casters and light are the same
+//as when it was drawn, is not touched at all. Maps which do need drawing
+//are done in order of how long they have waited, at most
+//shadow_updates_per_frame of them, except for directional lights, lights
+//with the camera inside their volume, lights which moved (as the map must
+//match the matrix in the light ubo) and maps never drawn, which are always
+//drawn
+void GraphicsSystem::updateShadowMaps_() {
+	//casters whose world matrix changed after this version are dynamic
+	frame_versions_[frame_count_ % SHADOW_STATIC_FRAMES] = ECS.getVersion();
+	frame_count_++;
+	const unsigned int static_version = frame_versions_[frame_count_ % SHADOW_STATIC_FRAMES];
+
+	auto lights = ECS.getEnabledComponents<Light>();
+	auto meshes = ECS.getEnabledComponents<Mesh>();
+	const lm::vec3 camera_position = ECS.getComponent<Camera>(ECS.main_camera).position;
+
+	//key of static casters of shadow view l: FNV-1a hash of its matrix and
+	//of entity, geometry and versions of each static caster
+	auto staticKey = [&](int l) {
+		uint64_t key = 14695981039346656037ull;
+		auto add = [&key](uint32_t v) { key = (key ^ v) * 1099511628211ull; };
+		const lm::mat4& view_projection = shadow_views_[l].view_projection;
+		for (int k = 0; k < 16; k++) {
+			uint32_t bits;
+			memcpy(&bits, &view_projection.m[k], 4);
+			add(bits);
+		}
+		for (int m : shadow_casters_[l]) {
+			const Mesh& mesh = meshes[m];
+			if (!ECS.hasComponent<Transform>(mesh.owner)) continue;
+			const Transform& transform = ECS.getComponentFromEntity<Transform>(mesh.owner);
+			if (transform.world_version > static_version) continue;
+			add((uint32_t)mesh.owner); add((uint32_t)mesh.geometry);
+			add(mesh.version); add(transform.world_version);
+		}
+		return key | 1; //never 0
+	};
+	auto isDynamic = [&](int m) {
+		const Mesh& mesh = meshes[m];
+		return ECS.hasComponent<Transform>(mesh.owner) &&
+		       ECS.getComponentFromEntity<Transform>(mesh.owner).world_version > static_version;
+	};
+
+	//find maps which need drawing, and which of those must be drawn now
+	std::vector<uint64_t> keys(shadow_views_.size());
+	std::vector<int> must, waiting;
+	for (int l = 0; l < (int)shadow_views_.size(); l++) {
+		const ShadowView& view = shadow_views_[l];
+		ShadowCache& cache = shadow_cache_[view.map];
+		keys[l] = staticKey(l);
+		const bool has_dynamic = std::any_of(shadow_casters_[l].begin(), shadow_casters_[l].end(), isDynamic);
+		if (!has_dynamic && !cache.map_has_dynamic && cache.map_key == keys[l]) {
+			cache.frames_waiting = 0;
+			continue;
+		}
+		const Light& light = lights[view.light];
+		const lm::vec3 position = ECS.getGlobalMatrix(ECS.getComponentFromEntity<Transform>(light.owner)).position();
+		const bool light_moved = memcmp(cache.map_view_projection.m, view.view_projection.m, sizeof(view.view_projection.m)) != 0;
+		if (cache.map_key == 0 || light_moved || light.type == LightTypeDirectional ||
+		    (camera_position - position).length() < light.radius)
+			must.push_back(l);
+		else
+			waiting.push_back(l);
+	}
+	std::stable_sort(waiting.begin(), waiting.end(), [&](int a, int b) {
+		return shadow_cache_[shadow_views_[a].map].frames_waiting > shadow_cache_[shadow_views_[b].map].frames_waiting;
+	});
+	const int num_waiting = std::max(0, std::min((int)waiting.size(), shadow_updates_per_frame - (int)must.size()));
+	for (int k = num_waiting; k < (int)waiting.size(); k++)
+		shadow_cache_[shadow_views_[waiting[k]].map].frames_waiting++;
+	must.insert(must.end(), waiting.begin(), waiting.begin() + num_waiting);
+
+	GL_STATE.cullFace(GL_FRONT);
+	useShader(depth_shader_);
+	for (int l : must) {
+		const ShadowView& view = shadow_views_[l];
+		ShadowCache& cache = shadow_cache_[view.map];
+		static_casters_.clear();
+		dynamic_casters_.clear();
+		for (int m : shadow_casters_[l])
+			(isDynamic(m) ? dynamic_casters_ : static_casters_).push_back(m);
+
+		const ShadowTile& tile = shadow_tiles_[view.map];
+		if (!dynamic_casters_.empty() && cache.static_key != keys[l]) {
+			//static layer is needed and out of date
+			if (cache.static_frame.framebuffer != (GLuint)-1 && (int)cache.static_frame.width != tile.size)
+				cache.static_frame.destroy();
+			if (cache.static_frame.framebuffer == (GLuint)-1)
+				cache.static_frame.initDepth(tile.size, tile.size);
+			cache.static_frame.bindAndClear();
+			renderShadowCasters_(static_casters_, view.view_projection);
+			cache.static_key = keys[l];
+		}
+		if (cache.static_key == keys[l]) {
+			cache.static_frame.copyDepthTo(shadow_atlas_, tile.x, tile.y);
+			bindShadowTile_(view.map, false);
+		}
+		else {
+			bindShadowTile_(view.map, true);
+			renderShadowCasters_(static_casters_, view.view_projection);
+		}
+		renderShadowCasters_(dynamic_casters_, view.view_projection);
+
+		cache.map_key = keys[l];
+		cache.map_has_dynamic = !dynamic_casters_.empty();
+		cache.map_view_projection = view.view_projection;
+		cache.frames_waiting = 0;
+	}
+	GL_STATE.cullFace(GL_BACK);
+
+	//atlas stays bound for the rest of the frame
+	GL_STATE.bindTexture(GL_TEXTURE_2D, shadow_atlas_.color_textures[0], SHADOW_ATLAS_UNIT);
+}
+
+//renders meshes (by index in mesh array) into bound shadow map
+void GraphicsSystem::renderShadowCasters_(const std::vector<int>& casters, const lm::mat4& view_projection) {
+	auto meshes = ECS.getEnabledComponents<Mesh>();
+	for (int m : casters) {
+		Mesh& mesh = meshes[m];
+		if (ECS.hasComponent<Transform>(mesh.owner))
+			renderDepth_(mesh, ECS.getComponentFromEntity<Transform>(mesh.owner), view_projection);
+	}
+}
+
+//renders a mesh from a shadow map view, only setting its MVP
 //i.e. only usable with a depth shader
-void GraphicsSystem::renderDepth_(Mesh& comp, const Light& light) {
-	//get transform and matrices
-	Transform& transform = ECS.getComponentFromEntity<Transform>(comp.owner);
-	lm::mat4 model_matrix = transform.getGlobalMatrix(ECS.getAllComponents<Transform>());
-	lm::mat4 mvp_matrix = light.view_projection * model_matrix;
+void GraphicsSystem::renderDepth_(Mesh& comp, Transform& transform, const lm::mat4& view_projection) {
+	//get matrices
+	lm::mat4 mvp_matrix = view_projection * ECS.getGlobalMatrix(transform);
 	//set sole uniform
 	depth_shader_->setUniform(U_MVP, mvp_matrix);
 	//render
@@ -298,32 +624,217 @@ void GraphicsSystem::renderDepth_(Mesh& comp, const Light& light) {
 
 }
 
-//renders a given mesh component
-void GraphicsSystem::renderMeshComponent_(Mesh& comp) {
+//collects draws of the meshes found visible by cullMeshes_, one per
+//material set of their geometry, and sorts them (see RenderQueue)
+void GraphicsSystem::fillRenderQueue_() {
+	render_queue_.clear();
+	render_stats = RenderStats();
+	auto meshes = ECS.getEnabledComponents<Mesh>();
+	const Camera& cam = ECS.getComponent<Camera>(ECS.main_camera);
+	visible_meshes_.clear();
+	cullMaskToList(mesh_visible_.data(), (int)meshes.size(), visible_meshes_);
+	for (int i : visible_meshes_) {
+		Mesh& mesh = meshes[i];
+		if (!ECS.hasComponent<Transform>(mesh.owner))
+			continue;
+		//depth of center of world box along camera view
+		const lm::vec3 center(mesh_boxes_.cx[i], mesh_boxes_.cy[i], mesh_boxes_.cz[i]);
+		const float depth = (center - cam.position).dot(cam.forward);
+		const Geometry& geom = geometries_[mesh.geometry];
+		const bool deferred = mesh.render_mode == RenderModeDeferred;
+		const uint32_t shader = deferred ? 0 : (uint32_t)materials_[mesh.material].shader_id;
+		const int num_sets = (int)geom.material_sets.size();
+		for (int set = num_sets ? 0 : -1; set < num_sets; set++) {
+			const int material = set < 0 ? mesh.material : geom.material_set_ids[set];
+			uint64_t key;
+			if (deferred)
+				key = RenderQueue::opaqueKey(RenderQueue::PASS_GBUFFER, 0, material, mesh.geometry, depth);
+			else if (materials_[material].transparency_map != -1)
+				key = RenderQueue::transparentKey(RenderQueue::PASS_TRANSPARENT, depth, shader, material);
+			else
+				key = RenderQueue::opaqueKey(RenderQueue::PASS_OPAQUE, shader, material, mesh.geometry, depth);
+			render_queue_.add(key, i, material, set);
+		}
+	}
+	render_queue_.sort();
+}
 
-	//get components and geom
-	Transform& transform = ECS.getComponentFromEntity<Transform>(comp.owner);
-	Camera& cam = ECS.getComponentInArray<Camera>(ECS.main_camera);
-	Geometry& geom = geometries_[comp.geometry];
+//draws the items of a pass of the render queue. The gbuffer pass uses the
+//current shader, the others the shader of each mesh's material. Runs of
+//items with the same geometry, material set and material are drawn as one
+//instanced draw, if the shader has an instanced variant
+void GraphicsSystem::renderQueuePass_(RenderQueue::Pass pass) {
+	auto meshes = ECS.getEnabledComponents<Mesh>();
+	const Camera& cam = ECS.getComponent<Camera>(ECS.main_camera);
+	Shader* pass_shader = shader_;
+	int first, last;
+	render_queue_.passRange(pass, first, last);
+	//shader_ may already be the pass shader (gbuffer), but its per pass
+	//uniforms aren't set yet, so the first run always counts as a change
+	Shader* current_shader = nullptr;
+	current_material_ = -1;
+	int current_mesh = -1;
+	for (int k = first; k < last; ) {
+		const DrawItem& item = render_queue_[k];
+		Mesh& mesh = meshes[item.mesh];
+		Shader* shader = pass == RenderQueue::PASS_GBUFFER ? pass_shader : shaders_[materials_[mesh.material].shader_id];
+
+		//run of items which can be instances of this one
+		int end = k + 1;
+		Shader* instanced = use_instancing && canInstance_(mesh) ? instancedShader_(shader) : nullptr;
+		if (instanced) {
+			while (end < last) {
+				const DrawItem& other = render_queue_[end];
+				const Mesh& other_mesh = meshes[other.mesh];
+				if (other.material != item.material || other.material_set != item.material_set ||
+				    other_mesh.geometry != mesh.geometry || other_mesh.material != mesh.material || !canInstance_(other_mesh))
+					break;
+				end++;
+			}
+			if (end - k < 2)
+				instanced = nullptr;
+		}
 
-	//create mvp
-	lm::mat4 model_matrix = transform.getGlobalMatrix(ECS.getAllComponents<Transform>());
-	lm::mat4 mvp_matrix = cam.view_projection * model_matrix;
+		Shader* draw_shader = instanced ? instanced : shader;
+		if (current_shader != draw_shader) {
+			//uniforms belong to the program, so set them all again
+			useShader(draw_shader);
+			current_shader = draw_shader;
+			shader_->setUniform(U_VP, cam.view_projection);
+			shader_->setUniform(U_CAM_POS, cam.position);
+			current_material_ = -1;
+			current_mesh = -1;
+		}
+		if (current_material_ != item.material) {
+			current_material_ = item.material;
+			setMaterialUniforms();
+		}
+		if (instanced) {
+			renderInstances_(k, end);
+		}
+		else {
+			if (current_mesh != item.mesh) {
+				//matrices are in the ring already, unless shader wants them
+				//as plain uniforms
+				if (shader_->hasUniform(U_OBJECT_UBO) && object_offsets_[item.mesh] != -1)
+					uniform_ring_.bindRange(OBJECT_BINDING_POINT, object_offsets_[item.mesh], OBJECT_UBO_SIZE);
+				else
+					setMeshUniforms_(mesh, ECS.getComponentFromEntity<Transform>(mesh.owner));
+				current_mesh = item.mesh;
+			}
+			if (item.material_set < 0)
+				geometries_[mesh.geometry].render();
+			else
+				geometries_[mesh.geometry].render(item.material_set);
+		}
+		render_stats.draw_items += end - k;
+		render_stats.draw_calls++;
+		k = end;
+	}
+}
 
-	//view frustum culling
-	if (!BBInFrustum_(geom.aabb, mvp_matrix)) {
-		return;
+//draws items [first, last) of render queue, which share geometry, material
+//set and material, as instances in one call. Their model and normal
+//matrices are streamed to the instance buffer
+void GraphicsSystem::renderInstances_(int first, int last) {
+	auto meshes = ECS.getEnabledComponents<Mesh>();
+	const int count = last - first;
+	instance_data_.resize((size_t)count * INSTANCE_FLOATS);
+	for (int k = 0; k < count; k++) {
+		const Mesh& mesh = meshes[render_queue_[first + k].mesh];
+		const Transform& transform = ECS.getComponentFromEntity<Transform>(mesh.owner);
+		float* data = &instance_data_[(size_t)k * INSTANCE_FLOATS];
+		memcpy(data, ECS.getGlobalMatrix(transform).m, 16 * sizeof(float));
+		memcpy(data + 16, ECS.getNormalMatrix(transform).m, 9 * sizeof(float));
 	}
+	//new storage each call, so the driver needn't wait for earlier draws
+	glBindBuffer(GL_ARRAY_BUFFER, instance_buffer_);
+	glBufferData(GL_ARRAY_BUFFER, instance_data_.size() * sizeof(float), instance_data_.data(), GL_STREAM_DRAW);
+
+	const DrawItem& item = render_queue_[first];
+	Geometry& geom = geometries_[meshes[item.mesh].geometry];
+	if (!geom.instanced)
+		geom.enableInstancing(instance_buffer_);
+	geom.renderInstanced(item.material_set, count);
+
+	render_stats.instanced_calls++;
+	render_stats.instances += count;
+}
+
+//true if a mesh can be drawn as an instance: it has no per mesh uniforms
+//besides its matrices, and its geometry has no attributes where the
+//instance attributes go
+bool GraphicsSystem::canInstance_(const Mesh& mesh) {
+	return !ECS.hasComponent<BlendShapes>(mesh.owner) && geometries_[mesh.geometry].num_blend_shapes == 0;
+}
 
-	//normal matrix
-	lm::mat4 normal_matrix = model_matrix;
-	normal_matrix.inverse();
-	normal_matrix.transpose();
+//variant of a shader with INSTANCED defined, which reads model and normal
+//matrices from instance attributes; built the first time it is asked for.
+//nullptr if the vertex shader doesn't support it
+Shader* GraphicsSystem::instancedShader_(Shader* shader) {
+	auto it = instanced_shaders_.find(shader);
+	if (it != instanced_shaders_.end())
+		return it->second;
+	Shader* variant = nullptr;
+	const size_t version_end = shader->vertex_source.find('\n');
+	if (shader->vertex_source.find("#ifdef INSTANCED") != std::string::npos && version_end != std::string::npos) {
+		std::string vertex_source = shader->vertex_source;
+		vertex_source.insert(version_end + 1, "#define INSTANCED\n");
+		variant = loadShader(vertex_source, shader->fragment_source, true);
+		variant->name = shader->name + " (instanced)";
+	}
+	instanced_shaders_[shader] = variant;
+	return variant;
+}
+
+//writes this frame's uniform data to the ring, before any draws: the
+//lights, then matrices of each mesh in the render queue. Lights stay
+//bound for the frame; meshes are bound one by one as they are drawn
+void GraphicsSystem::uploadFrameUniforms_() {
+	auto meshes = ECS.getEnabledComponents<Mesh>();
+	const Camera& cam = ECS.getComponent<Camera>(ECS.main_camera);
+	const GLsizeiptr light_size = (GLsizeiptr)light_data_.size();
+	uniform_ring_.begin(uniform_ring_.alignedSize(light_size) +
+	                    uniform_ring_.alignedSize(OBJECT_UBO_SIZE) * (GLsizeiptr)visible_meshes_.size());
+	const GLintptr light_offset = uniform_ring_.write(light_data_.data(), light_size);
+
+	object_offsets_.assign(meshes.size(), -1);
+	for (int i : visible_meshes_) {
+		if (!ECS.hasComponent<Transform>(meshes[i].owner))
+			continue;
+		const Transform& transform = ECS.getComponentFromEntity<Transform>(meshes[i].owner);
+		GLintptr offset;
+		float* data = (float*)uniform_ring_.allocate(OBJECT_UBO_SIZE, offset);
+		if (!data)
+			break;
+		const lm::mat4& model = ECS.getGlobalMatrix(transform);
+		const lm::mat4 mvp = cam.view_projection * model;
+		const lm::mat3& normal = ECS.getNormalMatrix(transform);
+		memcpy(data, mvp.m, 64);
+		memcpy(data + 16, model.m, 64);
+		for (int c = 0; c < 3; c++) {
+			memcpy(data + 32 + c * 4, &normal.m[c * 3], 12);
+			data[32 + c * 4 + 3] = 0.0f;
+		}
+		object_offsets_[i] = offset;
+	}
+	uniform_ring_.flush();
+	if (light_offset != -1 && light_size > 0)
+		uniform_ring_.bindRange(LIGHTS_BINDING_POINT, light_offset, light_size);
+}
+
+//sets transform (and blend shape) uniforms of a mesh in current shader
+void GraphicsSystem::setMeshUniforms_(Mesh& comp, Transform& transform) {
+	Camera& cam = ECS.getComponent<Camera>(ECS.main_camera);
+
+	//create mvp
+	const lm::mat4& model_matrix = ECS.getGlobalMatrix(transform);
+	lm::mat4 mvp_matrix = cam.view_projection * model_matrix;
 
 	//transform uniforms
 	shader_->setUniform(U_MVP, mvp_matrix);
 	shader_->setUniform(U_MODEL, model_matrix);
-	shader_->setUniform(U_NORMAL_MATRIX, normal_matrix);
+	shader_->setUniform(U_NORMAL_MATRIX, ECS.getNormalMatrix(transform));
 	shader_->setUniform(U_CAM_POS, cam.position);
     
     //blend shapes
@@ -331,6 +842,12 @@ void GraphicsSystem::renderMeshComponent_(Mesh& comp) {
         BlendShapes& bs = ECS.getComponentFromEntity<BlendShapes>(comp.owner);
         shader_->setUniformFloatArray(U_BLEND_WEIGHTS, &(bs.blend_weights[0]), (int)bs.blend_weights.size());
     }
+}
+
+//renders a given mesh component
+void GraphicsSystem::renderMeshComponent_(Mesh& comp, Transform& transform) {
+	Geometry& geom = geometries_[comp.geometry];
+	setMeshUniforms_(comp, transform);
 
     //draw raw geom if no material sets
     if (geom.material_sets.size() == 0)
@@ -377,10 +894,17 @@ void GraphicsSystem::getJointMatrices(Joint* current,
     }
 }
 
-void GraphicsSystem::renderSkinnedMeshComponent_(SkinnedMesh& comp) {
+void GraphicsSystem::renderSkinnedMeshComponent_(SkinnedMesh& comp, Transform& transform) {
     
     //set joint bind poses
-    Camera& cam = ECS.getComponentInArray<Camera>(ECS.main_camera);
+    Camera& cam = ECS.getComponent<Camera>(ECS.main_camera);
+    
+    //view frustum culling (not done by cullMeshes_, skinned meshes are few)
+    lm::vec3 box_center = geometries_[comp.geometry].aabb.center;
+    lm::vec3 box_half_width = geometries_[comp.geometry].aabb.half_width;
+    transformBox(ECS.getGlobalMatrix(transform), box_center, box_half_width);
+    if (!Frustum(cam.view_projection).testBox(box_center, box_half_width))
+        return;
     
     GLint u_joint_pos_matrices = glGetUniformLocation(shader_->program, "u_joint_pos_matrices");
     GLint u_joint_bind_matrices = glGetUniformLocation(shader_->program, "u_joint_bind_matrices");
@@ -399,7 +923,7 @@ void GraphicsSystem::renderSkinnedMeshComponent_(SkinnedMesh& comp) {
     shader_->setUniform(U_SKIN_BIND_MATRIX, comp.skin_bind_matrix);
     shader_->setUniform(U_VP, cam.view_projection);
     
-    renderMeshComponent_(comp);
+    renderMeshComponent_(comp, transform);
 }
 
 //render the skybox as a cubemap
@@ -412,7 +936,7 @@ void GraphicsSystem::renderEnvironment_() {
     useShader(environment_program_);
     
     //get camera
-    Camera& cam = ECS.getComponentInArray<Camera>(ECS.main_camera);
+    Camera& cam = ECS.getComponent<Camera>(ECS.main_camera);
         
     //view projection matrix, zeroing out
     lm::mat4 view_matrix = cam.view_matrix;
@@ -423,20 +947,19 @@ void GraphicsSystem::renderEnvironment_() {
     shader_->setUniform(U_VP, vp_matrix);
     
     //bind texture
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, environment_tex_);
+    GL_STATE.bindTexture(GL_TEXTURE_CUBE_MAP, environment_tex_, 0);
 
 	//no need to set sampler id, as it will default to 0
     
     // disable depth test, cull front faces (to draw inside of mesh)
-    glDepthMask(false);
-    glCullFace(GL_FRONT);
+    GL_STATE.depthMask(false);
+    GL_STATE.cullFace(GL_FRONT);
     
 	geometries_[cube_map_geom_].render();
     
     // reset depth test and culling
-    glDepthMask(true);
-    glCullFace(GL_BACK);
+    GL_STATE.depthMask(true);
+    GL_STATE.cullFace(GL_BACK);
     
 }
 
@@ -455,14 +978,6 @@ void GraphicsSystem::checkShaderAndMaterial_(Mesh& mesh) {
     }
 }
 
-void GraphicsSystem::checkMaterial_(Mesh& mesh) {
-    //set material uniforms if required
-    if (current_material_ != mesh.material) {
-        current_material_ = mesh.material;
-        setMaterialUniforms();
-    }
-}
-
 //sets uniforms for current material and current shader
 void GraphicsSystem::setMaterialUniforms() {
     Material& mat = materials_[current_material_];
@@ -521,122 +1036,150 @@ void GraphicsSystem::setMaterialUniforms() {
     }
     else shader_->setUniform(U_USE_TRANSPARENCY_MAP, 0);
 
-	auto lights = ECS.getAllComponents<Light>();
-	for (size_t i = 0; i < lights.size(); i++) {
-
-		glActiveTexture(GL_TEXTURE0 + (GLenum)i);
-		glBindTexture(GL_TEXTURE_2D, shadow_frame_[i].color_textures[0]);
-
-		std::string shadow_map_name = "u_shadow_map[" + std::to_string(i) + "]";
-		GLint u_shadow_map_pos = glGetUniformLocation(shader_->program, shadow_map_name.c_str());
-		if (u_shadow_map_pos != -1)
-			glUniform1i(u_shadow_map_pos, (GLint)i);
-	}
-    
-	//light uniforms
+	//light uniforms (shadow atlas is already bound)
     shader_->setUniformBlock(U_LIGHTS_UBO, LIGHTS_BINDING_POINT);
-	shader_->setUniform(U_NUM_LIGHTS, (int)lights.size());
+	shader_->setUniform(U_NUM_LIGHTS, (int)num_lights_uploaded_);
 }
 
-//updates light ubo
+//updates contents of light ubo
 void GraphicsSystem::updateLights_() {
-	const std::vector<Light>& lights = ECS.getAllComponents<Light>();
+	auto lights = ECS.getEnabledComponents<Light>();
+	//shaders have room for MAX_LIGHTS
+	const size_t num_lights = std::min(lights.size(), (size_t)MAX_LIGHTS);
+	layoutShadowAtlas_();
 
-	// 3 * vec4, 4 * float, 1 x matrix, 1 * int, which is blocked out to 16 bytes
-	GLsizeiptr size_lights_ubo = (16 + 16 + 16 + 16 + 16 + 64) * lights.size();
-
-	glBindBuffer(GL_UNIFORM_BUFFER, light_ubo_);
-	glBufferData(GL_UNIFORM_BUFFER, size_lights_ubo, NULL, GL_STATIC_DRAW);
+	// 3 * vec4, 4 * float, 1 x matrix, 2 * int blocked out to 16 bytes, 1 * vec4,
+	// MAX_CASCADES * (matrix + vec4), 1 * int blocked out to 16 bytes
+	//(at least one light, as a buffer range can't be empty)
+	light_data_.assign(LIGHT_UBO_SIZE * std::max(num_lights, (size_t)1), 0);
+	auto put = [this](GLsizeiptr offset, const void* data, size_t size) { memcpy(&light_data_[offset], data, size); };
 
 	GLsizeiptr offset = 0; //pointer to top of buffer
 
-	for (auto& l : lights) {
+	for (size_t i = 0; i < num_lights; i++) {
+		Light& l = lights[i];
 		Transform& lt = ECS.getComponentFromEntity<Transform>(l.owner);
+		//attenuation may have changed since light was created
+		l.calculateRadius();
 
 		float spot_inner_cosine = cos((l.spot_inner*DEG2RAD) / 2.0f);
 		float spot_outer_cosine = cos((l.spot_outer*DEG2RAD) / 2.0f);
 
 		GLfloat light_data[16] = {
-			lt.m[12], lt.m[13], lt.m[14], 0.0,
+			lt.world.m[12], lt.world.m[13], lt.world.m[14], 0.0,
 			l.direction.x, l.direction.y, l.direction.z, 0.0,
 			l.color.x, l.color.y, l.color.z, 0.0,
 			l.linear_att,l.quadratic_att,spot_inner_cosine,spot_outer_cosine
 		};
 		//vec4s and floats data
-		glBufferSubData(GL_UNIFORM_BUFFER, offset, 64, light_data);
+		put(offset, light_data, 64);
 		offset += 64;
         //light matrix
-        glBufferSubData(GL_UNIFORM_BUFFER, offset, 64, l.view_projection.m);
+        put(offset, l.view_projection.m, 64);
         offset += 64;
 		//type
-		glBufferSubData(GL_UNIFORM_BUFFER, offset, 4, &(l.type));
+		put(offset, &(l.type), 4);
 		offset += 4;
-        //type
-        glBufferSubData(GL_UNIFORM_BUFFER, offset, 4, &(l.cast_shadow));
+        //cast shadow, only if light got its tiles in atlas
+        const bool has_shadow_map = l.cast_shadow && hasShadowMap_((int)i);
+        const GLint cast_shadow = has_shadow_map ? 1 : 0;
+        put(offset, &cast_shadow, 4);
         offset += 12;
+        //tile in atlas: offset and scale in texture coordinates
+        const ShadowTile& tile = shadow_tiles_[i * MAX_CASCADES];
+        const float atlas_size = (float)shadow_atlas_size;
+        GLfloat shadow_rect[4] = { tile.x / atlas_size, tile.y / atlas_size, tile.size / atlas_size, tile.size / atlas_size };
+        put(offset, shadow_rect, 16);
+        offset += 16;
+        //cascade matrices and tiles are written each frame by uploadCascades_
+        offset += MAX_CASCADES * (64 + 16);
+        const GLint num_cascades = has_shadow_map ? lightCascades(l) : 0;
+        put(offset, &num_cascades, 4);
+        offset += 16;
 	}
 
-	glBindBufferRange(GL_UNIFORM_BUFFER, LIGHTS_BINDING_POINT, light_ubo_, 0, size_lights_ubo);
-
-	needUpdateLights = false;
+	lights_version_ = ECS.advanceVersion();
+	num_lights_uploaded_ = num_lights;
 }
 
-//This function executes two sorts:
-// i) sorts materials array by shader_id
-// ii) sorts Mesh components by material id
-//the result is that the mesh component array is
-//ordered by both shader and material
-void GraphicsSystem::sortMeshes_() {
-
-	//sort materials by shader id
-	//first we store the old index of each material in materials_ array
-	for (size_t i = 0; i < materials_.size(); i++)
-		materials_[i].index = (int)i; // 'index' is a new property of Material
-
-	//second, we sort materials by shader_id
-	std::sort(materials_.begin(), materials_.end(), [](const Material& a, const Material& b) {
-		return a.shader_id < b.shader_id;
-	});
-    
-	//now we map old indices to new indices
-	std::map<int, int> old_new;
-	for (size_t i = 0; i < materials_.size(); i++) {
-		old_new[materials_[i].index] = (int)i;
+//gives each shadow map of lights which cast shadows a tile of the atlas,
+//sized from the light's resolution (see packShadowTiles). Cascades get half
+//of it each, so four of them cost the texels of one map. Cached maps whose
+//tile changed are dropped
+void GraphicsSystem::layoutShadowAtlas_() {
+	auto lights = ECS.getEnabledComponents<Light>();
+	const int num_lights = std::min((int)lights.size(), MAX_LIGHTS);
+	std::vector<int> sizes, maps;
+	for (int i = 0; i < num_lights; i++) {
+		if (!lights[i].cast_shadow) continue;
+		const int num_cascades = lightCascades(lights[i]);
+		if (num_cascades == 0) {
+			sizes.push_back(lights[i].resolution);
+			maps.push_back(i * MAX_CASCADES);
+		}
+		for (int c = 0; c < num_cascades; c++) {
+			sizes.push_back(lights[i].resolution / 2);
+			maps.push_back(i * MAX_CASCADES + c);
+		}
 	}
-
-	//now we swap index of materials in all meshes
-	auto& meshes = ECS.getAllComponents<Mesh>();
-	for (auto& mesh : meshes) {
-		int old_index = mesh.material;
-		int new_index = old_new[old_index];
-		mesh.material = new_index;
+	std::vector<ShadowTile> tiles;
+	packShadowTiles(shadow_atlas_size, SHADOW_TILE_MIN_SIZE, sizes, tiles);
+
+	ShadowTile new_tiles[MAX_SHADOW_MAPS];
+	for (size_t k = 0; k < maps.size(); k++)
+		new_tiles[maps[k]] = tiles[k];
+	for (int i = 0; i < MAX_SHADOW_MAPS; i++) {
+		if (new_tiles[i] == shadow_tiles_[i]) continue;
+		shadow_tiles_[i] = new_tiles[i];
+		shadow_cache_[i].map_key = 0;
+		shadow_cache_[i].static_key = 0;
 	}
+}
 
-	//store old mesh indices
-	for (size_t i = 0; i < meshes.size(); i++)
-		meshes[i].index = (int)i;
-
-	//short meshes by material id
-	std::sort(meshes.begin(), meshes.end(), [](const Mesh& a, const Mesh& b) {
-		return a.material < b.material;
-	});
+//true if all shadow maps of a light got a tile of the atlas
+bool GraphicsSystem::hasShadowMap_(int light_index) {
+	const int num_maps = std::max(1, lightCascades(ECS.getEnabledComponents<Light>()[light_index]));
+	for (int c = 0; c < num_maps; c++)
+		if (shadow_tiles_[light_index * MAX_CASCADES + c].size == 0)
+			return false;
+	return true;
+}
 
-	//clear map and refill with mesh index map
-	old_new.clear();
-    old_new[-1] = -1; //makes sure entities without mesh stay without mesh!
-	for (size_t i = 0; i < meshes.size(); i++) {
-		old_new[meshes[i].index] = (int)i;
+//binds shadow atlas for drawing into the tile of a shadow map
+void GraphicsSystem::bindShadowTile_(int map, bool clear) {
+	const ShadowTile& tile = shadow_tiles_[map];
+	GL_STATE.bindFramebuffer(GL_FRAMEBUFFER, shadow_atlas_.framebuffer);
+	GL_STATE.viewport(tile.x, tile.y, tile.size, tile.size);
+	if (clear) {
+		GL_STATE.enable(GL_SCISSOR_TEST);
+		GL_STATE.scissor(tile.x, tile.y, tile.size, tile.size);
+		glClear(GL_DEPTH_BUFFER_BIT);
+		GL_STATE.disable(GL_SCISSOR_TEST);
 	}
+}
 
-	//update all entities with new mesh id
-	auto& all_entities = ECS.entities;
-	for (auto& ent : ECS.entities) {
-		int old_index = ent.components[type2int<Mesh>::result];
-		int new_index = old_new[old_index];
-		ent.components[type2int<Mesh>::result] = new_index;
+//true if a light was added or removed, or a light or the world matrix of
+//its transform has changed (or moved in its array) since last upload
+bool GraphicsSystem::lightsChanged_() {
+	auto lights = ECS.getEnabledComponents<Light>();
+	if (std::min(lights.size(), (size_t)MAX_LIGHTS) != num_lights_uploaded_)
+		return true;
+	//nothing to look at if no light or transform was touched
+	if (!ECS.changed<Light>(lights_version_) && !ECS.changed<Transform>(lights_version_))
+		return false;
+	for (auto& l : lights) {
+		if (ECS.changed(l, lights_version_) ||
+			ECS.getComponentFromEntity<Transform>(l.owner).world_version > lights_version_)
+			return true;
 	}
+	return false;
 }
 
+//This function executes two sorts:
+// i) sorts materials array by shader_id
+// ii) sorts Mesh components by material id
+//the result is that the mesh component array is
+//ordered by both shader and material
 //reset shader and material
 void GraphicsSystem::resetShaderAndMaterial_() {
 	
@@ -652,36 +1195,25 @@ void GraphicsSystem::updateAllCameras_() {
 }
 
 void GraphicsSystem::bindAndClearScreen_() {
-	glViewport(0, 0, viewport_width_, viewport_height_);
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	GL_STATE.viewport(0, 0, viewport_width_, viewport_height_);
+	GL_STATE.bindFramebuffer(GL_FRAMEBUFFER, 0);
 	glClearColor(screen_background_color.x, screen_background_color.y, screen_background_color.z, screen_background_color.w);
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 }
 
-//change shader only if need to - note shader object must be in shaders_ map
+//change shader - GL_STATE skips the call if already in use (other systems
+//change program too, so shader_ alone can't tell)
 //s - pointer to a shader object
 void GraphicsSystem::useShader(Shader* s) {
-	if (!s) {
-		glUseProgram(0);
-		shader_ = nullptr;
-	}
-	else if (!shader_ || shader_ != s) {
-		glUseProgram(s->program);
-		shader_ = s;
-	}
+	GL_STATE.useProgram(s ? s->program : 0);
+	shader_ = s;
 }
 
-//change shader only if need to - note shader object must be in shaders_ map
+//change shader - note shader object must be in shaders_ map
 //p - GL id of shader
 void GraphicsSystem::useShader(GLuint p) {
-	if (!p) {
-		glUseProgram(0);
-		shader_ = nullptr;
-	}
-	else if (!shader_ || shader_->program != p) {
-		glUseProgram(p);
-		shader_ = shaders_[p];
-	}
+	GL_STATE.useProgram(p);
+	shader_ = p ? shaders_[p] : nullptr;
 }
 
 //sets internal variables
@@ -773,6 +1305,37 @@ int GraphicsSystem::createGeometryFromFile(std::string filename) {
 
 
 
+//as createGeometryFromFile, for several files which are parsed in parallel
+//jobs. OpenGL buffers are created on this (main) thread afterwards
+//returns index of each geometry (or -1 if failed) in same order as filenames
+std::vector<int> GraphicsSystem::createGeometriesFromFiles(const std::vector<std::string>& filenames) {
+    struct ParsedOBJ {
+        std::vector<GLfloat> vertices, uvs, normals;
+        std::vector<GLuint> indices;
+        bool ok = false;
+    };
+    std::vector<ParsedOBJ> parsed(filenames.size());
+    JOBS.parallel_for(0, (int)filenames.size(), 1, [&](int i) {
+        const std::string& filename = filenames[i];
+        std::string ext = filename.size() < 4 ? "" : filename.substr(filename.size() - 4, 4);
+        if (ext == ".obj" || ext == ".OBJ")
+            parsed[i].ok = Parsers::parseOBJ(filename, parsed[i].vertices, parsed[i].uvs, parsed[i].normals, parsed[i].indices);
+    });
+    
+    std::vector<int> geoms(filenames.size(), -1);
+    for (size_t i = 0; i < filenames.size(); i++) {
+        if (!parsed[i].ok) {
+            std::cerr << "ERROR: Could not parse mesh file " << filenames[i] << std::endl;
+            continue;
+        }
+        std::string name = filenames[i];
+        Geometry new_geom(name, parsed[i].vertices, parsed[i].uvs, parsed[i].normals, parsed[i].indices);
+        geometries_.emplace_back(new_geom);
+        geoms[i] = (int)geometries_.size() - 1;
+    }
+    return geoms;
+}
+
 int GraphicsSystem::createMultiGeometryFromFile(std::string filename) {
     
     std::vector<GLfloat> vertices, uvs, normals;
@@ -893,157 +1456,9 @@ AABB GraphicsSystem::transformAABB_(const AABB& aabb, const lm::mat4& transform)
 	return new_aabb;
 }
 
-
-//tests whether AABB or OOB is inside frustum or not, based on view_projection matrix
-bool GraphicsSystem::AABBInFrustum_(const AABB& aabb, const lm::mat4& to_clip) {
-	lm::vec4 points[8];
-	points[0] = lm::vec4(aabb.center.x - aabb.half_width.x, aabb.center.y - aabb.half_width.y, aabb.center.z - aabb.half_width.z, 1.0);
-	points[1] = lm::vec4(aabb.center.x - aabb.half_width.x, aabb.center.y - aabb.half_width.y, aabb.center.z + aabb.half_width.z, 1.0);
-	points[2] = lm::vec4(aabb.center.x - aabb.half_width.x, aabb.center.y + aabb.half_width.y, aabb.center.z - aabb.half_width.z, 1.0);
-	points[3] = lm::vec4(aabb.center.x - aabb.half_width.x, aabb.center.y + aabb.half_width.y, aabb.center.z + aabb.half_width.z, 1.0);
-	points[4] = lm::vec4(aabb.center.x + aabb.half_width.x, aabb.center.y - aabb.half_width.y, aabb.center.z - aabb.half_width.z, 1.0);
-	points[5] = lm::vec4(aabb.center.x + aabb.half_width.x, aabb.center.y - aabb.half_width.y, aabb.center.z + aabb.half_width.z, 1.0);
-	points[6] = lm::vec4(aabb.center.x + aabb.half_width.x, aabb.center.y + aabb.half_width.y, aabb.center.z - aabb.half_width.z, 1.0);
-	points[7] = lm::vec4(aabb.center.x + aabb.half_width.x, aabb.center.y + aabb.half_width.y, aabb.center.z + aabb.half_width.z, 1.0);
-
-	//transform to clip space
-	lm::vec4 clip_points[8];
-	for (int i = 0; i < 8; i++) {
-		clip_points[i] = to_clip * points[i];
-	}
-
-	//now test clip points against each plane. If all clip points are outside plane we return false
-	//left plane
-	int in = 0;
-	for (int i = 0; i < 8; i++) {
-		if (-clip_points[i].w < clip_points[i].x) in++;
-	}
-	if (!in) return false;
-
-	//right plane
-	in = 0;
-	for (int i = 0; i < 8; i++) {
-		if (clip_points[i].x < clip_points[i].w) in++;
-	}
-	if (!in) return false;
-
-	//bottom plane
-	in = 0;
-	for (int i = 0; i < 8; i++) {
-		if (-clip_points[i].w < clip_points[i].y) in++;
-	}
-	if (!in) return false;
-
-	//top plane
-	in = 0;
-	for (int i = 0; i < 8; i++) {
-		if (clip_points[i].y < clip_points[i].w) in++;
-	}
-	if (!in) return false;
-
-	//near plane
-	in = 0;
-	for (int i = 0; i < 8; i++) {
-		if (-clip_points[i].z < clip_points[i].z) in++;
-	}
-	if (!in) return false;
-
-	//far plane
-	in = 0;
-	for (int i = 0; i < 8; i++) {
-		if (clip_points[i].z < clip_points[i].w) in++;
-	}
-	if (!in) return false;
-
-	return true;
-}
-
-//tests whether Bounding box is inside frustum or not, based on model_view_projection matrix
-bool GraphicsSystem::BBInFrustum_(const AABB& aabb, const lm::mat4& mvp) {
-    //each corner point of box gets transformed into clip space, to give point PC, in HOMOGENOUS coords
-    //point is inside clip space iff
-    //-PC.w < PC.xyz < PC.w
-    //so we first take each corner of AABB (note, using vec4 because of homogenous coords) and multiply
-    //by matrix to clip space. Then we test each point against the 6 planes e.g. PC is on the 'right' side
-    //of the left plane iff -PC.w < PC.x; and is on 'left' side of right plane is PC.x < PC.w etc.
-    //For more info see:
-    //http://www.lighthouse3d.com/tutorials/view-frustum-culling/clip-space-approach-extracting-the-planes/
-    
-    
-    //the eight points of the box corners are calculated using center and +/- halfwith:
-    //- - -
-    //- - +
-    //- + -
-    //- + +
-    //+ - -
-    //+ - +
-    //+ + -
-    //+ + +
-	lm::vec4 points[8];
-	points[0] = lm::vec4(aabb.center.x - aabb.half_width.x, aabb.center.y - aabb.half_width.y, aabb.center.z - aabb.half_width.z, 1.0);
-	points[1] = lm::vec4(aabb.center.x - aabb.half_width.x, aabb.center.y - aabb.half_width.y, aabb.center.z + aabb.half_width.z, 1.0);
-	points[2] = lm::vec4(aabb.center.x - aabb.half_width.x, aabb.center.y + aabb.half_width.y, aabb.center.z - aabb.half_width.z, 1.0);
-	points[3] = lm::vec4(aabb.center.x - aabb.half_width.x, aabb.center.y + aabb.half_width.y, aabb.center.z + aabb.half_width.z, 1.0);
-	points[4] = lm::vec4(aabb.center.x + aabb.half_width.x, aabb.center.y - aabb.half_width.y, aabb.center.z - aabb.half_width.z, 1.0);
-	points[5] = lm::vec4(aabb.center.x + aabb.half_width.x, aabb.center.y - aabb.half_width.y, aabb.center.z + aabb.half_width.z, 1.0);
-	points[6] = lm::vec4(aabb.center.x + aabb.half_width.x, aabb.center.y + aabb.half_width.y, aabb.center.z - aabb.half_width.z, 1.0);
-	points[7] = lm::vec4(aabb.center.x + aabb.half_width.x, aabb.center.y + aabb.half_width.y, aabb.center.z + aabb.half_width.z, 1.0);
-
-	//transform to clip space
-	lm::vec4 clip_points[8];
-	for (int i = 0; i < 8; i++) {
-		clip_points[i] = mvp * points[i];
-	}
-
-	//now test clip points against each plane. If all clip points are outside plane we return false
-	//left plane
-	int in = 0;
-	for (int i = 0; i < 8; i++) {
-		if (-clip_points[i].w < clip_points[i].x) in++;
-	}
-	if (!in) return false;
-
-	//right plane
-	in = 0;
-	for (int i = 0; i < 8; i++) {
-		if (clip_points[i].x < clip_points[i].w) in++;
-	}
-	if (!in) return false;
-
-	//bottom plane
-	in = 0;
-	for (int i = 0; i < 8; i++) {
-		if (-clip_points[i].w < clip_points[i].y) in++;
-	}
-	if (!in) return false;
-
-	//top plane
-	in = 0;
-	for (int i = 0; i < 8; i++) {
-		if (clip_points[i].y < clip_points[i].w) in++;
-	}
-	if (!in) return false;
-
-	//near plane
-	in = 0;
-	for (int i = 0; i < 8; i++) {
-		if (-clip_points[i].z < clip_points[i].z) in++;
-	}
-	if (!in) return false;
-
-	//far plane
-	in = 0;
-	for (int i = 0; i < 8; i++) {
-		if (clip_points[i].z < clip_points[i].w) in++;
-	}
-	if (!in) return false;
-
-	return true;
-}
-
 //sets viewport of graphics system
 void GraphicsSystem::updateMainViewport(int window_width, int window_height) {
-    glViewport(0, 0, window_width, window_height);
+    GL_STATE.viewport(0, 0, window_width, window_height);
     viewport_width_ = window_width;
     viewport_height_ = window_height;
 }
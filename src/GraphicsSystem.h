@@ -6,9 +6,22 @@
 #include "Shader.h"
 #include "Components.h"
 #include "GraphicsUtilities.h"
+#include "Frustum.h"
+#include "RenderQueue.h"
+#include "UniformRing.h"
 #include <unordered_map>
 
-#define MAX_LIGHTS 8
+//must match MAX_LIGHTS in shaders
+#define MAX_LIGHTS 16
+//must match MAX_CASCADES in shaders
+#define MAX_CASCADES 4
+//shadow map of each light, or of each cascade of a directional light
+#define MAX_SHADOW_MAPS (MAX_LIGHTS * MAX_CASCADES)
+//smallest tile of shadow atlas, in texels
+#define SHADOW_TILE_MIN_SIZE 64
+//a caster which hasn't moved for this many frames goes in the static layer of
+//shadow maps, see GraphicsSystem::updateShadowMaps_
+#define SHADOW_STATIC_FRAMES 30
 
 class GraphicsSystem {
 public:
@@ -21,6 +34,22 @@ public:
 	void updateMainViewport(int window_width, int window_height);
     void getMainViewport(int& width, int& height);
 	lm::vec4 screen_background_color;
+	//most shadow maps redrawn per frame, besides those which must be (see
+	//updateShadowMaps_). Others wait their turn and keep last frame's map
+	int shadow_updates_per_frame = 4;
+	//size in texels of the square shadow atlas shared by all lights (a
+	//power of two, set before lateInit)
+	int shadow_atlas_size = 4096;
+	//draw runs of meshes sharing geometry and material as one instanced
+	//call (see renderQueuePass_)
+	bool use_instancing = true;
+	//mesh draws of last frame
+	struct RenderStats {
+		int draw_items = 0; //meshes, or material sets of them
+		int draw_calls = 0;
+		int instanced_calls = 0; //draw calls of more than one instance
+		int instances = 0; //draw items drawn by instanced calls
+	} render_stats;
 
     //shader loader
 	Shader* loadShader(std::string vs_path, std::string fs_path, bool compile_direct = false);
@@ -41,12 +70,10 @@ public:
                        std::vector<float>& normals,
                        std::vector<unsigned int>& indices);
     int createGeometryFromFile(std::string filename);
+    std::vector<int> createGeometriesFromFiles(const std::vector<std::string>& filenames);
     int createMultiGeometryFromFile(std::string filename);
     int createTerrainGeometry(int resolution, float step, float max_height, ImageData& height_map);
 
-	//lights update
-	bool needUpdateLights = true;
-
 	int sphere_volume_geom_;
 
 private:
@@ -71,19 +98,22 @@ private:
     void setMaterialUniforms();
 
 	//sorting and checking and abstracting
-	void sortMeshes_();
 	void resetShaderAndMaterial_();
 	void updateAllCameras_();
 	void checkShaderAndMaterial_(Mesh& mesh);
-    void checkMaterial_(Mesh& mesh);
 	
 	//binding and clearing
 	void bindAndClearScreen_();
 
 	//light uniform buffer object
 	GLuint LIGHTS_BINDING_POINT = 1;
-	GLuint light_ubo_;
+	//contents of light ubo, written to uniform_ring_ each frame
+	std::vector<char> light_data_;
 	void updateLights_();
+	//ECS version and number of lights at last upload to ubo
+	unsigned int lights_version_ = 0;
+	size_t num_lights_uploaded_ = 0;
+	bool lightsChanged_();
     void setLightUniforms_();
 
 	//framebuffers
@@ -94,8 +124,50 @@ private:
 	//shadowing
 	Shader* depth_shader_ = nullptr;
 	Shader* screen_depth_shader_ = nullptr;
-	Framebuffer shadow_frame_[MAX_LIGHTS];
-	void renderDepth_(Mesh& comp, const Light& light);
+	//one depth texture holding all shadow maps, each in its own tile, laid
+	//out by layoutShadowAtlas_. The map of cascade c of light i (c = 0 for
+	//lights without cascades) is number i * MAX_CASCADES + c
+	Framebuffer shadow_atlas_;
+	ShadowTile shadow_tiles_[MAX_SHADOW_MAPS];
+	void layoutShadowAtlas_();
+	bool hasShadowMap_(int light_index);
+	void bindShadowTile_(int map, bool clear);
+	void renderDepth_(Mesh& comp, Transform& transform, const lm::mat4& view_projection);
+	//a shadow map drawn this frame
+	struct ShadowView {
+		int light; //index in light array
+		int map; //number of shadow map, see shadow_tiles_
+		lm::mat4 view_projection;
+		//cascades only: light view, and box in light view space
+		bool cascade = false;
+		lm::mat4 view;
+		lm::vec3 box_min, box_max;
+	};
+	//shadow maps drawn this frame, and the meshes inside the frustum of
+	//each (by index in mesh array)
+	std::vector<ShadowView> shadow_views_;
+	std::vector<int> shadow_casters_[MAX_SHADOW_MAPS];
+	std::vector<uint32_t> shadow_visible_;
+	void cullShadowCasters_();
+	void fitCascades_(int light_index);
+	void fitCascadeDepth_(ShadowView& view, const std::vector<int>& casters);
+	void uploadCascades_();
+	//cached state of each shadow map
+	struct ShadowCache {
+		Framebuffer static_frame; //static casters only, size of tile, created when needed
+		uint64_t static_key = 0; //key of what is in static_frame, 0 if nothing
+		uint64_t map_key = 0; //key of static casters in shadow map, 0 if never drawn
+		bool map_has_dynamic = false; //shadow map also has dynamic casters
+		lm::mat4 map_view_projection; //of map, when it was drawn
+		int frames_waiting = 0; //since map was last brought up to date
+	};
+	ShadowCache shadow_cache_[MAX_SHADOW_MAPS];
+	//ECS version at start of each of last SHADOW_STATIC_FRAMES frames
+	unsigned int frame_versions_[SHADOW_STATIC_FRAMES] = { 0 };
+	unsigned int frame_count_ = 0;
+	std::vector<int> static_casters_, dynamic_casters_;
+	void updateShadowMaps_();
+	void renderShadowCasters_(const std::vector<int>& casters, const lm::mat4& view_projection);
     
     //gbuffer
     Shader* gbuffer_shader_ = nullptr;
@@ -119,16 +191,37 @@ private:
                      int& joint_count);
     
     //rendering
-    void renderMeshComponent_(Mesh& comp);
-    void renderSkinnedMeshComponent_(SkinnedMesh& comp);
+    void renderMeshComponent_(Mesh& comp, Transform& transform);
+    void setMeshUniforms_(Mesh& comp, Transform& transform);
+    //visible meshes of this frame, sorted into draw order
+    RenderQueue render_queue_;
+    std::vector<int> visible_meshes_;
+    void fillRenderQueue_();
+    void renderQueuePass_(RenderQueue::Pass pass);
+    //uniform data of each frame: lights, and matrices of each visible mesh
+    //(offset in ring by index in mesh array, -1 if none)
+    UniformRing uniform_ring_;
+    std::vector<GLintptr> object_offsets_;
+    void uploadFrameUniforms_();
+    //instancing
+    GLuint instance_buffer_ = 0;
+    std::vector<float> instance_data_;
+    std::unordered_map<Shader*, Shader*> instanced_shaders_; //nullptr if none
+    void renderInstances_(int first, int last);
+    bool canInstance_(const Mesh& mesh);
+    Shader* instancedShader_(Shader* shader);
+    //world space box of each mesh, and bitmask of those inside the main
+    //camera frustum, by index in mesh array. Updated by cullMeshes_
+    CullBoxes mesh_boxes_;
+    std::vector<uint32_t> mesh_visible_;
+    void cullMeshes_();
+    void renderSkinnedMeshComponent_(SkinnedMesh& comp, Transform& transform);
     void renderEnvironment_();
     void previewTextureViewport(GLuint texture_id);
     
 	//AABB
 	void setGeometryAABB_(Geometry& geom, std::vector<GLfloat>& vertices);
 	AABB transformAABB_(const AABB& aabb, const lm::mat4& transform);
-	bool BBInFrustum_(const AABB& aabb, const lm::mat4& model_view_projection);
-	bool AABBInFrustum_(const AABB& aabb, const lm::mat4& view_projection);
 
 	//shader strings
 	const char* screen_vertex_shader_ =
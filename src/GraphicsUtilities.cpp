@@ -1,4 +1,6 @@
 #include "GraphicsUtilities.h"
+#include "extern.h"
+#include <algorithm>
 
 // ****** GEOMETRY ***** //
 
@@ -12,16 +14,17 @@ Geometry::Geometry(std::string& geo_name, std::vector<float>& vertices, std::vec
 	createVertexArrays(vertices, uvs, normals, indices);
 }
 
+//vao stays bound after drawing, so that drawing the same geometry again
+//(e.g. the next material set) doesn't bind it again
 void Geometry::render() {
-	glBindVertexArray(vao);
+	GL_STATE.bindVertexArray(vao);
 	glDrawElements(GL_TRIANGLES, num_tris * 3, GL_UNSIGNED_INT, 0);
-	glBindVertexArray(0);
 }
 
 
 void Geometry::render(int set) {
     //bind the vao
-    glBindVertexArray(vao);
+    GL_STATE.bindVertexArray(vao);
     //if first set, draw from start to "end of set 0" (* 3 to convert from triangles
     //to indices)
     if (set == 0)
@@ -39,7 +42,35 @@ void Geometry::render(int set) {
                        GL_UNSIGNED_INT, //format of indices
                        (void*)(start_index * sizeof(GLuint))); //pointer to start!
     }
-    glBindVertexArray(0);
+}
+
+void Geometry::enableInstancing(GLuint instance_buffer) {
+	GL_STATE.bindVertexArray(vao);
+	glBindBuffer(GL_ARRAY_BUFFER, instance_buffer);
+	const GLsizei stride = INSTANCE_FLOATS * sizeof(float);
+	//a matrix attribute takes one location per column
+	for (GLuint c = 0; c < 4; c++) {
+		glEnableVertexAttribArray(INSTANCE_ATTRIB_MODEL + c);
+		glVertexAttribPointer(INSTANCE_ATTRIB_MODEL + c, 4, GL_FLOAT, GL_FALSE, stride, (void*)(c * 4 * sizeof(float)));
+		glVertexAttribDivisor(INSTANCE_ATTRIB_MODEL + c, 1);
+	}
+	for (GLuint c = 0; c < 3; c++) {
+		glEnableVertexAttribArray(INSTANCE_ATTRIB_NORMAL + c);
+		glVertexAttribPointer(INSTANCE_ATTRIB_NORMAL + c, 3, GL_FLOAT, GL_FALSE, stride, (void*)((16 + c * 3) * sizeof(float)));
+		glVertexAttribDivisor(INSTANCE_ATTRIB_NORMAL + c, 1);
+	}
+	GL_STATE.bindVertexArray(0);
+	instanced = true;
+}
+
+void Geometry::renderInstanced(int set, int instances) {
+	GLuint start_index = 0, count = num_tris * 3;
+	if (set >= 0) {
+		start_index = set == 0 ? 0 : material_sets[set - 1] * 3;
+		count = material_sets[set] * 3 - start_index;
+	}
+	GL_STATE.bindVertexArray(vao);
+	glDrawElementsInstanced(GL_TRIANGLES, count, GL_UNSIGNED_INT, (void*)(start_index * sizeof(GLuint)), instances);
 }
 
 void Geometry::createMaterialSet(int tri_count, int material_id) {
@@ -52,7 +83,7 @@ void Geometry::createVertexArrays(std::vector<float>& vertices, std::vector<floa
     
 	//generate and bind vao
 	glGenVertexArrays(1, &vao);
-	glBindVertexArray(vao);
+	GL_STATE.bindVertexArray(vao);
 	GLuint vbo;
 	//positions
 	glGenBuffers(1, &vbo);
@@ -79,7 +110,7 @@ void Geometry::createVertexArrays(std::vector<float>& vertices, std::vector<floa
 	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &(indices[0]), GL_STATIC_DRAW);
 	//unbind
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
-	glBindVertexArray(0);
+	GL_STATE.bindVertexArray(0);
 
 	//set number of triangles
 	num_tris = (GLuint)indices.size() / 3;
@@ -239,7 +270,7 @@ int Geometry::addVertexWeights(std::vector<lm::vec4>& vertex_weights,
     }
     
     
-    glBindVertexArray(vao);
+    GL_STATE.bindVertexArray(vao);
     GLuint vbo;
     
     glGenBuffers(1, &vbo);
@@ -266,7 +297,7 @@ int Geometry::addBlendShape(std::vector<float>& blend_offsets) {
     //attribute location is 2 (positions(0) + normals(1) + uvs(2)) + num_blend_shapes
     GLuint new_attrib_location = 2 + num_blend_shapes;
     
-    glBindVertexArray(vao);
+    GL_STATE.bindVertexArray(vao);
     GLuint vbo;
     
     glGenBuffers(1, &vbo);
@@ -283,16 +314,38 @@ int Geometry::addBlendShape(std::vector<float>& blend_offsets) {
  ******************/
 
 
+void Framebuffer::bind() {
+	GL_STATE.viewport(0, 0, width, height);
+	GL_STATE.bindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+}
+
+void Framebuffer::copyDepthTo(Framebuffer& dest, GLint x, GLint y) {
+	GL_STATE.bindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+	GL_STATE.bindFramebuffer(GL_DRAW_FRAMEBUFFER, dest.framebuffer);
+	glBlitFramebuffer(0, 0, width, height, x, y, x + width, y + height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+	GL_STATE.bindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void Framebuffer::destroy() {
+	if (framebuffer == (GLuint)-1) return;
+	GL_STATE.deleteFramebuffer(framebuffer);
+	for (GLuint& tex : color_textures) {
+		if (tex) GL_STATE.deleteTextures(1, &tex);
+		tex = 0;
+	}
+	framebuffer = -1;
+}
+
 void Framebuffer::bindAndClear() {
-	glViewport(0, 0, width, height);
-	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	GL_STATE.viewport(0, 0, width, height);
+	GL_STATE.bindFramebuffer(GL_FRAMEBUFFER, framebuffer);
 	glClearColor(1.0f, 1.0f, 1.0f, 1.0f);
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 }
 
 void Framebuffer::bindAndClear(lm::vec4 cc) {
-    glViewport(0, 0, width, height);
-    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    GL_STATE.viewport(0, 0, width, height);
+    GL_STATE.bindFramebuffer(GL_FRAMEBUFFER, framebuffer);
     glClearColor(cc.x, cc.y, cc.z, cc.w);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 }
@@ -302,16 +355,16 @@ void Framebuffer::initColor(GLsizei w, GLsizei h) {
 	width = w; height = h;
 
 	glGenFramebuffers(1, &(framebuffer));
-	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	GL_STATE.bindFramebuffer(GL_FRAMEBUFFER, framebuffer);
 
 	glGenTextures(1, &(color_textures[0]));
-	glBindTexture(GL_TEXTURE_2D, color_textures[0]);
+	GL_STATE.bindTexture(GL_TEXTURE_2D, color_textures[0]);
 
 	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
-	glBindTexture(GL_TEXTURE_2D, 0);
+	GL_STATE.bindTexture(GL_TEXTURE_2D, 0);
 
 	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, color_textures[0], 0);
 
@@ -326,7 +379,7 @@ void Framebuffer::initColor(GLsizei w, GLsizei h) {
 
 	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
 		std::cout << "ERROR::FRAMEBUFFER:: Framebuffer is not complete!" << std::endl;
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	GL_STATE.bindFramebuffer(GL_FRAMEBUFFER, 0);
 }
 
 void Framebuffer::initDepth(GLsizei w, GLsizei h) {
@@ -334,11 +387,11 @@ void Framebuffer::initDepth(GLsizei w, GLsizei h) {
 
 	//bind framebuffer and texture as usual
 	glGenFramebuffers(1, &framebuffer);
-	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	GL_STATE.bindFramebuffer(GL_FRAMEBUFFER, framebuffer);
 
 	//bind texture, but format with be only storing depth component
 	glGenTextures(1, &(color_textures[0]));
-	glBindTexture(GL_TEXTURE_2D, color_textures[0]);
+	GL_STATE.bindTexture(GL_TEXTURE_2D, color_textures[0]);
 	//generate depth texture
 	glTexImage2D(GL_TEXTURE_2D, 0, 
 		GL_DEPTH_COMPONENT, width, height, 0, 
@@ -365,7 +418,7 @@ void Framebuffer::initDepth(GLsizei w, GLsizei h) {
 
 	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
 		std::cout << "ERROR::FRAMEBUFFER:: Framebuffer is not complete!" << std::endl;
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	GL_STATE.bindFramebuffer(GL_FRAMEBUFFER, 0);
 }
 
 void Framebuffer::initGbuffer(GLsizei w, GLsizei h) {
@@ -373,10 +426,10 @@ void Framebuffer::initGbuffer(GLsizei w, GLsizei h) {
     
     //create and bind
     glGenFramebuffers(1, &(framebuffer));
-    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    GL_STATE.bindFramebuffer(GL_FRAMEBUFFER, framebuffer);
     //position
     glGenTextures(1, &(color_textures[0]));
-    glBindTexture(GL_TEXTURE_2D, color_textures[0]);
+    GL_STATE.bindTexture(GL_TEXTURE_2D, color_textures[0]);
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, width, height, 0, GL_RGB, GL_FLOAT, NULL);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
@@ -384,7 +437,7 @@ void Framebuffer::initGbuffer(GLsizei w, GLsizei h) {
     
     //normal
     glGenTextures(1, &(color_textures[1]));
-    glBindTexture(GL_TEXTURE_2D, color_textures[1]);
+    GL_STATE.bindTexture(GL_TEXTURE_2D, color_textures[1]);
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, width, height, 0, GL_RGB, GL_FLOAT, NULL);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
@@ -392,7 +445,7 @@ void Framebuffer::initGbuffer(GLsizei w, GLsizei h) {
     
     //diffuse + specular (in A channel)
     glGenTextures(1, &(color_textures[2]));
-    glBindTexture(GL_TEXTURE_2D, color_textures[2]);
+    GL_STATE.bindTexture(GL_TEXTURE_2D, color_textures[2]);
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
@@ -416,5 +469,49 @@ void Framebuffer::initGbuffer(GLsizei w, GLsizei h) {
     
     if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
         std::cout << "ERROR::Framebuffer is not complete!" << std::endl;
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    GL_STATE.bindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void packShadowTiles(int atlas_size, int min_size, const std::vector<int>& sizes, std::vector<ShadowTile>& tiles) {
+	const int n = (int)sizes.size();
+	std::vector<int> size(n);
+	long long area = 0;
+	for (int i = 0; i < n; i++) {
+		int s = min_size;
+		while (s * 2 <= std::min(sizes[i], atlas_size)) s *= 2;
+		size[i] = s;
+		area += (long long)s * s;
+	}
+	//halve largest tiles until all fit
+	const long long atlas_area = (long long)atlas_size * atlas_size;
+	while (area > atlas_area) {
+		int largest = (int)(std::max_element(size.begin(), size.end()) - size.begin());
+		if (size[largest] <= min_size) break;
+		area -= (long long)size[largest] * size[largest] * 3 / 4;
+		size[largest] /= 2;
+	}
+
+	//place largest first along a Z-order curve of min_size cells: as sizes
+	//are powers of two in decreasing order, each tile starts at a multiple
+	//of its own number of cells, which is a square block of the curve
+	std::vector<int> order(n);
+	for (int i = 0; i < n; i++) order[i] = i;
+	std::stable_sort(order.begin(), order.end(), [&](int a, int b) { return size[a] > size[b]; });
+	const long long num_cells = atlas_area / ((long long)min_size * min_size);
+	long long cell = 0;
+	tiles.assign(n, ShadowTile());
+	for (int i : order) {
+		const long long cells = (long long)(size[i] / min_size) * (size[i] / min_size);
+		if (cell + cells > num_cells) continue;
+		//de-interleave bits of cell index into x and y
+		int x = 0, y = 0;
+		for (int bit = 0; bit < 31; bit++) {
+			x |= (int)((cell >> (2 * bit)) & 1) << bit;
+			y |= (int)((cell >> (2 * bit + 1)) & 1) << bit;
+		}
+		tiles[i].x = x * min_size;
+		tiles[i].y = y * min_size;
+		tiles[i].size = size[i];
+		cell += cells;
+	}
 }
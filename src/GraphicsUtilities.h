@@ -26,6 +26,12 @@ struct ImageData {
     }
 };
 
+//per instance attributes of instanced draws: model matrix (locations 9-12)
+//then normal matrix (13-15), interleaved in one buffer
+const GLuint INSTANCE_ATTRIB_MODEL = 9;
+const GLuint INSTANCE_ATTRIB_NORMAL = 13;
+const int INSTANCE_FLOATS = 16 + 9;
+
 struct Geometry {
     
     //constructors
@@ -47,6 +53,10 @@ struct Geometry {
     //rendering
     void render();
     void render(int set);
+    //instancing: attributes read from instance_buffer, see INSTANCE_ATTRIB_*
+    bool instanced = false;
+    void enableInstancing(GLuint instance_buffer);
+    void renderInstanced(int set, int instances); //set -1 for all
 
 	//geometry, arrays and AABB
 	void createVertexArrays(std::vector<float>& vertices, std::vector<float>& uvs, std::vector<float>& normals, std::vector<unsigned int>& indices);
@@ -116,10 +126,28 @@ struct Framebuffer {
 	GLuint framebuffer = -1;
 	GLuint num_color_attachments = 0;
 	GLuint color_textures[10] = { 0,0,0,0,0,0,0,0,0,0 };
+	void bind();
 	void bindAndClear();
     void bindAndClear(lm::vec4 clear_color);
+	//copies depth buffer to the region of dest at x, y (same format)
+	void copyDepthTo(Framebuffer& dest, GLint x = 0, GLint y = 0);
 	void initColor(GLsizei width, GLsizei height);
 	void initDepth(GLsizei width, GLsizei height);
     void initGbuffer(GLsizei width, GLsizei height);
+	//deletes framebuffer and its textures
+	void destroy();
+};
+
+//square region of the shadow atlas, in texels (size 0 if none)
+struct ShadowTile {
+	int x = 0, y = 0, size = 0;
+	bool operator==(const ShadowTile& o) const { return x == o.x && y == o.y && size == o.size; }
+	bool operator!=(const ShadowTile& o) const { return !(*this == o); }
 };
 
+//places square tiles in a square atlas of atlas_size texels (a power of
+//two). Requested sizes are rounded down to powers of two between min_size
+//and atlas_size; while they don't fit, the largest are halved. Tiles which
+//still don't fit at min_size get size 0. tiles[i] is the place of sizes[i]
+void packShadowTiles(int atlas_size, int min_size, const std::vector<int>& sizes, std::vector<ShadowTile>& tiles);
+
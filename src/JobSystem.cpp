@@ -0,0 +1,129 @@
+#include "JobSystem.h"
+
+//which system and index the current thread belongs to
+static thread_local JobSystem* tls_job_system = nullptr;
+static thread_local int tls_thread_index = -1;
+
+JobSystem::~JobSystem() {
+    shutdown();
+}
+
+void JobSystem::init(int num_workers) {
+    if (num_workers < 0) {
+        int cores = (int)std::thread::hardware_concurrency();
+        num_workers = cores > 1 ? cores - 1 : 0;
+    }
+    main_thread_id_ = std::this_thread::get_id();
+    queues_.clear();
+    for (int i = 0; i < num_workers + 1; i++)
+        queues_.emplace_back(new JobQueue());
+    quit_ = false;
+    for (int i = 0; i < num_workers; i++)
+        threads_.emplace_back(&JobSystem::workerLoop_, this, i + 1);
+}
+
+void JobSystem::shutdown() {
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex_);
+        quit_ = true;
+    }
+    sleep_cv_.notify_all();
+    for (auto& t : threads_)
+        t.join();
+    threads_.clear();
+}
+
+int JobSystem::getThreadIndex() {
+    if (tls_job_system == this) return tls_thread_index;
+    if (std::this_thread::get_id() == main_thread_id_) return 0;
+    return -1;
+}
+
+void JobSystem::run(std::function<void()> job, JobCounter* counter) {
+    if (counter) counter->count.fetch_add(1, std::memory_order_relaxed);
+    const int index = getThreadIndex();
+    Job new_job;
+    new_job.func = std::move(job);
+    new_job.counter = counter;
+    push_(*queues_[index < 0 ? 0 : index], std::move(new_job));
+}
+
+void JobSystem::runOnMainThread(std::function<void()> job, JobCounter* counter) {
+    if (counter) counter->count.fetch_add(1, std::memory_order_relaxed);
+    Job new_job;
+    new_job.func = std::move(job);
+    new_job.counter = counter;
+    std::lock_guard<std::mutex> lock(main_thread_jobs_.mutex);
+    main_thread_jobs_.jobs.push_back(std::move(new_job));
+}
+
+void JobSystem::wait(JobCounter& counter) {
+    const int index = getThreadIndex();
+    while (!counter.done()) {
+        if (index < 0 || !runOne_(index))
+            std::this_thread::yield();
+    }
+}
+
+void JobSystem::push_(JobQueue& queue, Job&& job) {
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.jobs.push_back(std::move(job));
+    }
+    num_queued_.fetch_add(1, std::memory_order_release);
+    //lock so a worker about to sleep does not miss the notification
+    { std::lock_guard<std::mutex> lock(sleep_mutex_); }
+    sleep_cv_.notify_one();
+}
+
+bool JobSystem::pop_(JobQueue& queue, Job& job, bool from_back) {
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.jobs.empty()) return false;
+    if (from_back) {
+        job = std::move(queue.jobs.back());
+        queue.jobs.pop_back();
+    }
+    else {
+        job = std::move(queue.jobs.front());
+        queue.jobs.pop_front();
+    }
+    return true;
+}
+
+bool JobSystem::runOne_(int thread_index) {
+    Job job;
+    //main thread jobs first, as nobody else can run them
+    if (thread_index == 0 && pop_(main_thread_jobs_, job, false)) {
+        execute_(job);
+        return true;
+    }
+    if (num_queued_.load(std::memory_order_acquire) == 0)
+        return false;
+    //newest job of own queue, which is most likely in cache
+    bool found = pop_(*queues_[thread_index], job, true);
+    //otherwise oldest job of another thread, which is usually the biggest
+    const int num_queues = (int)queues_.size();
+    for (int i = 1; i < num_queues && !found; i++)
+        found = pop_(*queues_[(thread_index + i) % num_queues], job, false);
+    if (!found) return false;
+    num_queued_.fetch_sub(1, std::memory_order_relaxed);
+    execute_(job);
+    return true;
+}
+
+void JobSystem::execute_(Job& job) {
+    job.func();
+    if (job.counter)
+        job.counter->count.fetch_sub(1, std::memory_order_acq_rel);
+}
+
+void JobSystem::workerLoop_(int thread_index) {
+    tls_job_system = this;
+    tls_thread_index = thread_index;
+    while (true) {
+        if (runOne_(thread_index)) continue;
+        std::unique_lock<std::mutex> lock(sleep_mutex_);
+        sleep_cv_.wait(lock, [&]() { return quit_ || num_queued_.load() > 0; });
+        if (quit_) return;
+    }
+}
@@ -0,0 +1,108 @@
+#pragma once
+#include <atomic>
+#include <functional>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+
+/**** JOB SYSTEM ****/
+
+//runs small jobs on a pool of worker threads. Every thread (the main thread,
+//which called init(), is thread 0) has its own queue: it pushes and pops jobs
+//at the back of its queue, and when empty it steals from the front of the
+//queue of another thread. Jobs which call GL must run on main thread; use
+//runOnMainThread() for those
+//
+//A JobCounter counts unfinished jobs. wait() on a counter runs other jobs
+//until it reaches zero, so waiting inside a job does not block a thread
+//
+//The engine uses the global JOBS (see extern.h)
+
+struct JobCounter {
+    std::atomic<int> count{ 0 };
+    bool done() const { return count.load(std::memory_order_acquire) == 0; }
+};
+
+class JobSystem {
+public:
+    ~JobSystem();
+
+    //starts worker threads. -1 uses one per core, minus the main thread.
+    //With 0 workers, jobs run inside wait() on the main thread
+    void init(int num_workers = -1);
+    void shutdown();
+
+    //queues job on current thread (on main thread if called from a thread
+    //which is not part of this system). counter, if any, is incremented now
+    //and decremented when job has finished
+    void run(std::function<void()> job, JobCounter* counter = nullptr);
+
+    //queues job which only main thread may run
+    void runOnMainThread(std::function<void()> job, JobCounter* counter = nullptr);
+
+    //returns when counter is zero, running queued jobs in the meantime
+    void wait(JobCounter& counter);
+
+    //calls func(i) for every i in [begin, end), in jobs of 'grain' indices,
+    //and returns when all have finished. Calling thread runs a part itself
+    template<typename F>
+    void parallel_for(int begin, int end, int grain, const F& func) {
+        const int count = end - begin;
+        if (count <= 0) return;
+        grain = std::max(grain, 1);
+        if (count <= grain || threads_.empty()) {
+            for (int i = begin; i < end; i++) func(i);
+            return;
+        }
+        JobCounter counter;
+        int first = begin;
+        for (; first + grain < end; first += grain) {
+            const int last = first + grain;
+            run([&func, first, last]() {
+                for (int i = first; i < last; i++) func(i);
+            }, &counter);
+        }
+        for (int i = first; i < end; i++) func(i);
+        wait(counter);
+    }
+
+    //number of threads running jobs, including main thread
+    int getNumThreads() { return (int)threads_.size() + 1; }
+    //index of calling thread: 0 main thread, 1.. workers, -1 any other thread
+    int getThreadIndex();
+    bool isMainThread() { return getThreadIndex() == 0; }
+
+private:
+    struct Job {
+        std::function<void()> func;
+        JobCounter* counter = nullptr;
+    };
+    struct JobQueue {
+        std::mutex mutex;
+        std::deque<Job> jobs;
+    };
+
+    //one per thread, index as getThreadIndex()
+    std::vector<std::unique_ptr<JobQueue>> queues_;
+    JobQueue main_thread_jobs_;
+    std::vector<std::thread> threads_;
+    std::thread::id main_thread_id_;
+
+    //jobs in queues_, so idle workers know when to wake up
+    std::atomic<int> num_queued_{ 0 };
+    std::atomic<bool> quit_{ false };
+    std::mutex sleep_mutex_;
+    std::condition_variable sleep_cv_;
+
+    void push_(JobQueue& queue, Job&& job);
+    //runs one job from own queue, main thread queue (thread 0 only) or
+    //stolen from another thread. false if there were none
+    bool runOne_(int thread_index);
+    bool pop_(JobQueue& queue, Job& job, bool from_back);
+    void execute_(Job& job);
+    void workerLoop_(int thread_index);
+};
@@ -458,7 +458,7 @@ GLint Parsers::parseTexture(std::string filename,
 
 		//generate new openGL texture and bind it (tell openGL we want to do stuff with it)
 		glGenTextures(1, &texture_id);
-		glBindTexture(GL_TEXTURE_2D, texture_id); //we are making a regular 2D texture
+		GL_STATE.bindTexture(GL_TEXTURE_2D, texture_id); //we are making a regular 2D texture
 
 												  //screen pixels will almost certainly not be same as texture pixels, so we need to
 												  //set some parameters regarding the filter we use to deal with these cases
@@ -587,7 +587,7 @@ GLuint Parsers::parseCubemap(std::vector<std::string>& faces) {
     
     GLuint texture_id;
     glGenTextures(1, &texture_id);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, texture_id);
+    GL_STATE.bindTexture(GL_TEXTURE_CUBE_MAP, texture_id);
     
     //Define all 6 faces
     glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X, 0, GL_RGB, width, height, 0, GL_BGR, GL_UNSIGNED_BYTE, tgainfo0->data);
@@ -701,7 +701,8 @@ bool Parsers::parseJSONLevel(std::string filename,
 				player_cam.position = the_position;
 				player_cam.forward = lm::vec3(jd[0].GetFloat(), jd[1].GetFloat(), jd[2].GetFloat());
 				player_cam.setPerspective(fov*DEG2RAD, (float)vp_w / (float)vp_h, near, far);
-				ECS.main_camera = ECS.getComponentID<Camera>(ent_player);
+				ECS.main_camera = ECS.getComponentHandle<Camera>(ent_player);
+				control_system.debug_camera = ECS.main_camera;
 				control_system.control_type = ControlTypeFree;
 			}
 		}
@@ -800,6 +801,15 @@ bool Parsers::parseJSONLevel(std::string filename,
         materials[name] = mat_id;
     }
     
+	//make room for all lights and entities at once. This only saves
+	//allocations: components may still move while entities are created, so
+	//each reference below is fetched for its own entity and not kept after
+	const size_t num_lights = json["lights"].Size();
+	const size_t num_entities = json["entities"].Size();
+	ECS.reserveEntities(ECS.entities.size() + num_lights + num_entities);
+	ECS.reserveComponents<Light>(ECS.getAllComponents<Light>().size() + num_lights);
+	ECS.reserveComponents<Mesh>(ECS.getAllComponents<Mesh>().size() + num_entities);
+
 	//lights
 	for (rapidjson::SizeType i = 0; i < json["lights"].Size(); i++) {
 		std::string light_name = json["lights"][i]["name"].GetString();
@@ -873,12 +883,8 @@ bool Parsers::parseJSONLevel(std::string filename,
         //rotate
         //get rotation euler angles
         lm::vec3 rotate; rotate.x = jr[0].GetFloat(); rotate.y = jr[1].GetFloat(); rotate.z = jr[2].GetFloat();
-        //create quaternion from euler angles
-        lm::quat qR(rotate.x*DEG2RAD, rotate.y*DEG2RAD, rotate.z*DEG2RAD);
-        //create matrix which represents these rotations
-        lm::mat4 R; R.makeRotationMatrix(qR);
-        //multiply transform by this matrix
-        ent_transform.set(ent_transform * R);
+        //create quaternion from euler angles, which is the rotation
+        ent_transform.rotation = lm::quat(rotate.x*DEG2RAD, rotate.y*DEG2RAD, rotate.z*DEG2RAD);
         
         //scale
         ent_transform.scaleLocal(js[0].GetFloat(), js[1].GetFloat(), js[2].GetFloat());
@@ -915,18 +921,13 @@ bool Parsers::parseJSONLevel(std::string filename,
     
     //now link hierarchy need to get transform id from parent entity,
     //and link to transform object from child entity
-    for (std::pair<std::string, std::string> relationship : child_parent)
+    for (const auto& relationship : child_parent)
     {
         //get parent entity
         int parent_entity_id = ECS.getEntity(relationship.second);
-        Entity& parent = ECS.entities[parent_entity_id];
-        int parent_transform_id = parent.components[0]; //transform component is always in slot 0
-        
-        //get child transform
-        Transform& transform_child = ECS.getComponentFromEntity<Transform>(relationship.first);
         
-        //link child transform with parent id
-        transform_child.parent = parent_transform_id;
+        //link child transform with handle of parent entity
+        ECS.setParent(ECS.getEntity(relationship.first), ECS.getEntityHandle(parent_entity_id));
     }
     
     return true;
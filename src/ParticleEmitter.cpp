@@ -42,7 +42,7 @@ void ParticleEmitter::init() {
 	texture_id_ = Parsers::parseTexture("data/assets/droptexture.tga");
 
 	// tell opengl that the shader set the point size
-	glEnable(GL_PROGRAM_POINT_SIZE);
+	GL_STATE.enable(GL_PROGRAM_POINT_SIZE);
 
 	int num_particles = 1000;
 
@@ -62,7 +62,7 @@ void ParticleEmitter::init() {
 	glGenTransformFeedbacks(1, &tfA_);
 	glGenTransformFeedbacks(1, &tfB_);
 
-	glBindVertexArray(vaoA_);
+	GL_STATE.bindVertexArray(vaoA_);
 	GLuint vb_A_pos, vb_A_vel, vb_A_age, vb_A_lif;
 
 	// position buffer
@@ -139,7 +139,7 @@ void ParticleEmitter::init() {
 	glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 2, vb_A_age);
 	glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 3, vb_A_lif);
 
-	glBindVertexArray(vaoB_);
+	GL_STATE.bindVertexArray(vaoB_);
 	GLuint vb_B_pos, vb_B_vel, vb_B_age, vb_B_lif;
 
 	// position buffer
@@ -219,14 +219,14 @@ void ParticleEmitter::init() {
 }
 
 void ParticleEmitter::update() {
-	glUseProgram(particle_shader_->program);
+	GL_STATE.useProgram(particle_shader_->program);
 
-	glEnable(GL_BLEND);
-	glEnable(GL_POINT_SPRITE);
-	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-	glDepthMask(GL_FALSE);
+	GL_STATE.enable(GL_BLEND);
+	GL_STATE.enable(GL_POINT_SPRITE);
+	GL_STATE.blendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	GL_STATE.depthMask(GL_FALSE);
 
-	Camera& cam = ECS.getComponentInArray<Camera>(ECS.main_camera);
+	Camera& cam = ECS.getComponent<Camera>(ECS.main_camera);
 
 	particle_shader_->setUniform(U_MODEL, lm::mat4());
 	particle_shader_->setUniform(U_VP, cam.view_projection);
@@ -239,12 +239,12 @@ void ParticleEmitter::update() {
 	particle_shader_->setUniform(U_HEIGHT_NEAR_PLANE, heigh_near_plane);
 
 	if (vaoSource == 0) {
-		glBindVertexArray(vaoA_);
+		GL_STATE.bindVertexArray(vaoA_);
 		glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, tfB_);
 		vaoSource = 1;
 	}
 	else {
-		glBindVertexArray(vaoB_);
+		GL_STATE.bindVertexArray(vaoB_);
 		glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, tfA_);
 		vaoSource = 0;
 	}
@@ -252,8 +252,8 @@ void ParticleEmitter::update() {
 	glBeginTransformFeedback(GL_POINTS);
 	glDrawArrays(GL_POINTS, 0, 1000);
 	glEndTransformFeedback();
-	glDisable(GL_BLEND);
-	glDepthMask(GL_TRUE);
-	glDisable(GL_POINT_SPRITE);
+	GL_STATE.disable(GL_BLEND);
+	GL_STATE.depthMask(GL_TRUE);
+	GL_STATE.disable(GL_POINT_SPRITE);
 
 }
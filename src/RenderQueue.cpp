@@ -0,0 +1,66 @@
+#include "RenderQueue.h"
+#include <cstring>
+
+//top bits of a positive float, which sort in the same order as the floats.
+//Negative depths (behind the camera, but inside a box crossing the near
+//plane) count as 0
+static uint32_t depthBits(float depth, int bits) {
+    if (!(depth > 0.0f)) return 0;
+    uint32_t u;
+    memcpy(&u, &depth, 4);
+    return u >> (32 - bits);
+}
+
+uint64_t RenderQueue::opaqueKey(Pass pass, uint32_t shader, uint32_t material, uint32_t geometry, float depth) {
+    return (uint64_t)pass << 60 |
+           (uint64_t)(shader & 0xFFF) << 48 |
+           (uint64_t)(material & 0xFFFF) << 32 |
+           (uint64_t)(geometry & 0xFFFF) << 16 |
+           depthBits(depth, 16);
+}
+
+uint64_t RenderQueue::transparentKey(Pass pass, float depth, uint32_t shader, uint32_t material) {
+    return (uint64_t)pass << 60 |
+           (uint64_t)(~depthBits(depth, 28) & 0xFFFFFFF) << 32 |
+           (uint64_t)(shader & 0xFFF) << 16 |
+           (material & 0xFFFF);
+}
+
+void RenderQueue::sort() {
+    //least significant byte first, eight passes, skipping bytes which are
+    //the same in every key (most of them when there are few shaders)
+    const size_t n = items_.size();
+    scratch_.resize(n);
+    uint32_t counts[8][256] = { { 0 } };
+    for (const auto& item : items_)
+        for (int b = 0; b < 8; b++)
+            counts[b][(item.key >> (b * 8)) & 0xFF]++;
+
+    DrawItem* src = items_.data();
+    DrawItem* dst = scratch_.data();
+    for (int b = 0; b < 8; b++) {
+        const uint32_t* count = counts[b];
+        if (n == 0 || count[(src[0].key >> (b * 8)) & 0xFF] == n)
+            continue;
+        uint32_t offsets[256];
+        uint32_t sum = 0;
+        for (int d = 0; d < 256; d++) {
+            offsets[d] = sum;
+            sum += count[d];
+        }
+        for (size_t i = 0; i < n; i++)
+            dst[offsets[(src[i].key >> (b * 8)) & 0xFF]++] = src[i];
+        DrawItem* swap = src; src = dst; dst = swap;
+    }
+    if (src != items_.data())
+        items_.swap(scratch_);
+}
+
+void RenderQueue::passRange(Pass pass, int& first, int& last) const {
+    first = 0;
+    while (first < size() && (int)(items_[first].key >> 60) < pass)
+        first++;
+    last = first;
+    while (last < size() && (int)(items_[last].key >> 60) == pass)
+        last++;
+}
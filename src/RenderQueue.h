@@ -0,0 +1,41 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+/**** RENDER QUEUE ****/
+
+//one draw of a frame: a mesh, or one material set of its geometry
+struct DrawItem {
+    uint64_t key; //see RenderQueue, items are drawn in order of key
+    int mesh; //index in mesh array
+    int material; //index in materials array
+    int material_set; //-1 to draw whole geometry
+};
+
+//draws of a frame, refilled every frame and sorted by 64 bit key so that
+//each pass is drawn in one run with as few changes of state as possible.
+//Top 4 bits of key are the pass. For opaque passes the rest is shader,
+//material, geometry, then depth (front to back, so early depth test
+//rejects hidden pixels); for transparent passes depth comes first (back to
+//front, so blending is right), then shader and material
+class RenderQueue {
+public:
+    enum Pass { PASS_GBUFFER, PASS_OPAQUE, PASS_TRANSPARENT, NUM_PASSES };
+
+    void clear() { items_.clear(); }
+    void add(uint64_t key, int mesh, int material, int material_set) { items_.push_back({ key, mesh, material, material_set }); }
+    //radix sort by key; items with equal keys keep the order they were added
+    void sort();
+    int size() const { return (int)items_.size(); }
+    const DrawItem& operator[](int i) const { return items_[i]; }
+    //items [first, last) of pass, after sort
+    void passRange(Pass pass, int& first, int& last) const;
+
+    //keys. Fields are truncated to their bits (shader 12, material and
+    //geometry 16), which can only cost a change of state, never a wrong draw
+    static uint64_t opaqueKey(Pass pass, uint32_t shader, uint32_t material, uint32_t geometry, float depth);
+    static uint64_t transparentKey(Pass pass, float depth, uint32_t shader, uint32_t material);
+
+private:
+    std::vector<DrawItem> items_, scratch_;
+};
@@ -1,4 +1,5 @@
 #include "Shader.h"
+#include "extern.h"
 #include <vector>
 #include <fstream>
 #include <sstream>
@@ -62,6 +63,16 @@ bool Shader::setUniform(UniformID id, const lm::vec3& data) {
     return false;
 }
 
+//mat3 (e.g. normal matrix)
+bool Shader::setUniform(UniformID id, const lm::mat3& data) {
+    GLint loc = getUniformLocation(id);
+    if (loc != -1) {
+        glUniformMatrix3fv(loc, 1, GL_FALSE, data.m);
+        return true;
+    }
+    return false;
+}
+
 //mat4 array
 bool Shader::setUniform(UniformID id, const lm::mat4& data) {
     GLint loc = getUniformLocation(id);
@@ -119,8 +130,7 @@ bool Shader::setUniformMat4Array(UniformID id, const float* data, int size){
 //texture
 bool Shader::setTexture(UniformID id, GLuint tex_id, GLuint unit) {
     //get texture id and bind it
-    glActiveTexture(GL_TEXTURE0 + unit);
-    glBindTexture(GL_TEXTURE_2D, tex_id);
+    GL_STATE.bindTexture(GL_TEXTURE_2D, tex_id, unit);
     // tell sampler which slot its in
     GLint loc = getUniformLocation(id);
     if (loc != -1) {
@@ -132,8 +142,7 @@ bool Shader::setTexture(UniformID id, GLuint tex_id, GLuint unit) {
 //texture cube
 bool Shader::setTextureCube(UniformID id, GLuint tex_id, GLuint unit) {
     //get texture id and bind it
-    glActiveTexture(GL_TEXTURE0 + unit);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, tex_id);
+    GL_STATE.bindTexture(GL_TEXTURE_CUBE_MAP, tex_id, unit);
     // tell sampler which slot its in
     GLint loc = getUniformLocation(id);
     if (loc != -1) {
@@ -156,9 +165,9 @@ std::string Shader::readFile(std::string filename) {
 Shader::Shader(std::string vertSource, std::string fragSource) {
     std::vector<std::string> result = split(fragSource, '/');
     name = result.back();
-	std::string vertexShaderSourceCode=readFile(vertSource);
-	std::string fragmentShaderSourceCode=readFile(fragSource);
-    makeShaderProgram(makeVertexShader(vertexShaderSourceCode.c_str()), makeFragmentShader(fragmentShaderSourceCode.c_str()));
+	vertex_source = readFile(vertSource);
+	fragment_source = readFile(fragSource);
+    makeShaderProgram(makeVertexShader(vertex_source.c_str()), makeFragmentShader(fragment_source.c_str()));
 }
 
 Shader::Shader(std::string vertSource, std::string fragSource, const int num_feedback_varyings, const GLchar* feedback_varyings[]) {
@@ -168,6 +177,8 @@ Shader::Shader(std::string vertSource, std::string fragSource, const int num_fee
 }
 
 GLuint Shader::compileFromStrings(std::string vsh, std::string fsh) {
+	vertex_source = vsh;
+	fragment_source = fsh;
 	makeShaderProgram(makeVertexShader(vsh.c_str()), makeFragmentShader(fsh.c_str()));
 	return 1;
 }
@@ -309,6 +320,17 @@ void Shader::initUniforms_() {
         UniformID uniform_id = element.second;
         uniform_locations_[uniform_id] = glGetUniformBlockIndex(program, uniform_name.c_str());
     }
+
+    //sampler of shadow atlas never changes, so set it once
+    if (uniform_locations_[U_SHADOW_ATLAS] != (GLuint)-1) {
+        GLint current_program = 0;
+        glGetIntegerv(GL_CURRENT_PROGRAM, &current_program);
+        GL_STATE.useProgram(program);
+        glUniform1i(uniform_locations_[U_SHADOW_ATLAS], SHADOW_ATLAS_UNIT);
+        GL_STATE.useProgram(current_program);
+    }
+    if (uniform_locations_[U_OBJECT_UBO] != (GLuint)-1)
+        glUniformBlockBinding(program, uniform_locations_[U_OBJECT_UBO], OBJECT_BINDING_POINT);
 }
 
 //Returns location of uniform with given enum
@@ -36,6 +36,7 @@ enum UniformID {
 	U_USE_REFLECTION_MAP,
 	U_NUM_LIGHTS,
     U_LIGHTS_UBO,
+    U_OBJECT_UBO,
 	U_SCREEN_TEXTURE,
 	U_NEAR_PLANE,
 	U_FAR_PLANE,
@@ -44,14 +45,7 @@ enum UniformID {
     U_TEX_POSITION,
     U_TEX_NORMAL,
     U_TEX_ALBEDO,
-    U_SHADOW_MAP0,
-    U_SHADOW_MAP1,
-    U_SHADOW_MAP2,
-    U_SHADOW_MAP3,
-    U_SHADOW_MAP4,
-    U_SHADOW_MAP5,
-    U_SHADOW_MAP6,
-    U_SHADOW_MAP7,
+    U_SHADOW_ATLAS,
     U_LIGHT_ID,
     U_UV_SCALE,
     U_MAX_HEIGHT,
@@ -100,14 +94,7 @@ const std::unordered_map<std::string, UniformID> uniform_string2id_ = {
     { "u_tex_position", U_TEX_POSITION },
     { "u_tex_normal", U_TEX_NORMAL },
     { "u_tex_albedo", U_TEX_ALBEDO },
-    { "u_shadow_map[0]", U_SHADOW_MAP0 },
-    { "u_shadow_map[1]", U_SHADOW_MAP1 },
-    { "u_shadow_map[2]", U_SHADOW_MAP2 },
-    { "u_shadow_map[3]", U_SHADOW_MAP3 },
-    { "u_shadow_map[4]", U_SHADOW_MAP4 },
-    { "u_shadow_map[5]", U_SHADOW_MAP5 },
-    { "u_shadow_map[6]", U_SHADOW_MAP6 },
-    { "u_shadow_map[7]", U_SHADOW_MAP7 },
+    { "u_shadow_atlas", U_SHADOW_ATLAS },
     { "u_light_id", U_LIGHT_ID },
     { "u_uv_scale", U_UV_SCALE},
     { "u_max_height", U_MAX_HEIGHT},
@@ -120,8 +107,16 @@ const std::unordered_map<std::string, UniformID> uniform_string2id_ = {
     { "u_height_near_plane", U_HEIGHT_NEAR_PLANE}
 };
 
+//texture unit which the shadow atlas stays bound to (see GraphicsSystem).
+//Shaders which sample it get their u_shadow_atlas set to it when linked
+const GLuint SHADOW_ATLAS_UNIT = 7;
+//binding point of per object uniform block (matrices of the mesh being
+//drawn), also set when linked
+const GLuint OBJECT_BINDING_POINT = 2;
+
 const std::unordered_map<std::string, UniformID> uniformblock_string2id_ = {
     { "u_lights_ubo", U_LIGHTS_UBO },
+    { "u_object_ubo", U_OBJECT_UBO },
 };
 
 class Shader {
@@ -145,14 +140,18 @@ public:
     void saveProgramInfoLog(GLuint obj);
     void saveShaderInfoLog(GLuint obj);
     std::string log;
+    //sources the program was built from, to build variants of it
+    std::string vertex_source, fragment_source;
     
 	//
     GLuint getUniformLocation(UniformID name);
+    bool hasUniform(UniformID id) const { return uniform_locations_[id] != (GLuint)-1; }
     
     bool setUniform(UniformID id, const int data);
     bool setUniform(UniformID id, const float data);
     bool setUniform(UniformID id, const lm::vec2& data);
     bool setUniform(UniformID id, const lm::vec3& data);
+    bool setUniform(UniformID id, const lm::mat3& data);
     bool setUniform(UniformID id, const lm::mat4& data);
     bool setUniformFloatArray(UniformID id, const float* data, int size);
     bool setUniformVec2Array(UniformID id, const float* data, int size);
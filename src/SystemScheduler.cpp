@@ -0,0 +1,81 @@
+#include "SystemScheduler.h"
+#include "extern.h"
+
+void SystemScheduler::init(JobSystem* jobs) {
+    jobs_ = jobs;
+}
+
+void SystemScheduler::addSystem(const std::string& name,
+                                ComponentMask reads,
+                                ComponentMask writes,
+                                bool main_thread,
+                                std::function<void(float)> update) {
+    Node node;
+    node.name = name;
+    node.reads = reads;
+    node.writes = writes;
+    node.main_thread = main_thread;
+    node.update = update;
+    const int new_index = (int)nodes_.size();
+
+    //depend on every earlier system we conflict with. Main thread systems
+    //also keep their order, as they share the GL context
+    for (auto& other : nodes_) {
+        bool conflict = (other.writes & (reads | writes)) != 0 ||
+                        (writes & other.reads) != 0 ||
+                        (main_thread && other.main_thread);
+        if (conflict) {
+            other.dependents.push_back(new_index);
+            node.num_dependencies++;
+        }
+    }
+    nodes_.push_back(node);
+    remaining_.reset(new std::atomic<int>[nodes_.size()]);
+}
+
+void SystemScheduler::update(float dt) {
+    const int num_nodes = (int)nodes_.size();
+    dt_ = dt;
+    frame_start_ = std::chrono::high_resolution_clock::now();
+    frame_timings_.assign(num_nodes, SystemTiming());
+    for (int i = 0; i < num_nodes; i++)
+        remaining_[i] = nodes_[i].num_dependencies;
+    for (int i = 0; i < num_nodes; i++) {
+        if (nodes_[i].num_dependencies == 0)
+            queue_(i);
+    }
+
+    //main thread runs its own systems, and helps with others while waiting
+    jobs_->wait(frame_counter_);
+
+    timings_ = frame_timings_;
+    frame_ms_ = std::chrono::duration<double, std::milli>(
+        std::chrono::high_resolution_clock::now() - frame_start_).count();
+}
+
+void SystemScheduler::queue_(int node) {
+    if (nodes_[node].main_thread)
+        jobs_->runOnMainThread([this, node]() { run_(node); }, &frame_counter_);
+    else
+        jobs_->run([this, node]() { run_(node); }, &frame_counter_);
+}
+
+void SystemScheduler::run_(int node) {
+    auto start = std::chrono::high_resolution_clock::now();
+    nodes_[node].update(dt_);
+    auto end = std::chrono::high_resolution_clock::now();
+
+    //each system writes only its own entry
+    SystemTiming& timing = frame_timings_[node];
+    timing.name = nodes_[node].name;
+    timing.start_ms = std::chrono::duration<double, std::milli>(start - frame_start_).count();
+    timing.duration_ms = std::chrono::duration<double, std::milli>(end - start).count();
+    timing.thread = jobs_->getThreadIndex();
+
+    //frame counter can't reach zero before dependents are queued, as this
+    //job is still counted
+    for (int d : nodes_[node].dependents) {
+        if (remaining_[d].fetch_sub(1, std::memory_order_acq_rel) == 1)
+            queue_(d);
+    }
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include "Components.h"
+#include "JobSystem.h"
+#include <functional>
+#include <vector>
+#include <string>
+#include <chrono>
+
+//timing of a system in last frame, in ms since start of frame
+struct SystemTiming {
+    std::string name;
+    double start_ms = 0.0;
+    double duration_ms = 0.0;
+    int thread = 0; //0 is main thread
+};
+
+//runs the systems of a frame on several threads. Each system declares the
+//component types it reads and writes; a system runs after any system added
+//before it which writes what it reads or writes, or reads what it writes.
+//Systems which do not conflict run at the same time as jobs of the
+//JobSystem. Declared access only orders systems; changes are tracked by
+//what systems actually mark (see EntityComponentStore::changed). Systems
+//flagged main_thread (those calling GL or imGUI) run on the main thread, in
+//the order they were added
+class SystemScheduler {
+public:
+    void init(JobSystem* jobs);
+
+    void addSystem(const std::string& name,
+                   ComponentMask reads,
+                   ComponentMask writes,
+                   bool main_thread,
+                   std::function<void(float)> update);
+
+    //runs all systems once, returns when all of them have finished
+    void update(float dt);
+
+    //timings of last complete frame, in order systems were added
+    const std::vector<SystemTiming>& getTimings() { return timings_; }
+    double getFrameTime() { return frame_ms_; }
+    int getNumThreads() { return jobs_->getNumThreads(); }
+
+private:
+    struct Node {
+        std::string name;
+        ComponentMask reads;
+        ComponentMask writes;
+        bool main_thread;
+        std::function<void(float)> update;
+        std::vector<int> dependents;
+        int num_dependencies = 0;
+    };
+    std::vector<Node> nodes_;
+
+    JobSystem* jobs_ = nullptr;
+
+    //state of current frame
+    std::unique_ptr<std::atomic<int>[]> remaining_;
+    JobCounter frame_counter_;
+    std::vector<SystemTiming> frame_timings_;
+    float dt_ = 0.0f;
+    std::chrono::high_resolution_clock::time_point frame_start_;
+
+    std::vector<SystemTiming> timings_;
+    double frame_ms_ = 0.0;
+
+    void queue_(int node);
+    //runs system, then queues dependents which are now ready
+    void run_(int node);
+};
@@ -0,0 +1,127 @@
+#include "TransformSystem.h"
+#include "extern.h"
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TRANSFORM_SSE 1
+#include <xmmintrin.h>
+#endif
+
+//subtrees are updated in batches of this many roots per job
+static const int ROOTS_PER_JOB = 64;
+
+//writes local matrices of 4 transforms, built from translation, rotation and
+//scale (same as Transform::getLocalMatrix), to their world matrix, one
+//transform per SIMD lane
+static void updateLocalMatrices4_(Transform* const* t) {
+#if TRANSFORM_SSE
+    //quaternions are w, x, y, z: transpose them to one register per component
+    __m128 w = _mm_loadu_ps(t[0]->rotation.value_);
+    __m128 x = _mm_loadu_ps(t[1]->rotation.value_);
+    __m128 y = _mm_loadu_ps(t[2]->rotation.value_);
+    __m128 z = _mm_loadu_ps(t[3]->rotation.value_);
+    _MM_TRANSPOSE4_PS(w, x, y, z);
+    const __m128 sx = _mm_setr_ps(t[0]->scaling.x, t[1]->scaling.x, t[2]->scaling.x, t[3]->scaling.x);
+    const __m128 sy = _mm_setr_ps(t[0]->scaling.y, t[1]->scaling.y, t[2]->scaling.y, t[3]->scaling.y);
+    const __m128 sz = _mm_setr_ps(t[0]->scaling.z, t[1]->scaling.z, t[2]->scaling.z, t[3]->scaling.z);
+
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 two = _mm_set1_ps(2.0f);
+    const __m128 xx = _mm_mul_ps(x, x), yy = _mm_mul_ps(y, y), zz = _mm_mul_ps(z, z);
+    const __m128 xy = _mm_mul_ps(x, y), xz = _mm_mul_ps(x, z), yz = _mm_mul_ps(y, z);
+    const __m128 wx = _mm_mul_ps(w, x), wy = _mm_mul_ps(w, y), wz = _mm_mul_ps(w, z);
+
+    //element [column][row] of each matrix
+    __m128 m00 = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz))), sx);
+    __m128 m01 = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xy, wz)), sx);
+    __m128 m02 = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xz, wy)), sx);
+    __m128 m10 = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xy, wz)), sy);
+    __m128 m11 = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz))), sy);
+    __m128 m12 = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(yz, wx)), sy);
+    __m128 m20 = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xz, wy)), sz);
+    __m128 m21 = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(yz, wx)), sz);
+    __m128 m22 = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy))), sz);
+
+    //transpose back to one column per register, per transform
+    __m128 zero0 = _mm_setzero_ps(), zero1 = _mm_setzero_ps(), zero2 = _mm_setzero_ps();
+    _MM_TRANSPOSE4_PS(m00, m01, m02, zero0);
+    _MM_TRANSPOSE4_PS(m10, m11, m12, zero1);
+    _MM_TRANSPOSE4_PS(m20, m21, m22, zero2);
+    const __m128 col0[4] = { m00, m01, m02, zero0 };
+    const __m128 col1[4] = { m10, m11, m12, zero1 };
+    const __m128 col2[4] = { m20, m21, m22, zero2 };
+    for (int i = 0; i < 4; i++) {
+        float* m = t[i]->world.m;
+        _mm_storeu_ps(m, col0[i]);
+        _mm_storeu_ps(m + 4, col1[i]);
+        _mm_storeu_ps(m + 8, col2[i]);
+        m[12] = t[i]->translation.x; m[13] = t[i]->translation.y; m[14] = t[i]->translation.z; m[15] = 1.0f;
+    }
+#else
+    for (int i = 0; i < 4; i++)
+        t[i]->world = t[i]->getLocalMatrix();
+#endif
+}
+
+void TransformSystem::update(float dt) {
+    auto& transforms = ECS.getAllComponents<Transform>();
+
+    ECS.sortTransformHierarchy();
+    if (ECS.getHierarchyVersion() != roots_version_ || roots_.empty()) {
+        roots_version_ = ECS.getHierarchyVersion();
+        roots_.clear();
+        for (int i = 0; i < (int)transforms.size(); i += transforms[i].num_descendants + 1)
+            roots_.push_back(i);
+        roots_.push_back((int)transforms.size());
+    }
+
+    //matrices computed now get this version; changes made from here on have
+    //a higher one, so they are picked up next frame
+    stamp_ = ECS.advanceVersion();
+    num_updated_ = 0;
+
+    const int num_roots = (int)roots_.size() - 1;
+    JOBS.parallel_for(0, (num_roots + ROOTS_PER_JOB - 1) / ROOTS_PER_JOB, 1, [&](int batch) {
+        const int first = batch * ROOTS_PER_JOB;
+        const int last = std::min(first + ROOTS_PER_JOB, num_roots);
+        updateRange_(transforms, roots_[first], roots_[last]);
+    });
+}
+
+//updates transforms [begin, end), which must be whole subtrees
+void TransformSystem::updateRange_(ComponentPool<Transform>& transforms, int begin, int end) {
+    //find transforms to update: changed since last update, or below one
+    //which is (parents come first, and are stamped before their children are
+    //checked). Their local matrix goes to world, in batches
+    Transform* batch[4];
+    int batch_size = 0;
+    int updated = 0;
+    auto it = transforms.begin() + begin;
+    for (int i = begin; i < end; i++, ++it) {
+        Transform& transform = *it;
+        const Transform* parent = transform.parent_index == -1 ? nullptr : &transforms[transform.parent_index];
+        const bool dirty = transform.version > transform.world_version ||
+                           (parent && parent->world_version > transform.world_version);
+        if (!dirty) continue;
+        transform.world_version = stamp_;
+        updated++;
+        batch[batch_size++] = &transform;
+        if (batch_size == 4) {
+            updateLocalMatrices4_(batch);
+            batch_size = 0;
+        }
+    }
+    for (int i = 0; i < batch_size; i++)
+        batch[i]->world = batch[i]->getLocalMatrix();
+
+    //world matrices, parents first
+    it = transforms.begin() + begin;
+    for (int i = begin; i < end; i++, ++it) {
+        Transform& transform = *it;
+        if (transform.world_version != stamp_) continue;
+        if (transform.parent_index != -1)
+            transform.world = transforms[transform.parent_index].world * transform.world;
+        transform.normal_matrix = transform.world.normalMatrix();
+    }
+    num_updated_ += updated;
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include "includes.h"
+#include "Components.h"
+#include <atomic>
+#include <vector>
+
+//computes world matrix of every Transform once per frame (Transform::world,
+//and Transform::normal_matrix from it), so that rendering, shadows and
+//collisions read it instead of walking up the hierarchy each time. The
+//Transform array is kept in hierarchy order (see
+//EntityComponentStore::sortTransformHierarchy), so this is one forward loop
+//in which parents are always done before their children. Each root and its
+//subtree is contiguous and independent of the others, so batches of roots
+//are updated in parallel. Only transforms which changed (see
+//EntityComponentStore::markDirty), or whose parent's world matrix changed,
+//are recomputed. Their local matrix is built from translation, rotation and
+//scale, four at a time with SSE, straight into the world matrix, which is
+//then multiplied by the parent's
+class TransformSystem {
+public:
+    void update(float dt);
+
+    //number of world matrices recomputed in last update
+    int getNumUpdated() { return num_updated_; }
+
+private:
+    //index of first transform of each subtree (i.e. each root), plus size
+    //of array at end, rebuilt when hierarchy changes
+    std::vector<int> roots_;
+    unsigned int roots_version_ = 0;
+    unsigned int stamp_ = 0;
+    std::atomic<int> num_updated_{ 0 };
+
+    void updateRange_(ComponentPool<Transform>& transforms, int begin, int end);
+};
@@ -0,0 +1,111 @@
+#include "UniformRing.h"
+#include <cstring>
+
+UniformRing::~UniformRing() {
+    destroy_();
+}
+
+void UniformRing::init() {
+    GLint alignment = 0;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    if (alignment > 0) alignment_ = alignment;
+    persistent_ = GLEW_ARB_buffer_storage != 0;
+    create_(64 * 1024);
+}
+
+void UniformRing::create_(GLsizeiptr part_size) {
+    part_size_ = alignedSize(part_size);
+    const GLsizeiptr size = part_size_ * FRAMES_IN_FLIGHT;
+    glGenBuffers(1, &buffer_);
+    glBindBuffer(GL_UNIFORM_BUFFER, buffer_);
+    if (persistent_) {
+        const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_UNIFORM_BUFFER, size, NULL, flags);
+        persistent_data_ = (char*)glMapBufferRange(GL_UNIFORM_BUFFER, 0, size, flags);
+        if (!persistent_data_) {
+            //fall back to mapping each frame
+            std::cerr << "ERROR: UniformRing could not map buffer persistently" << std::endl;
+            glDeleteBuffers(1, &buffer_);
+            persistent_ = false;
+            create_(part_size);
+            return;
+        }
+    }
+    else {
+        glBufferData(GL_UNIFORM_BUFFER, size, NULL, GL_STREAM_DRAW);
+    }
+}
+
+void UniformRing::destroy_() {
+    for (auto& fence : fences_) {
+        if (fence) glDeleteSync(fence);
+        fence = 0;
+    }
+    if (buffer_) {
+        if (persistent_data_) {
+            glBindBuffer(GL_UNIFORM_BUFFER, buffer_);
+            glUnmapBuffer(GL_UNIFORM_BUFFER);
+        }
+        glDeleteBuffers(1, &buffer_);
+    }
+    buffer_ = 0;
+    persistent_data_ = nullptr;
+    data_ = nullptr;
+}
+
+void UniformRing::begin(GLsizeiptr size) {
+    if (size > part_size_) {
+        //GL keeps the old buffer alive until draws using it are done
+        GLsizeiptr part_size = part_size_ * 2;
+        while (part_size < size) part_size *= 2;
+        destroy_();
+        create_(part_size);
+        part_ = 0;
+    }
+    if (GLsync& fence = fences_[part_]) {
+        //normally long signalled, as it is FRAMES_IN_FLIGHT frames old
+        while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED) {}
+        glDeleteSync(fence);
+        fence = 0;
+    }
+    cursor_ = 0;
+    if (persistent_) {
+        data_ = persistent_data_ + part_ * part_size_;
+    }
+    else {
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer_);
+        data_ = (char*)glMapBufferRange(GL_UNIFORM_BUFFER, part_ * part_size_, part_size_,
+                                        GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+    }
+}
+
+void* UniformRing::allocate(GLsizeiptr size, GLintptr& offset) {
+    if (!data_ || cursor_ + size > part_size_) {
+        offset = -1;
+        return nullptr;
+    }
+    void* data = data_ + cursor_;
+    offset = part_ * part_size_ + cursor_;
+    cursor_ += alignedSize(size);
+    return data;
+}
+
+GLintptr UniformRing::write(const void* data, GLsizeiptr size) {
+    GLintptr offset;
+    void* dest = allocate(size, offset);
+    if (dest) memcpy(dest, data, size);
+    return offset;
+}
+
+void UniformRing::flush() {
+    if (!persistent_ && data_) {
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer_);
+        glUnmapBuffer(GL_UNIFORM_BUFFER);
+    }
+    data_ = nullptr;
+}
+
+void UniformRing::end() {
+    fences_[part_] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    part_ = (part_ + 1) % FRAMES_IN_FLIGHT;
+}
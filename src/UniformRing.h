@@ -0,0 +1,54 @@
+#pragma once
+#include "includes.h"
+
+/**** UNIFORM RING BUFFER ****/
+
+//frames the GPU may still be drawing while the CPU writes the next
+#define FRAMES_IN_FLIGHT 3
+
+//one uniform buffer, split in a part per frame in flight, which all per
+//frame uniform data (lights, per object matrices...) is written to in a
+//row and then bound with glBindBufferRange. A fence per part means the CPU
+//never writes where the GPU still reads, so no writes wait on the driver.
+//
+//Where GL_ARB_buffer_storage is available the buffer is mapped once,
+//persistently; otherwise each frame's part is mapped unsynchronized in
+//begin and unmapped in flush. Either way all writes of a frame go between
+//begin and flush, and binds and draws after it
+class UniformRing {
+public:
+    ~UniformRing();
+    void init();
+    //waits for the GPU to finish with the part this frame reuses, growing
+    //the buffer first if a part is smaller than size bytes
+    void begin(GLsizeiptr size);
+    //copies data and returns its offset in the buffer, aligned for
+    //glBindBufferRange. -1 if the frame's part is full
+    GLintptr write(const void* data, GLsizeiptr size);
+    //space for size bytes, to fill in place; nullptr if full
+    void* allocate(GLsizeiptr size, GLintptr& offset);
+    void flush();
+    //fences this frame's part and moves on to the next
+    void end();
+
+    void bindRange(GLuint binding_point, GLintptr offset, GLsizeiptr size) const {
+        glBindBufferRange(GL_UNIFORM_BUFFER, binding_point, buffer_, offset, size);
+    }
+    //size of a block of size bytes in the ring, with alignment
+    GLsizeiptr alignedSize(GLsizeiptr size) const { return (size + alignment_ - 1) / alignment_ * alignment_; }
+    bool persistent() const { return persistent_; }
+    GLsizeiptr used() const { return cursor_; }
+
+private:
+    GLuint buffer_ = 0;
+    bool persistent_ = false;
+    GLsizeiptr alignment_ = 256;
+    GLsizeiptr part_size_ = 0; //bytes per frame in flight
+    char* persistent_data_ = nullptr; //whole buffer, if persistent
+    char* data_ = nullptr; //current part, while writable
+    GLsizeiptr cursor_ = 0; //in current part
+    int part_ = 0;
+    GLsync fences_[FRAMES_IN_FLIGHT] = { 0 };
+    void create_(GLsizeiptr part_size);
+    void destroy_();
+};
@@ -1,4 +1,10 @@
 #pragma once
 #include "EntityComponentStore.h"
+#include "EcsCommandBuffer.h"
+#include "JobSystem.h"
+#include "GLState.h"
 
-extern EntityComponentStore ECS;
\ No newline at end of file
+extern EntityComponentStore ECS;
+extern EcsCommandBuffer ECS_COMMANDS;
+extern JobSystem JOBS;
+extern GLState GL_STATE;
\ No newline at end of file
@@ -8,6 +8,20 @@
 #include <math.h> //atan2
 #include <utility> //for std::swap
 
+//SSE2 is always there on x86-64 (and by default with MSVC on x86), so it is
+//the baseline. AVX2 and FMA are only used by transformMany, after checking
+//the CPU, as the rest is inlined in callers built for any x86-64 CPU
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define LM_SSE 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define LM_TARGET_AVX2
+#else
+#define LM_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#endif
+#endif
+
 namespace lm {
 
 	//**************************************
@@ -122,9 +136,9 @@ namespace lm {
 		return (*this).conjugate() * (1/norm);
 	}
 
-	quat operator + (const quat& a, const quat& b) { return quat(a.x + b.x, a.y + b.y, a.z + b.z, a.w + b.w); }
-	quat operator - (const quat& a, const quat& b) { return quat(a.x - b.x, a.y - b.y, a.z - b.z, a.w - b.w); }
-	quat operator * (const quat& a, float v) { return quat(a.x * v, a.y * v, a.z * v, a.w * v); }
+	quat operator + (const quat& a, const quat& b) { return quat(a.w + b.w, a.x + b.x, a.y + b.y, a.z + b.z); }
+	quat operator - (const quat& a, const quat& b) { return quat(a.w - b.w, a.x - b.x, a.y - b.y, a.z - b.z); }
+	quat operator * (const quat& a, float v) { return quat(a.w * v, a.x * v, a.y * v, a.z * v); }
 	quat operator * (const quat& a, const quat& b) {
 		return quat(
 			a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z,
@@ -134,9 +148,191 @@ namespace lm {
 		);
 	}
 
+	//v + 2w(u x v) + 2u x (u x v), where u is vector part of a
+	vec3 operator * (const quat& a, const vec3& v) {
+		vec3 u(a.x, a.y, a.z);
+		vec3 uv = u.cross(v);
+		vec3 uuv = u.cross(uv);
+		return v + uv * (2.0f * a.w) + uuv * 2.0f;
+	}
+
+	//**************************************
+	// mat3
+	//**************************************
+
+	mat3& mat3::setIdentity()
+	{
+		m[0] = 1; m[3] = 0; m[6] = 0;
+		m[1] = 0; m[4] = 1; m[7] = 0;
+		m[2] = 0; m[5] = 0; m[8] = 1;
+		return *this;
+	}
+
+	vec3 mat3::operator*(const vec3& v) const
+	{
+		return vec3(v.x*m[0] + v.y*m[3] + v.z*m[6],
+		            v.x*m[1] + v.y*m[4] + v.z*m[7],
+		            v.x*m[2] + v.y*m[5] + v.z*m[8]);
+	}
+
 	//**************************************
 	// mat4
 	//**************************************
+
+#if LM_SSE
+	//a * b, where each element of b scales a column of a and columns are summed
+	static inline __m128 transformSSE_(const mat4& a, __m128 v)
+	{
+		__m128 r = _mm_mul_ps(_mm_load_ps(a.m), _mm_shuffle_ps(v, v, 0x00));
+		r = _mm_add_ps(r, _mm_mul_ps(_mm_load_ps(a.m + 4), _mm_shuffle_ps(v, v, 0x55)));
+		r = _mm_add_ps(r, _mm_mul_ps(_mm_load_ps(a.m + 8), _mm_shuffle_ps(v, v, 0xAA)));
+		r = _mm_add_ps(r, _mm_mul_ps(_mm_load_ps(a.m + 12), _mm_shuffle_ps(v, v, 0xFF)));
+		return r;
+	}
+
+	//column i of result is a * column i of b. Result may be a or b
+	static inline void multiplySSE_(const mat4& a, const mat4& b, mat4& result)
+	{
+		const __m128 a0 = _mm_load_ps(a.m);
+		const __m128 a1 = _mm_load_ps(a.m + 4);
+		const __m128 a2 = _mm_load_ps(a.m + 8);
+		const __m128 a3 = _mm_load_ps(a.m + 12);
+		__m128 r[4];
+		for (int i = 0; i < 4; i++) {
+			const __m128 col = _mm_load_ps(b.m + 4 * i);
+			r[i] = _mm_add_ps(
+				_mm_add_ps(_mm_mul_ps(a0, _mm_shuffle_ps(col, col, 0x00)), _mm_mul_ps(a1, _mm_shuffle_ps(col, col, 0x55))),
+				_mm_add_ps(_mm_mul_ps(a2, _mm_shuffle_ps(col, col, 0xAA)), _mm_mul_ps(a3, _mm_shuffle_ps(col, col, 0xFF))));
+		}
+		for (int i = 0; i < 4; i++)
+			_mm_store_ps(result.m + 4 * i, r[i]);
+	}
+
+	//2x2 matrices, packed in a register as (m00, m01, m10, m11)
+	#define LM_SHUFFLE(a, b, x, y, z, w) _mm_shuffle_ps(a, b, _MM_SHUFFLE(w, z, y, x))
+	#define LM_SWIZZLE(a, x, y, z, w) LM_SHUFFLE(a, a, x, y, z, w)
+	//a * b
+	static inline __m128 mat2Mul_(__m128 a, __m128 b)
+	{
+		return _mm_add_ps(_mm_mul_ps(a, LM_SWIZZLE(b, 0, 3, 0, 3)),
+		                  _mm_mul_ps(LM_SWIZZLE(a, 1, 0, 3, 2), LM_SWIZZLE(b, 2, 1, 2, 1)));
+	}
+	//adjugate(a) * b
+	static inline __m128 mat2AdjMul_(__m128 a, __m128 b)
+	{
+		return _mm_sub_ps(_mm_mul_ps(LM_SWIZZLE(a, 3, 3, 0, 0), b),
+		                  _mm_mul_ps(LM_SWIZZLE(a, 1, 1, 2, 2), LM_SWIZZLE(b, 2, 3, 0, 1)));
+	}
+	//a * adjugate(b)
+	static inline __m128 mat2MulAdj_(__m128 a, __m128 b)
+	{
+		return _mm_sub_ps(_mm_mul_ps(a, LM_SWIZZLE(b, 3, 0, 3, 0)),
+		                  _mm_mul_ps(LM_SWIZZLE(a, 1, 0, 3, 2), LM_SWIZZLE(b, 2, 1, 2, 1)));
+	}
+
+	//inverse by 2x2 blocks (a transposed matrix gives the transposed
+	//inverse, so this works on columns as well as rows). Leaves m unchanged
+	//and returns false if it is singular
+	static bool inverseSSE_(mat4& m)
+	{
+		const __m128 c0 = _mm_load_ps(m.m);
+		const __m128 c1 = _mm_load_ps(m.m + 4);
+		const __m128 c2 = _mm_load_ps(m.m + 8);
+		const __m128 c3 = _mm_load_ps(m.m + 12);
+
+		//blocks | A B |
+		//       | C D |
+		const __m128 A = _mm_movelh_ps(c0, c1);
+		const __m128 B = _mm_movehl_ps(c1, c0);
+		const __m128 C = _mm_movelh_ps(c2, c3);
+		const __m128 D = _mm_movehl_ps(c3, c2);
+
+		//determinants of blocks, as (|A|, |B|, |C|, |D|)
+		const __m128 det_sub = _mm_sub_ps(
+			_mm_mul_ps(LM_SHUFFLE(c0, c2, 0, 2, 0, 2), LM_SHUFFLE(c1, c3, 1, 3, 1, 3)),
+			_mm_mul_ps(LM_SHUFFLE(c0, c2, 1, 3, 1, 3), LM_SHUFFLE(c1, c3, 0, 2, 0, 2)));
+		const __m128 det_A = LM_SWIZZLE(det_sub, 0, 0, 0, 0);
+		const __m128 det_B = LM_SWIZZLE(det_sub, 1, 1, 1, 1);
+		const __m128 det_C = LM_SWIZZLE(det_sub, 2, 2, 2, 2);
+		const __m128 det_D = LM_SWIZZLE(det_sub, 3, 3, 3, 3);
+
+		const __m128 D_C = mat2AdjMul_(D, C);
+		const __m128 A_B = mat2AdjMul_(A, B);
+		__m128 X = _mm_sub_ps(_mm_mul_ps(det_D, A), mat2Mul_(B, D_C));
+		__m128 W = _mm_sub_ps(_mm_mul_ps(det_A, D), mat2Mul_(C, A_B));
+		__m128 Y = _mm_sub_ps(_mm_mul_ps(det_B, C), mat2MulAdj_(D, A_B));
+		__m128 Z = _mm_sub_ps(_mm_mul_ps(det_C, B), mat2MulAdj_(A, D_C));
+
+		//|M| = |A||D| + |B||C| - trace(A#B D#C)
+		__m128 tr = _mm_mul_ps(A_B, LM_SWIZZLE(D_C, 0, 2, 1, 3));
+		tr = _mm_add_ps(tr, LM_SWIZZLE(tr, 2, 3, 0, 1));
+		tr = _mm_add_ps(tr, LM_SWIZZLE(tr, 1, 0, 3, 2));
+		const __m128 det_M = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(det_A, det_D), _mm_mul_ps(det_B, det_C)), tr);
+
+		const float det = _mm_cvtss_f32(det_M);
+		if (det == 0.0f || !std::isfinite(1.0f / det))
+			return false;
+
+		const __m128 r_det = _mm_div_ps(_mm_setr_ps(1.0f, -1.0f, -1.0f, 1.0f), det_M);
+		X = _mm_mul_ps(X, r_det);
+		Y = _mm_mul_ps(Y, r_det);
+		Z = _mm_mul_ps(Z, r_det);
+		W = _mm_mul_ps(W, r_det);
+
+		//adjugate of each block, stored back in columns
+		_mm_store_ps(m.m, LM_SHUFFLE(X, Y, 3, 1, 3, 1));
+		_mm_store_ps(m.m + 4, LM_SHUFFLE(X, Y, 2, 0, 2, 0));
+		_mm_store_ps(m.m + 8, LM_SHUFFLE(Z, W, 3, 1, 3, 1));
+		_mm_store_ps(m.m + 12, LM_SHUFFLE(Z, W, 2, 0, 2, 0));
+		return true;
+	}
+
+	//cross product of xyz lanes (w is 0 if it is 0 in a and b)
+	static inline __m128 crossSSE_(__m128 a, __m128 b)
+	{
+		const __m128 c = _mm_sub_ps(_mm_mul_ps(a, LM_SWIZZLE(b, 1, 2, 0, 3)),
+		                            _mm_mul_ps(LM_SWIZZLE(a, 1, 2, 0, 3), b));
+		return LM_SWIZZLE(c, 1, 2, 0, 3);
+	}
+
+	//rows of the inverse of the 3x3 part are cross products of its columns
+	//divided by the determinant. Leaves m unchanged and returns false if it
+	//is singular
+	static bool inverseAffineSSE_(mat4& m)
+	{
+		const __m128 c0 = _mm_load_ps(m.m);
+		const __m128 c1 = _mm_load_ps(m.m + 4);
+		const __m128 c2 = _mm_load_ps(m.m + 8);
+		const __m128 t = _mm_load_ps(m.m + 12);
+		__m128 r0 = crossSSE_(c1, c2);
+		__m128 r1 = crossSSE_(c2, c0);
+		__m128 r2 = crossSSE_(c0, c1);
+
+		const __m128 d = _mm_mul_ps(c0, r0);
+		const float det = _mm_cvtss_f32(d) + _mm_cvtss_f32(LM_SWIZZLE(d, 1, 1, 1, 1)) + _mm_cvtss_f32(LM_SWIZZLE(d, 2, 2, 2, 2));
+		if (det == 0.0f || !std::isfinite(1.0f / det))
+			return false;
+
+		const __m128 r_det = _mm_set1_ps(1.0f / det);
+		r0 = _mm_mul_ps(r0, r_det);
+		r1 = _mm_mul_ps(r1, r_det);
+		r2 = _mm_mul_ps(r2, r_det);
+		__m128 r3 = _mm_setzero_ps();
+		_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+
+		//translation is -inverse * t
+		__m128 it = _mm_mul_ps(r0, LM_SWIZZLE(t, 0, 0, 0, 0));
+		it = _mm_add_ps(it, _mm_mul_ps(r1, LM_SWIZZLE(t, 1, 1, 1, 1)));
+		it = _mm_add_ps(it, _mm_mul_ps(r2, LM_SWIZZLE(t, 2, 2, 2, 2)));
+		_mm_store_ps(m.m, r0);
+		_mm_store_ps(m.m + 4, r1);
+		_mm_store_ps(m.m + 8, r2);
+		_mm_store_ps(m.m + 12, _mm_sub_ps(_mm_setr_ps(0.0f, 0.0f, 0.0f, 1.0f), it));
+		return true;
+	}
+	#undef LM_SWIZZLE
+	#undef LM_SHUFFLE
+#endif
 	mat4::mat4()
 	{
 		setIdentity();
@@ -146,7 +342,7 @@ namespace lm {
         for (int i = 0; i < 16; i++) (*this).m[i] = v[i];
     }
 
-	void mat4::set(mat4 m) {
+	void mat4::set(const mat4& m) {
 		for (int i = 0; i < 16; i++) (*this).m[i] = m.m[i];
 	}
 
@@ -176,13 +372,85 @@ namespace lm {
 	}
 
 	bool mat4::inverse()
+	{
+#if LM_SSE
+		return inverseSSE_(*this);
+#else
+		return scalar::inverse(*this);
+#endif
+	}
+
+	//cofactors of the 3x3 part of a, i.e. its inverse transpose times its
+	//determinant, which is returned
+	static float cofactors3_(const mat4& a, mat3& c)
+	{
+		const float* m = a.m;
+		c.m[0] = m[5] * m[10] - m[9] * m[6];
+		c.m[1] = m[8] * m[6] - m[4] * m[10];
+		c.m[2] = m[4] * m[9] - m[8] * m[5];
+		c.m[3] = m[9] * m[2] - m[1] * m[10];
+		c.m[4] = m[0] * m[10] - m[8] * m[2];
+		c.m[5] = m[8] * m[1] - m[0] * m[9];
+		c.m[6] = m[1] * m[6] - m[5] * m[2];
+		c.m[7] = m[4] * m[2] - m[0] * m[6];
+		c.m[8] = m[0] * m[5] - m[4] * m[1];
+		return m[0] * c.m[0] + m[1] * c.m[1] + m[2] * c.m[2];
+	}
+
+	bool mat4::inverseAffine()
+	{
+#if LM_SSE
+		return inverseAffineSSE_(*this);
+#else
+		mat3 c;
+		const float det = cofactors3_(*this, c);
+		if (det == 0.0f || !std::isfinite(1.0f / det))
+			return false;
+		const float inv_det = 1.0f / det;
+
+		//3x3 part is the transposed cofactors / det, translation is -inverse * t
+		const vec3 t = position();
+		for (int col = 0; col < 3; col++)
+			for (int row = 0; row < 3; row++)
+				M[col][row] = c.M[row][col] * inv_det;
+		m[12] = -(m[0] * t.x + m[4] * t.y + m[8] * t.z);
+		m[13] = -(m[1] * t.x + m[5] * t.y + m[9] * t.z);
+		m[14] = -(m[2] * t.x + m[6] * t.y + m[10] * t.z);
+		m[3] = 0; m[7] = 0; m[11] = 0; m[15] = 1;
+		return true;
+#endif
+	}
+
+	mat4& mat4::inverseRigid()
+	{
+		const vec3 t = position();
+		std::swap(m[1], m[4]); std::swap(m[2], m[8]); std::swap(m[6], m[9]);
+		m[12] = -(m[0] * t.x + m[4] * t.y + m[8] * t.z);
+		m[13] = -(m[1] * t.x + m[5] * t.y + m[9] * t.z);
+		m[14] = -(m[2] * t.x + m[6] * t.y + m[10] * t.z);
+		m[3] = 0; m[7] = 0; m[11] = 0; m[15] = 1;
+		return *this;
+	}
+
+	mat3 mat4::normalMatrix() const
+	{
+		mat3 c;
+		const float det = cofactors3_(*this, c);
+		//singular matrices flatten normals anyway: keep cofactors unscaled
+		if (det != 0.0f && std::isfinite(1.0f / det))
+			for (int i = 0; i < 9; i++) c.m[i] /= det;
+		return c;
+	}
+
+	//Gauss-Jordan elimination with partial pivoting
+	bool scalar::inverse(mat4& a)
 	{
 		unsigned int i, j, k, swap;
 		float t;
 		mat4 temp, final;
 		final.setIdentity();
 
-		temp = (*this);
+		temp = a;
 
 		unsigned int m, n;
 		m = n = 4;
@@ -234,7 +502,7 @@ namespace lm {
 				}
 			}
 		}
-		*this = final;
+		a = final;
 
 		return true;
 	}
@@ -374,6 +642,64 @@ namespace lm {
 		m[12] = m[13] = m[14] = 0; m[15] = 1;
 	}
 
+	// sets the values of this matrix to translation * rotation * scale,
+	// without multiplying matrices: columns of rotation scaled by s
+	void mat4::makeTransformMatrix(const vec3& t, const quat& q, const vec3& s) {
+		const float xx = q.x * q.x, yy = q.y * q.y, zz = q.z * q.z;
+		const float xy = q.x * q.y, xz = q.x * q.z, yz = q.y * q.z;
+		const float wx = q.w * q.x, wy = q.w * q.y, wz = q.w * q.z;
+
+		m[0] = (1 - 2 * (yy + zz)) * s.x;
+		m[1] = 2 * (xy + wz) * s.x;
+		m[2] = 2 * (xz - wy) * s.x;
+		m[3] = 0;
+
+		m[4] = 2 * (xy - wz) * s.y;
+		m[5] = (1 - 2 * (xx + zz)) * s.y;
+		m[6] = 2 * (yz + wx) * s.y;
+		m[7] = 0;
+
+		m[8] = 2 * (xz + wy) * s.z;
+		m[9] = 2 * (yz - wx) * s.z;
+		m[10] = (1 - 2 * (xx + yy)) * s.z;
+		m[11] = 0;
+
+		m[12] = t.x; m[13] = t.y; m[14] = t.z; m[15] = 1;
+	}
+
+	// splits this matrix in translation, rotation and scale. Scale is the
+	// length of each base vector (x negative if matrix mirrors); rotation is
+	// taken from the normalized base vectors
+	void mat4::decompose(vec3& t, quat& r, vec3& s) const {
+		t = vec3(m[12], m[13], m[14]);
+		vec3 c0(m[0], m[1], m[2]), c1(m[4], m[5], m[6]), c2(m[8], m[9], m[10]);
+		s = vec3(c0.length(), c1.length(), c2.length());
+		if (c0.dot(c1.cross(c2)) < 0) s.x = -s.x;
+		if (s.x != 0) c0 *= 1.0f / s.x;
+		if (s.y != 0) c1 *= 1.0f / s.y;
+		if (s.z != 0) c2 *= 1.0f / s.z;
+
+		//largest of w, x, y, z first, for precision
+		const float trace = c0.x + c1.y + c2.z;
+		if (trace > 0) {
+			float k = 0.5f / sqrtf(trace + 1.0f);
+			r = quat(0.25f / k, (c1.z - c2.y) * k, (c2.x - c0.z) * k, (c0.y - c1.x) * k);
+		}
+		else if (c0.x > c1.y && c0.x > c2.z) {
+			float k = 2.0f * sqrtf(1.0f + c0.x - c1.y - c2.z);
+			r = quat((c1.z - c2.y) / k, 0.25f * k, (c1.x + c0.y) / k, (c2.x + c0.z) / k);
+		}
+		else if (c1.y > c2.z) {
+			float k = 2.0f * sqrtf(1.0f + c1.y - c0.x - c2.z);
+			r = quat((c2.x - c0.z) / k, (c1.x + c0.y) / k, 0.25f * k, (c2.y + c1.z) / k);
+		}
+		else {
+			float k = 2.0f * sqrtf(1.0f + c2.z - c0.x - c1.y);
+			r = quat((c0.y - c1.x) / k, (c2.x + c0.z) / k, (c2.y + c1.z) / k, 0.25f * k);
+		}
+		r.normalize();
+	}
+
 	// sets the values of this matrix to a scale matrix
 	// representing the 3 components of the parameters
 	void mat4::makeScaleMatrix(float x, float y, float z) {
@@ -471,7 +797,31 @@ namespace lm {
 	// multiplies a vec4 with a mat4
 	vec4 mat4::operator*(const vec4& v) const
 	{
+#if LM_SSE
 		vec4 ret;
+		_mm_storeu_ps(ret.value_, transformSSE_(*this, _mm_loadu_ps(v.value_)));
+		return ret;
+#else
+		return scalar::transform(*this, v);
+#endif
+	}
+
+	// multiplies column major matrices such that result = this * N
+	mat4 mat4::operator*(const mat4& N) const
+	{
+#if LM_SSE
+		mat4 result;
+		multiplySSE_(*this, N, result);
+		return result;
+#else
+		return scalar::multiply(*this, N);
+#endif
+	}
+
+	vec4 scalar::transform(const mat4& a, const vec4& v)
+	{
+		vec4 ret;
+		const float* m = a.m;
 
 		ret.x = v.x*m[0] + v.y*m[4] + v.z*m[8] + v.w*m[12];
 		ret.y = v.x*m[1] + v.y*m[5] + v.z*m[9] + v.w*m[13];
@@ -481,8 +831,7 @@ namespace lm {
 		return ret;
 	}
 
-	// multiplies column major matrices such that result = this * N
-	mat4 mat4::operator*(const mat4& N) const
+	mat4 scalar::multiply(const mat4& a, const mat4& N)
 	{
 		mat4 result;
 
@@ -496,7 +845,7 @@ namespace lm {
 					//k-j iterates row
 					//i-k iterates column
 					//this.row * N.column
-					result.M[i][j] += N.M[i][k] * M[k][j];
+					result.M[i][j] += N.M[i][k] * a.M[k][j];
 				}
 			}
 		}
@@ -504,6 +853,95 @@ namespace lm {
 		return result;
 	}
 
+	void scalar::transformMany(const mat4* a, const mat4* b, mat4* out, int n)
+	{
+		for (int i = 0; i < n; i++)
+			out[i] = multiply(a[i], b[i]);
+	}
+
+	//**************************************
+	// batches
+	//**************************************
+
+#if LM_SSE
+	static void transformManySSE_(const mat4* a, const mat4* b, mat4* out, int n)
+	{
+		for (int i = 0; i < n; i++)
+			multiplySSE_(a[i], b[i], out[i]);
+	}
+
+	//each column of result is a 256 bit register holding two columns: the
+	//columns of a are repeated in both halves and multiplied by two columns
+	//of b at once, so a product is 8 fused multiply-adds
+	LM_TARGET_AVX2 static void transformManyAVX2_(const mat4* a, const mat4* b, mat4* out, int n)
+	{
+		for (int i = 0; i < n; i++) {
+			const float* A = a[i].m;
+			const float* B = b[i].m;
+			const __m256 a0 = _mm256_broadcast_ps((const __m128*)(A + 0));
+			const __m256 a1 = _mm256_broadcast_ps((const __m128*)(A + 4));
+			const __m256 a2 = _mm256_broadcast_ps((const __m128*)(A + 8));
+			const __m256 a3 = _mm256_broadcast_ps((const __m128*)(A + 12));
+			const __m256 b01 = _mm256_loadu_ps(B);
+			const __m256 b23 = _mm256_loadu_ps(B + 8);
+
+			__m256 r01 = _mm256_mul_ps(a0, _mm256_shuffle_ps(b01, b01, 0x00));
+			r01 = _mm256_fmadd_ps(a1, _mm256_shuffle_ps(b01, b01, 0x55), r01);
+			r01 = _mm256_fmadd_ps(a2, _mm256_shuffle_ps(b01, b01, 0xAA), r01);
+			r01 = _mm256_fmadd_ps(a3, _mm256_shuffle_ps(b01, b01, 0xFF), r01);
+			__m256 r23 = _mm256_mul_ps(a0, _mm256_shuffle_ps(b23, b23, 0x00));
+			r23 = _mm256_fmadd_ps(a1, _mm256_shuffle_ps(b23, b23, 0x55), r23);
+			r23 = _mm256_fmadd_ps(a2, _mm256_shuffle_ps(b23, b23, 0xAA), r23);
+			r23 = _mm256_fmadd_ps(a3, _mm256_shuffle_ps(b23, b23, 0xFF), r23);
+
+			_mm256_storeu_ps(out[i].m, r01);
+			_mm256_storeu_ps(out[i].m + 8, r23);
+		}
+	}
+
+	static bool cpuHasAVX2FMA_()
+	{
+#ifdef _MSC_VER
+		int info[4];
+		__cpuid(info, 0);
+		if (info[0] < 7) return false;
+		__cpuid(info, 1);
+		const bool fma = (info[2] & (1 << 12)) != 0;
+		const bool osxsave = (info[2] & (1 << 27)) != 0;
+		const bool avx = (info[2] & (1 << 28)) != 0;
+		//OS must save the AVX registers too
+		if (!fma || !osxsave || !avx || (_xgetbv(0) & 6) != 6) return false;
+		__cpuidex(info, 7, 0);
+		return (info[1] & (1 << 5)) != 0;
+#else
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+	}
+
+	typedef void (*TransformManyFunc)(const mat4*, const mat4*, mat4*, int);
+	static const bool has_avx2_fma = cpuHasAVX2FMA_();
+	static const TransformManyFunc transform_many = has_avx2_fma ? transformManyAVX2_ : transformManySSE_;
+#endif
+
+	void transformMany(const mat4* a, const mat4* b, mat4* out, int n)
+	{
+#if LM_SSE
+		transform_many(a, b, out, n);
+#else
+		scalar::transformMany(a, b, out, n);
+#endif
+	}
+
+	const char* simdLevel()
+	{
+#if LM_SSE
+		return has_avx2_fma ? "avx2+fma" : "sse";
+#else
+		return "scalar";
+#endif
+	}
+
 	// turns this matrix into a view matrix
 	void mat4::lookAt(const vec3& eye, const vec3& center, const vec3& up) {
 		//create coordinate system of camera
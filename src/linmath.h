@@ -108,10 +108,26 @@ namespace lm {
 
 		quat &normalize() { *this *= (1.0f / length()); return *this; }; //both normalizes object and return reference to it
 
-		void operator *= (float v) { w *= v; x *= v; y *= v; y *= v;  }
+		void operator *= (float v) { w *= v; x *= v; y *= v; z *= v;  }
 	};
 
-	class mat4 {
+	//3x3 matrix, column-major like mat4. Used for normal matrices
+	class mat3 {
+	public:
+		union {
+			float M[3][3]; //[column][row]
+			float m[9];
+		};
+
+		mat3() { setIdentity(); }
+		mat3& setIdentity();
+
+		vec3 operator * (const vec3& vec) const;
+	};
+
+	//aligned to 16 bytes so that SSE can load columns directly (see
+	//linmath.cpp); components and vectors holding mat4 are aligned with it
+	class alignas(16) mat4 {
 	public:
 		// OpenGL and GLSL by default accept matrices in column-major format.
 		// However, we are used to writing matrices in row-major format.
@@ -134,12 +150,21 @@ namespace lm {
 
 		//sets values of this matrix to parameter. Useful for classes which
 		//inherit this class
-		void set(mat4 m);
+		void set(const mat4& m);
 
 		mat4& clear();
 		mat4& setIdentity();
 		mat4& transpose();
 		bool inverse();
+		//inverse of an affine matrix (bottom row 0 0 0 1: any translation,
+		//rotation, scale and shear), cheaper than inverse(). Returns
+		//false and leaves matrix unchanged if it is singular
+		bool inverseAffine();
+		//inverse of a matrix with only rotation and translation
+		mat4& inverseRigid();
+		//inverse transpose of the 3x3 part, which transforms normals of an
+		//affine matrix. Just the 3x3 part if there is no scale or shear
+		mat3 normalMatrix() const;
 
 		//get base vectors
 		vec3 right() const { return vec3(m[0], m[1], m[2]); }
@@ -160,6 +185,10 @@ namespace lm {
 		void makeRotationMatrix(const quat& normalized_quat);
 		void makeScaleMatrix(float x, float y, float z);
 		void makeScaleMatrix(const vec3& t);
+		//translation * rotation * scale, i.e. scales, then rotates, then translates
+		void makeTransformMatrix(const vec3& t, const quat& normalized_quat, const vec3& s);
+		//inverse of makeTransformMatrix, for matrices without shear
+		void decompose(vec3& t, quat& r, vec3& s) const;
 
 		//transform this matrix using world coordinates
 		void translate(float x, float y, float z);
@@ -203,5 +232,21 @@ namespace lm {
 	quat operator - (const quat& a, const quat& b);
 	quat operator * (const quat& a, float v);
 	quat operator * (const quat& a, const quat& b);
+	vec3 operator * (const quat& a, const vec3& v); //rotates v (a must be normalized)
+
+	//out[i] = a[i] * b[i] for n matrices, using the widest SIMD the CPU has
+	//(AVX2 and FMA, else SSE). out may be a or b
+	void transformMany(const mat4* a, const mat4* b, mat4* out, int n);
+	//SIMD used by transformMany, for benchmarks: "avx2+fma", "sse" or "scalar"
+	const char* simdLevel();
+
+	//plain C++ versions of mat4 operator*, inverse and transformMany: used
+	//where there is no SSE, and as reference for tests and benchmarks
+	namespace scalar {
+		mat4 multiply(const mat4& a, const mat4& b);
+		vec4 transform(const mat4& a, const vec4& v);
+		bool inverse(mat4& a);
+		void transformMany(const mat4* a, const mat4* b, mat4* out, int n);
+	}
 
 }
@@ -6,6 +6,7 @@
 #include "includes.h"
 #include "extern.h"
 #include "Game.h"
+#include "Benchmarks.h"
 
 
 
@@ -13,6 +14,12 @@
 Game* GAME = nullptr;
 //initialise global ECS. By including extern.h in any cpp file (NOT .h file!) we can access this variable
 EntityComponentStore ECS;
+//deferred structural changes to ECS, played back once per frame in Game::update
+EcsCommandBuffer ECS_COMMANDS;
+//worker threads shared by all systems, started in Game::init
+JobSystem JOBS;
+//cache of GL state, so that systems only make calls which change it
+GLState GL_STATE;
 
 bool glCheckError() {
     GLenum errCode;
@@ -51,8 +58,12 @@ void mouse_button_callback(GLFWwindow* window, int button, int action, int mods)
 	GAME->mouse_button_callback(button, action, mods);
 }
 
-int main(void)
+int main(int argc, char** argv)
 {
+    //run a micro-benchmark instead of the game, see Benchmarks.h
+    if (argc >= 3 && std::string(argv[1]) == "benchmark")
+        return runBenchmark(argv[2], argc >= 4 ? atoi(argv[3]) : 10000);
+
 	int WINDOW_WIDTH = 800;
 	int WINDOW_HEIGHT = 600;
 